@@ -4,7 +4,6 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include "../include/queue.h"
 #include "../include/memmngr.h"
 #include "../include/params.h"
 
@@ -14,29 +13,43 @@
 /**
  * A binary tree node.
  * @field value The terminal/function that the node holds.
+ * @field in_arena Whether the node was allocated from a node arena. A tree
+ *                 is allocated either from an arena or on the heap.
+ * @field refs The number of trees sharing the node (heap nodes only).
+ *             Shared nodes are never changed.
+ * @field height The depth of the subtree of the node.
+ * @field size The number of nodes in the subtree of the node.
  * @field left The child of the node contained in its left branch.
  * @field right The child of the node contained in its right branch.
  */
 struct node {
     char value;
+    bool in_arena;
+    short height;
+    int refs;
     struct node *left, *right;
+    int size;
 };
 
 struct node *new_node(char v);
 void free_node(struct node *node);
+struct node *retain_node(struct node *node);
+struct node *share_tree(struct node *node);
 
+void update_node(struct node *node);
+void annotate_tree(struct node *root);
 int get_number_of_nodes(struct node *root);
-struct node **get_children(struct node *root);
 int get_num_children(struct node *root);
+struct node *find_node_at_index(struct node *root, int goal_i, int *depth);
 int get_depth_at_index_wrapper(struct node *root, int goal_i);
-int get_depth_at_index(struct node *root, int goal_i, int *curr_i, int curr_depth, int *i_depth);
 struct node *get_node_at_index_wrapper(struct node *root, int goal);
-struct node *get_node_at_index(struct node *root, int goal_i, int *curr_i, struct node **goal);
 struct node *append_node(struct node *tree, char value, bool side);
 void print_nodes_index_order(struct node *root);
 int get_max_tree_depth(struct node *root);
 struct node *tree_deep_copy(struct node *node);
+struct node *replace_subtree(struct node *root, int goal_i, struct node *subtree);
 char *tree_to_string(struct node *root);
+bool tree_matches_string(struct node *root, const char *str, int len);
 void print_infix(struct node *root);
 
 #endif //PONY_GP_BINARY_TREE_H
@@ -1,27 +1,13 @@
-
 #ifndef PONY_GP_CSV_DATA_H
 #define PONY_GP_CSV_DATA_H
 
-extern double **fitness_cases;
-extern double *targets;
-
-extern int fitness_len;
-extern int targets_len;
-
-extern int fitness_split;
+#include "../include/dataset.h"
 
-extern double **test_cases;
-extern double *test_targets;
-extern double **training_cases;
-extern double *training_targets;
-
-extern int training_len;
-extern int test_len;
+extern struct dataset *fitness_data;
+extern struct dataset *training_data;
+extern struct dataset *test_data;
 
 extern char *headers;
 extern int num_headers;
 
-extern int num_exemplars;
-extern int num_columns;
-
 #endif //PONY_GP_CSV_DATA_H
@@ -0,0 +1,54 @@
+#ifndef PONY_GP_DAG_H
+#define PONY_GP_DAG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <ctype.h>
+#include "../include/memmngr.h"
+#include "../include/binary_tree.h"
+#include "../include/dataset.h"
+#include "../include/program.h"
+#include "../include/kernels.h"
+#include "../include/semantic_cache.h"
+
+/**
+ * A node of a hash-consed DAG. Structurally identical subtrees are
+ * stored once, as the same node.
+ * @field value The symbol of the node. MISSING_NODE_SYMBOL for a missing child.
+ * @field left, right The indexes of the children, or -1 for a leaf.
+ * @field refs The number of references to the node, from parents and from roots.
+ * @field chain The index of the next node in the same bucket, or -1.
+ */
+struct dag_node {
+    char value;
+    int left, right;
+    int refs;
+    int chain;
+};
+
+/**
+ * A store of trees where every unique subtree is interned once. The
+ * nodes are kept in the order they were created, so every node comes
+ * after its children.
+ * @field nodes The unique nodes.
+ * @field len The number of unique nodes.
+ * @field capacity The largest number of nodes the store can hold.
+ * @field buckets The hash table, the index of the first node of each bucket or -1.
+ * @field num_buckets The number of buckets, a power of two.
+ * @field interned The number of tree nodes interned, shared or not.
+ */
+struct dag {
+    struct dag_node *nodes;
+    int len;
+    int capacity;
+    int *buckets;
+    int num_buckets;
+    long interned;
+};
+
+struct dag *new_dag(int capacity);
+void free_dag(struct dag *d);
+int intern_tree(struct dag *d, struct node *root);
+void dag_squared_errors(struct dag *d, const int *roots, int num_roots, struct dataset *data, double *errors);
+
+#endif //PONY_GP_DAG_H
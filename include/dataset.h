@@ -0,0 +1,60 @@
+#ifndef PONY_GP_DATASET_H
+#define PONY_GP_DATASET_H
+
+#include <stdint.h>
+#include <string.h>
+#include "../include/memmngr.h"
+
+// Columns are aligned to, and padded to a multiple of, this many bytes.
+// A cache line, and wide enough for any of the SIMD kernels.
+#define DATASET_ALIGNMENT 64
+#define DATASET_PADDING (DATASET_ALIGNMENT / (int) sizeof(double))
+#define FLOAT_DATASET_PADDING (DATASET_ALIGNMENT / (int) sizeof(float))
+
+/**
+ * A set of fitness cases stored one column per variable. All columns
+ * live in a single aligned block, so an evaluator can stream a column
+ * without following a pointer per fitness case. The values between
+ * `len` and `stride` are zero.
+ * @field columns The input columns, one per variable.
+ * @field targets The target value (output) of each fitness case.
+ * @field num_inputs The number of input columns.
+ * @field len The number of fitness cases.
+ * @field stride The allocated length of each column.
+ * @field block The allocation the columns live in.
+ */
+struct dataset {
+    double **columns;
+    double *targets;
+    int num_inputs;
+    int len;
+    int stride;
+    void *block;
+};
+
+/**
+ * A single precision copy of a dataset, laid out the same way.
+ * @field columns The input columns, one per variable.
+ * @field targets The target value (output) of each fitness case.
+ * @field num_inputs The number of input columns.
+ * @field len The number of fitness cases.
+ * @field stride The allocated length of each column.
+ * @field block The allocation the columns live in.
+ */
+struct float_dataset {
+    float **columns;
+    float *targets;
+    int num_inputs;
+    int len;
+    int stride;
+    void *block;
+};
+
+struct dataset *new_dataset(int len, int num_inputs);
+void free_dataset(struct dataset *d);
+uint64_t hash_dataset(struct dataset *d);
+struct dataset *dataset_subset(struct dataset *d, const int *indexes, int len);
+struct float_dataset *new_float_dataset(struct dataset *d);
+void free_float_dataset(struct float_dataset *d);
+
+#endif //PONY_GP_DATASET_H
@@ -0,0 +1,61 @@
+#ifndef PONY_GP_FITNESS_CACHE_H
+#define PONY_GP_FITNESS_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "../include/memmngr.h"
+#include "../include/binary_tree.h"
+#include "../include/misc_util.h"
+
+/**
+ * A slot of a fitness cache.
+ * @field hash The hash of the genome, see hash_tree().
+ * @field key The string of the genome (see tree_to_string()), or the other
+ *            key the fitness is cached under, to rule out hash collisions,
+ *            or NULL if the slot is empty.
+ * @field key_len The length of the key.
+ * @field fitness The fitness of the genome.
+ * @field referenced Set when the entry is used, cleared as the clock hand passes it.
+ */
+struct fitness_entry {
+    uint64_t hash;
+    char *key;
+    int key_len;
+    double fitness;
+    bool referenced;
+};
+
+/**
+ * A bounded cache of the fitness of genomes, or of fitness under other
+ * keys, in an open-addressing hash table with linear probing. When the
+ * cache is full, an entry is evicted by the CLOCK policy: the hand sweeps
+ * the slots, sparing each entry that was used since it last passed.
+ * @field slots The hash table.
+ * @field num_slots The number of slots, a power of two, at least twice the capacity.
+ * @field capacity The maximum number of entries.
+ * @field len The number of entries.
+ * @field hand The slot the clock hand is at.
+ * @field hits, misses, evictions Counters since the last call to print_fitness_cache().
+ */
+struct fitness_cache {
+    struct fitness_entry *slots;
+    size_t num_slots;
+    size_t capacity;
+    size_t len;
+    size_t hand;
+    long hits, misses, evictions;
+};
+
+struct fitness_cache *init_fitness_cache(size_t capacity);
+void free_fitness_cache(struct fitness_cache *c);
+uint64_t hash_tree(struct node *root);
+bool get_fitness_cache(struct fitness_cache *c, uint64_t hash, struct node *genome, double *fitness);
+bool put_fitness_cache(struct fitness_cache *c, uint64_t hash, struct node *genome, double fitness);
+bool get_fitness_cache_key(struct fitness_cache *c, uint64_t hash, const char *key, int key_len, double *fitness);
+bool put_fitness_cache_key(struct fitness_cache *c, uint64_t hash, const char *key, int key_len, double fitness);
+void print_fitness_cache(struct fitness_cache *c, const char *name);
+void move_fitness_cache_counts(struct fitness_cache *to, struct fitness_cache *from);
+
+#endif //PONY_GP_FITNESS_CACHE_H
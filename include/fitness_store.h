@@ -0,0 +1,95 @@
+#ifndef PONY_GP_FITNESS_STORE_H
+#define PONY_GP_FITNESS_STORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "../include/memmngr.h"
+#include "../include/binary_tree.h"
+#include "../include/misc_util.h"
+
+#ifdef PONY_GP_THREADS
+#include <pthread.h>
+#endif
+
+#ifdef PONY_GP_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Starts every record of a fitness cache file.
+#define FITNESS_RECORD_MAGIC 0x31544650u
+
+/**
+ * A record of a fitness cache file, followed by its key padded to a
+ * multiple of 8 bytes. The file is only used on one host, so numbers
+ * are in the host's byte order.
+ * @field magic FITNESS_RECORD_MAGIC.
+ * @field key_len The length of the key, the string of the genome (see tree_to_string()).
+ * @field fingerprint The fingerprint of the fitness cases the fitness was computed on.
+ * @field hash The hash of the genome, see hash_tree().
+ * @field fitness The fitness of the genome.
+ * @field check A hash of the other fields and the key, which tells a
+ *              record that was only partly written.
+ */
+struct fitness_record {
+    uint32_t magic;
+    uint32_t key_len;
+    uint64_t fingerprint;
+    uint64_t hash;
+    double fitness;
+    uint64_t check;
+};
+
+/**
+ * A fitness cache file, shared by runs on the same fitness cases. Runs
+ * append a record for every genome they evaluate, with one write each,
+ * so that several processes can append to the file at once. The records
+ * that were in the file when it was opened are memory-mapped and found
+ * through a hash table of their offsets. Records of other fitness cases
+ * are skipped. A genome is only appended if it had no record when the
+ * file was opened, and was not appended since.
+ * @field fd The file.
+ * @field fingerprint The fingerprint of the fitness cases of this run.
+ * @field map The mapped records, or NULL if there were none.
+ * @field map_size The number of bytes mapped.
+ * @field index The offset plus 1 of the record in each slot, or 0 if the slot is empty.
+ * @field num_slots The number of slots, a power of two, at least twice the number of records.
+ * @field len The number of records in the index.
+ * @field appended The hashes of the genomes appended since the file was
+ *                 opened, in a hash table where 0 is an empty slot.
+ * @field appended_slots The number of slots of `appended`, a power of two.
+ * @field appended_len The number of hashes in `appended`.
+ * @field lock Guards `appended`.
+ * @field failed Set when a record could not be appended, so no more are.
+ * @field hits, added Counters since the last call to print_fitness_store().
+ */
+struct fitness_store {
+    int fd;
+    uint64_t fingerprint;
+    const unsigned char *map;
+    size_t map_size;
+    size_t *index;
+    size_t num_slots;
+    size_t len;
+    uint64_t *appended;
+    size_t appended_slots;
+    size_t appended_len;
+#ifdef PONY_GP_THREADS
+    pthread_mutex_t lock;
+#endif
+    bool failed;
+    long hits, added;
+};
+
+struct fitness_store *open_fitness_store(const char *path, uint64_t fingerprint);
+void close_fitness_store(struct fitness_store *s);
+bool get_fitness_store(struct fitness_store *s, uint64_t hash, struct node *genome, double *fitness);
+void put_fitness_store(struct fitness_store *s, uint64_t hash, struct node *genome, double fitness);
+void print_fitness_store(struct fitness_store *s);
+
+#endif //PONY_GP_FITNESS_STORE_H
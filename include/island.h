@@ -0,0 +1,91 @@
+
+#ifndef PONY_GP_ISLAND_H
+#define PONY_GP_ISLAND_H
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "../include/memmngr.h"
+#include "../include/misc_util.h"
+#include "../include/rand_util.h"
+
+#ifdef PONY_GP_THREADS
+#include <pthread.h>
+#endif
+
+// The number of messages a mailbox holds. A power of two.
+#define MAILBOX_CAPACITY 4
+
+#define RING_TOPOLOGY 0
+#define RANDOM_TOPOLOGY 1
+
+/**
+ * Runs generation `generation` of island `island`. Generation 0 creates
+ * the initial population.
+ */
+typedef void (*island_step)(void *context, int island, int generation);
+
+/**
+ * Returns the message with the migrants that leave island `island`.
+ */
+typedef void *(*island_emigrate)(void *context, int island);
+
+/**
+ * Adds the migrants of a message to island `island`.
+ */
+typedef void (*island_immigrate)(void *context, int island, void *migrants);
+
+/**
+ * A queue of messages from one island to another. Only the sending
+ * island writes `tail` and only the receiving island writes `head`, so
+ * no lock is needed.
+ * @field messages The queued messages are messages[head] to
+ *                 messages[tail - 1], modulo the capacity.
+ * @field head The number of messages received.
+ * @field tail The number of messages sent.
+ */
+struct mailbox {
+    void *messages[MAILBOX_CAPACITY];
+    unsigned long head;
+    unsigned long tail;
+};
+
+/**
+ * A set of islands that evolve separately, except that every `interval`
+ * generations each island sends migrants to another island.
+ * @field num_islands The number of islands.
+ * @field interval The number of generations between migrations.
+ * @field topology Which island each island sends to. RING_TOPOLOGY to send
+ *                 to the next island, RANDOM_TOPOLOGY to send around a
+ *                 random cycle of the islands, drawn for each migration.
+ * @field mailboxes The mailbox from island i to island j is mailboxes[i * num_islands + j].
+ * @field migrations The number of messages sent by each island.
+ * @field step, emigrate, immigrate, context The functions run for each island and their argument.
+ * @field generations The number of generations to run.
+ */
+struct archipelago {
+    int num_islands;
+    int interval;
+    int topology;
+    struct mailbox *mailboxes;
+    long *migrations;
+    island_step step;
+    island_emigrate emigrate;
+    island_immigrate immigrate;
+    void *context;
+    int generations;
+};
+
+struct archipelago *new_archipelago(int num_islands, int generations, int interval, int topology);
+void free_archipelago(struct archipelago *a);
+void run_archipelago(struct archipelago *a, island_step step, island_emigrate emigrate,
+                     island_immigrate immigrate, void *context);
+bool is_migration(struct archipelago *a, int generation);
+int get_migration_target(struct archipelago *a, int island, int generation, bool source);
+void mailbox_send(struct mailbox *m, void *message);
+void *mailbox_receive(struct mailbox *m);
+void lock_output(void);
+void unlock_output(void);
+void print_archipelago(struct archipelago *a);
+
+#endif //PONY_GP_ISLAND_H
@@ -0,0 +1,52 @@
+#ifndef PONY_GP_JIT_H
+#define PONY_GP_JIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "../include/memmngr.h"
+#include "../include/program.h"
+#include "../include/dataset.h"
+#include "../include/kernels.h"
+
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__) && !defined(__EMSCRIPTEN__)
+#define PONY_GP_JIT_SUPPORTED 1
+#endif
+
+// Programs that need more stack than this fall back to the interpreter.
+// Each stack entry is a register, and two registers are kept as scratch.
+#define JIT_MAX_STACK 14
+
+// Programs longer than this fall back to the interpreter.
+#define JIT_MAX_INSTRUCTIONS 4096
+
+/**
+ * The signature of a compiled program. Computes the outputs of the
+ * fitness cases `start` to `end` (exclusive, a multiple of two cases
+ * past `start`) into `out[0]` to `out[end - start - 1]`.
+ */
+typedef void (*jit_function)(double *const *columns, double *out, long start, long end,
+                             const double *constants);
+
+/**
+ * A program compiled to native code.
+ * @field function The entry point of the code.
+ * @field constants The constant table read by the code.
+ * @field buffer The executable mapping holding the constants and the code.
+ * @field size The size of the mapping.
+ */
+struct jit_program {
+    jit_function function;
+    const double *constants;
+    void *buffer;
+    size_t size;
+};
+
+bool jit_available(void);
+struct jit_program *jit_compile(struct program *p);
+void jit_free(struct jit_program *j);
+double jit_squared_error(struct jit_program *j, struct dataset *data, double limit, int *evaluated);
+void jit_block_errors(struct jit_program *j, struct dataset *data, int start, int end, double *errors);
+
+#endif //PONY_GP_JIT_H
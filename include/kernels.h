@@ -0,0 +1,42 @@
+#ifndef PONY_GP_KERNELS_H
+#define PONY_GP_KERNELS_H
+
+#include <stdio.h>
+#include <math.h>
+#include "../include/program.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(__EMSCRIPTEN__)
+#define PONY_GP_X86_KERNELS 1
+#endif
+
+/**
+ * A set of column kernels. Every kernel works on whole columns of `n`
+ * values. The output column may be the same array as one of the inputs.
+ * @field name The name of the instruction set used by the kernels.
+ * @field add, sub, mul Element-wise arithmetic: out[i] = left[i] op right[i].
+ * @field pdiv Element-wise protected division, see evaluate().
+ * @field squared_error The sum of (outputs[i] - targets[i])^2.
+ * @field add_float, sub_float, mul_float, pdiv_float, squared_error_float
+ *        The same kernels on single precision columns. The squared
+ *        errors are summed in single precision.
+ */
+struct kernels {
+    const char *name;
+    void (*add)(double *out, const double *left, const double *right, int n);
+    void (*sub)(double *out, const double *left, const double *right, int n);
+    void (*mul)(double *out, const double *left, const double *right, int n);
+    void (*pdiv)(double *out, const double *left, const double *right, int n);
+    double (*squared_error)(const double *outputs, const double *targets, int n);
+    void (*add_float)(float *out, const float *left, const float *right, int n);
+    void (*sub_float)(float *out, const float *left, const float *right, int n);
+    void (*mul_float)(float *out, const float *left, const float *right, int n);
+    void (*pdiv_float)(float *out, const float *left, const float *right, int n);
+    double (*squared_error_float)(const float *outputs, const float *targets, int n);
+};
+
+void init_kernels(void);
+const struct kernels *get_kernels(void);
+void fill_column(double *out, double value, int n);
+void fill_column_float(float *out, float value, int n);
+
+#endif //PONY_GP_KERNELS_H
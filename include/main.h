@@ -11,42 +11,229 @@
 #include <stdbool.h>
 #include "../include/memmngr.h"
 #include "../include/binary_tree.h"
-#include "../include/queue.h"
+#include "../include/node_arena.h"
+#include "../include/prefix_genome.h"
 #include "../include/rand_util.h"
 #include "../include/misc_util.h"
 #include "../include/hashmap.h"
+#include "../include/fitness_cache.h"
+#include "../include/fitness_store.h"
 #include "../include/params.h"
 #include "../include/config_parser.h"
 #include "../include/csv_parser.h"
+#include "../include/program.h"
+#include "../include/kernels.h"
+#include "../include/jit.h"
+#include "../include/semantic_cache.h"
+#include "../include/semantics.h"
+#include "../include/dag.h"
+#include "../include/thread_pool.h"
+#include "../include/island.h"
+#include "../include/migration.h"
 #include "../include/tests.h"
 
 #define DEFAULT_FITNESS (-DBL_MAX)
-#define EXPERIMENTAL_OUTPUT 0
 
+/**
+ * An individual solution.
+ * @field genome The tree.
+ * @field fitness The fitness of the evaluated tree.
+ * @field exact Set when the fitness was computed in double precision by
+ *              rescore_individual(), so that it is not computed again.
+ * @field deduplicated Set when the fitness was taken from a genome with the
+ *                     same outputs on the probe cases, see get_cached_fitness().
+ * @field semantics The outputs of the nodes of the tree on the training
+ *                  data (incremental evaluation only), or NULL.
+ * @field origins The semantics of the parents, used to evaluate the
+ *                individual incrementally, or NULL.
+ * @field prefix The genome in prefix order (`PREFIX_VARIATION` only), or NULL.
+ * @field probe The outputs of the genome on the probe cases, kept from the
+ *              fitness cache lookup until the fitness is cached, or NULL.
+ */
 struct individual {
     struct node *genome;
     double fitness;
+    bool exact;
+    bool deduplicated;
+    struct semantics *semantics;
+    struct semantics *origins[2];
+    struct prefix_genome *prefix;
+    double *probe;
+};
+
+/**
+ * A batch of individuals evaluated by the thread pool.
+ * @field pop The population.
+ * @field pending The indexes of the individuals to evaluate.
+ * @field evaluated Set to the number of fitness cases evaluated for each individual.
+ * @field threshold The racing threshold of the thread that started the batch.
+ */
+struct evaluation_batch {
+    struct individual **pop;
+    const int *pending;
+    int *evaluated;
+    double threshold;
+};
+
+/**
+ * The offspring of a generation, varied, and evaluated if `evaluate` is
+ * set, by the thread pool a pair at a time.
+ * @field pairs The parents of each pair of offspring.
+ * @field streams The random stream of each pair, after choosing the parents.
+ * @field new_pop Set to the offspring.
+ * @field arena The arena the offspring are allocated from, or NULL.
+ * @field generation The generation of the offspring.
+ * @field evaluate Whether the offspring are evaluated with their variation.
+ * @field hashes Set to the hash of each offspring's genome.
+ * @field evaluated Set to the number of fitness cases evaluated for each
+ *                  offspring, or -1 if its fitness was in the cache.
+ * @field cache, output_cache The fitness caches of the thread that started the batch.
+ * @field threshold The racing threshold of the thread that started the batch.
+ */
+struct variation_batch {
+    struct individual **pairs;
+    struct rng *streams;
+    struct individual **new_pop;
+    struct node_arena *arena;
+    int generation;
+    bool evaluate;
+    uint64_t *hashes;
+    int *evaluated;
+    struct fitness_cache *cache, *output_cache;
+    double threshold;
+};
+
+/**
+ * A batch of individuals evaluated by the thread pool a shard of the
+ * training data at a time.
+ * @field programs, natives The compiled genome of each individual.
+ * @field errors The squared error of each block, for each individual.
+ * @field num_blocks The number of blocks of the training data.
+ * @field shards The number of shards.
+ * @field shard_blocks The number of blocks per shard.
+ */
+struct shard_batch {
+    struct program **programs;
+    struct jit_program **natives;
+    double *errors;
+    int num_blocks;
+    int shards;
+    int shard_blocks;
+};
+
+/**
+ * The state of a steady-state search, shared by the jobs on the thread pool.
+ * @field pop The population.
+ * @field evaluations The number of offspring evaluated.
+ * @field generation The last generation whose statistics were printed. A
+ *                   generation is `POPULATION_SIZE` evaluations.
+ * @field time When the statistics were last printed.
+ * @field racing_abandoned, racing_skipped The racing statistics of the jobs
+ *                                         since the statistics were last printed.
+ * @field cache_counts, output_counts The counters of the jobs' fitness and
+ *                                    probe-output caches since the statistics
+ *                                    were last printed. They hold no entries.
+ * @field lock Guards the other fields.
+ */
+struct steady_state {
+    struct individual **pop;
+    long evaluations;
+    int generation;
+    double time;
+    long racing_abandoned;
+    long racing_skipped;
+    struct fitness_cache cache_counts;
+    struct fitness_cache output_counts;
+#ifdef PONY_GP_THREADS
+    pthread_mutex_t lock;
+#endif
+};
+
+/**
+ * The populations of the islands of an island model search.
+ * @field pops The population of each island, sorted after every generation.
+ * @field new_pops Space for the next generation of each island.
+ * @field arenas The arena of the genomes of each island, or NULL.
+ */
+struct island_populations {
+    struct individual ***pops;
+    struct individual ***new_pops;
+    struct node_arena **arenas;
+};
+
+/**
+ * Individuals sent from one island to another.
+ * @field count The number of individuals.
+ * @field individuals The individuals, with their own genomes.
+ */
+struct migrants {
+    int count;
+    struct individual **individuals;
 };
 
 void setup(void);
+void init_pop_cache(void);
+void get_probe_outputs(struct dataset *probe, struct node *genome, double *outputs);
+bool get_cached_fitness(struct fitness_cache *cache, struct fitness_cache *outputs, uint64_t hash,
+                        struct individual *ind);
+void cache_fitness(uint64_t hash, struct individual *ind);
 struct individual *run(struct individual **pop);
 char get_random_symbol(int curr_depth, int max_depth, bool must_fill);
-void subtree_mutation(struct node *root);
+struct node *subtree_mutation(struct node *root);
 struct node **subtree_crossover(struct node *p1, struct node *p2);
+struct prefix_genome *prefix_mutation(struct prefix_genome *g);
+struct prefix_genome **prefix_crossover(struct prefix_genome *p1, struct prefix_genome *p2);
+void crossover_individuals(struct individual *p1, struct individual *p2, struct individual **offspring);
+void mutate_offspring(struct individual *ind);
+void flatten_individual(struct individual *ind);
 struct individual *new_individual(struct node *genome, double fitness);
+void set_origins(struct individual *child, struct individual *p1, struct individual *p2);
 void free_individual(struct individual *i);
+void release_origins(struct individual *i);
+void release_probe(struct individual *i);
 void print_individual(struct individual *i);
 double evaluate(struct node *node, double *fitness_case);
-void evaluate_individual(struct individual *ind, bool test);
+int evaluate_individual(struct individual *ind, bool test);
+void rescore_individual(struct individual *ind);
+void rescore_population(struct individual **pop);
 void evaluate_population(struct individual **pop);
+void record_evaluations(struct individual **pop, const uint64_t *hashes, const int *pending, const int *evaluated,
+                        int num_pending);
+void evaluate_task(void *context, int task);
+int get_num_shards(int num_individuals);
+void evaluate_sharded(struct individual **pop, const int *pending, int num_pending, int *evaluated, int shards);
+void shard_task(void *context, int task);
+void evaluate_population_dag(struct individual **pop);
 void init_population(struct individual **pop);
 void sort_population(struct individual **pop, int size);
+double get_nth_best_fitness(struct individual **pop, int n);
 int fitness_comp(const void *elem1, const void *elem2);
 void print_population(struct individual **pop, int size);
 void print_stats(int generation, struct individual **pop, double duration);
 struct individual **tournament_selection(struct individual **pop);
 void generational_replacement(struct individual **new_pop, struct individual **old_pop);
 struct individual *search_loop(struct individual **pop);
+void next_generation(struct individual ***population, struct individual ***scratch, struct node_arena **arena,
+                     int generation);
+void pair_parents(struct individual **parents, struct variation_batch *batch);
+void variation_task(void *context, int task);
+struct individual *search_steady_state(struct individual **pop);
+void steady_state_task(void *context, int task);
+void evaluate_offspring(struct individual *ind);
+int steady_state_tournament(struct individual **pop, bool inverse);
+void lock_steady_state(struct steady_state *ss);
+void unlock_steady_state(struct steady_state *ss);
+struct individual *search_islands(void);
+void island_generation(void *context, int island, int generation);
+void *select_migrants(void *context, int island);
+void accept_migrants(void *context, int island, void *migrants);
+void evolve_island(struct island_populations *islands, int island, int generation);
+struct individual *search_processes(void);
+void island_process_main(int island, int fd);
+void send_island_stats(int fd, int island, int generation, struct individual **pop, double duration);
+unsigned char *pack_migrants(struct migrants *m, size_t *length);
+struct migrants *unpack_migrants(const unsigned char *payload, size_t length);
+void free_migrants(struct migrants *m);
 void swap_populations(struct individual ***pop1, struct individual ***pop2);
 void out_of_sample_test(struct individual *i);
 void print_params_minimal(void);
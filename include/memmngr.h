@@ -9,6 +9,10 @@
 #include "../include/params.h"
 
 #define DEFAULT_MEMORY_POOL_SIZE 1000000 // 1 megabyte
+// Blocks are aligned to this many bytes, and sized in multiples of it.
+#define MEMORY_ALIGNMENT 16
+// Blocks of up to NUM_SIZE_CLASSES * MEMORY_ALIGNMENT bytes are pooled.
+#define NUM_SIZE_CLASSES 32
 
 bool is_initialized(void);
 size_t get_current_max_size(void);
@@ -0,0 +1,68 @@
+#ifndef PONY_GP_MIGRATION_H
+#define PONY_GP_MIGRATION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "../include/memmngr.h"
+#include "../include/binary_tree.h"
+
+#ifdef PONY_GP_PROCESSES
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#define MSG_STATS 1
+#define MSG_MIGRANTS 2
+#define MSG_BEST 3
+
+// Set on the symbol of an encoded node that is followed by its children.
+#define ENCODED_CHILDREN 0x80
+
+/**
+ * The header of a message between an island process and the coordinator.
+ * The processes run on the same host, so numbers are in the host's
+ * byte order.
+ * @field type MSG_STATS, MSG_MIGRANTS or MSG_BEST.
+ * @field island The sending island, or for migrants the receiving island.
+ * @field generation The generation the message is about.
+ * @field length The number of bytes of the payload that follows.
+ */
+struct message_header {
+    uint32_t type;
+    int32_t island;
+    int32_t generation;
+    uint32_t length;
+};
+
+/**
+ * The statistics of a generation of an island. Followed by the encoded
+ * genome of the best individual in a MSG_STATS payload.
+ */
+struct island_stats {
+    double duration;
+    double fitness_average;
+    double fitness_std;
+    double size_average;
+    double best_fitness;
+};
+
+/**
+ * Runs island `island`, sending its messages to the coordinator over `fd`.
+ */
+typedef void (*island_process)(int island, int fd);
+
+size_t get_encoded_size(struct node *root);
+size_t encode_genome(struct node *root, unsigned char *buffer);
+struct node *decode_genome(const unsigned char **buffer, const unsigned char *end);
+bool send_message(int fd, uint32_t type, int island, int generation, const void *payload, size_t length);
+void *receive_message(int fd, struct message_header *header);
+bool run_island_processes(int num_processes, island_process run, struct node **best_genome, double *best_fitness);
+
+#endif //PONY_GP_MIGRATION_H
@@ -8,6 +8,43 @@
 #include <string.h>
 #include "../include/hashmap.h"
 
+// Gives each thread its own copy of a global variable.
+#if defined(PONY_GP_THREADS) && defined(__GNUC__)
+#define THREAD_LOCAL __thread
+#else
+#define THREAD_LOCAL
+#endif
+
+// Counters and flags that several threads update at once, where the order
+// of the updates does not matter. The additions give the new value.
+#if defined(PONY_GP_THREADS) && defined(__GNUC__)
+#define ADD_RELAXED(p, v) __atomic_add_fetch(p, v, __ATOMIC_RELAXED)
+#define LOAD_RELAXED(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+#define STORE_RELAXED(p, v) __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#else
+#define ADD_RELAXED(p, v) (*(p) += (v))
+#define LOAD_RELAXED(p) (*(p))
+#define STORE_RELAXED(p, v) (*(p) = (v))
+#endif
+
+// Values handed from one thread to another: a load that sees a store also
+// sees what the storing thread wrote before it.
+#if defined(PONY_GP_THREADS) && defined(__GNUC__)
+#define LOAD_ACQUIRE(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#else
+#define LOAD_ACQUIRE(p) (*(p))
+#define STORE_RELEASE(p, v) (*(p) = (v))
+#endif
+
+// Reference counts: the thread that drops the last reference sees what the
+// others wrote before dropping theirs. Gives the new value.
+#if defined(PONY_GP_THREADS) && defined(__GNUC__)
+#define SUB_ACQ_REL(p, v) __atomic_sub_fetch(p, v, __ATOMIC_ACQ_REL)
+#else
+#define SUB_ACQ_REL(p, v) (*(p) -= (v))
+#endif
+
 /**
  * A wrapper for the functions and terminals that the program can use.
  * Keeps track of arities and the amount of functions and terminals available
@@ -0,0 +1,49 @@
+#ifndef PONY_GP_NODE_ARENA_H
+#define PONY_GP_NODE_ARENA_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "../include/memmngr.h"
+#include "../include/binary_tree.h"
+#include "../include/misc_util.h"
+
+#ifdef PONY_GP_THREADS
+#include <pthread.h>
+#endif
+
+// The number of nodes a thread takes from an arena at a time.
+#define ARENA_CHUNK_NODES 4096
+
+/**
+ * A chunk of nodes handed out by an arena.
+ * @field next The chunk taken before this one.
+ * @field nodes The nodes.
+ */
+struct arena_chunk {
+    struct arena_chunk *next;
+    struct node nodes[ARENA_CHUNK_NODES];
+};
+
+/**
+ * Nodes allocated with a bump pointer and freed all at once. Each thread
+ * takes a chunk of nodes at a time, so that threads rarely wait for each other.
+ * @field id Tells the arena apart from arenas freed before it.
+ * @field chunks The chunks taken from the arena.
+ * @field lock Guards chunks.
+ */
+struct node_arena {
+    unsigned long id;
+    struct arena_chunk *chunks;
+#ifdef PONY_GP_THREADS
+    pthread_mutex_t lock;
+#endif
+};
+
+struct node_arena *new_node_arena(void);
+void free_node_arena(struct node_arena *arena);
+struct node_arena *use_node_arena(struct node_arena *arena);
+bool is_node_arena_used(void);
+struct node *allocate_arena_node(void);
+struct node *compact_tree(struct node *root, struct node_arena *arena);
+
+#endif //PONY_GP_NODE_ARENA_H
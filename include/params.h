@@ -4,6 +4,9 @@
 
 #include <stdbool.h>
 
+// Print only the parameters and the best fitness, for experiments.
+#define EXPERIMENTAL_OUTPUT 0
+
 extern bool VERBOSE;
 extern int POPULATION_SIZE;
 extern int MAX_DEPTH;
@@ -14,8 +17,27 @@ extern double SEED;
 extern double CROSSOVER_PROBABILITY;
 extern double MUTATION_PROBABILITY;
 extern double TEST_TRAIN_SPLIT;
+extern bool JIT;
+extern int FITNESS_CACHE_SIZE;
+extern double SEMANTIC_CACHE_SIZE;
+extern int SEMANTIC_DEDUPLICATION;
+extern int SEMANTIC_DEDUPLICATION_CHECK;
+extern bool INCREMENTAL_EVALUATION;
+extern bool RACING;
+extern bool FLOAT_EVALUATION;
+extern bool DAG_EVALUATION;
+extern int THREADS;
+extern int ROW_SHARDING;
+extern int ISLANDS;
+extern int MIGRATION_INTERVAL;
+extern int MIGRATION_SIZE;
+extern int MIGRATION_TOPOLOGY;
+extern int PROCESSES;
+extern bool STEADY_STATE;
+extern bool PREFIX_VARIATION;
 
 extern char *CONFIG_DIR;
 extern char *CSV_DIR;
+extern char *FITNESS_CACHE_FILE;
 
 #endif //PONY_GP_PARAMS_H
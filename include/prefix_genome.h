@@ -0,0 +1,36 @@
+#ifndef PONY_GP_PREFIX_GENOME_H
+#define PONY_GP_PREFIX_GENOME_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "../include/memmngr.h"
+#include "../include/binary_tree.h"
+
+/**
+ * A genome stored as its symbols in prefix order, so that the subtree at
+ * an index is a contiguous run of symbols starting there. A node with
+ * one child has it on the left.
+ * @field len The number of symbols.
+ * @field symbols The symbols in prefix order, NUL terminated, so that they
+ *                are also the string of the tree (see tree_to_string()).
+ * @field sizes The size of the subtree at each index.
+ * @field depths The depth of the node at each index.
+ */
+struct prefix_genome {
+    int len;
+    char *symbols;
+    int *sizes;
+    int *depths;
+};
+
+struct prefix_genome *new_prefix_genome(struct node *root);
+struct prefix_genome *copy_prefix_genome(const struct prefix_genome *g);
+void free_prefix_genome(struct prefix_genome *g);
+char *prefix_genome_to_string(const struct prefix_genome *g);
+struct node *prefix_genome_to_tree(const struct prefix_genome *g);
+int get_prefix_subtree_depth(const struct prefix_genome *g, int i);
+struct prefix_genome *splice_prefix_genome(const struct prefix_genome *g, int i,
+                                           const struct prefix_genome *donor, int j);
+
+#endif //PONY_GP_PREFIX_GENOME_H
@@ -0,0 +1,68 @@
+#ifndef PONY_GP_PROGRAM_H
+#define PONY_GP_PROGRAM_H
+
+#include <stdlib.h>
+#include <ctype.h>
+#include <math.h>
+#include <float.h>
+#include <assert.h>
+#include "../include/memmngr.h"
+#include "../include/binary_tree.h"
+#include "../include/dataset.h"
+
+#define OP_CONST 0
+#define OP_VAR 1
+#define OP_ADD 2
+#define OP_SUB 3
+#define OP_MUL 4
+#define OP_DIV 5
+
+// Denominators smaller than this (in magnitude) are replaced by 1.0.
+#define PROTECTED_DIVISION_LIMIT 0.00001
+
+// The value of a missing child, as returned by evaluate().
+#define MISSING_NODE_VALUE (-DBL_MAX)
+
+// The number of fitness cases each column instruction works on at a time.
+// Small enough that the stack of blocks stays in cache.
+#define EVAL_BLOCK_SIZE 256
+
+/**
+ * A single instruction of a compiled program.
+ * @field opcode The operation, one of the OP_* macros.
+ * @field index The fitness case column pushed by OP_VAR.
+ * @field constant The value pushed by OP_CONST.
+ */
+struct instruction {
+    unsigned char opcode;
+    int index;
+    double constant;
+};
+
+/**
+ * A genome compiled to a linear postfix program. Running the program
+ * on a fitness case gives the same value as evaluating the tree.
+ * @field code The instructions in postfix order.
+ * @field len The number of instructions.
+ * @field max_stack The largest number of values on the stack at once.
+ */
+struct program {
+    struct instruction *code;
+    int len;
+    int max_stack;
+};
+
+struct program *compile_program(struct node *root);
+void free_program(struct program *p);
+double run_program(struct program *p, const double *fitness_case, double *stack);
+const double *run_program_block(struct program *p, struct dataset *data, int start, int n,
+                                double *scratch, const double **stack);
+double program_squared_error(struct program *p, struct dataset *data, double limit, int *evaluated);
+const float *run_program_block_float(struct program *p, struct float_dataset *data, int start, int n,
+                                     float *scratch, const float **stack);
+double program_squared_error_float(struct program *p, struct float_dataset *data, double limit, int *evaluated);
+void program_block_errors(struct program *p, struct dataset *data, int start, int end, double *errors);
+void program_block_errors_float(struct program *p, struct float_dataset *data, int start, int end, double *errors);
+double sum_block_errors(const double *errors, int len, double limit, int *evaluated);
+
+#endif //PONY_GP_PROGRAM_H
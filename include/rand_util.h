@@ -1,15 +1,55 @@
-
 #ifndef PONY_GP_RAND_UTIL_H
 #define PONY_GP_RAND_UTIL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <time.h>
 #include "../include/params.h"
 #include "../include/memmngr.h"
 #include "../include/misc_util.h"
 
+// What a stream of random numbers is used for. Part of the stream key,
+// so that the streams of different purposes never overlap.
+#define RNG_SETUP 0
+#define RNG_INITIALIZATION 1
+#define RNG_SELECTION 2
+#define RNG_VARIATION 3
+#define RNG_MUTATION 4
+#define RNG_MIGRATION 5
+#define RNG_STEADY_STATE 6
+
+/**
+ * A stream of random numbers from the Philox4x32-10 counter-based
+ * generator. Every output is a function of the key and the counter
+ * only, so streams with different counters are independent, and any
+ * stream can be created in any thread without shared state.
+ * @field key The key, made from the seed.
+ * @field counter The counter. The first word counts the blocks drawn,
+ *                the others identify the stream.
+ * @field output The last block of four random words.
+ * @field used The number of words of `output` already used.
+ */
+struct rng {
+    uint32_t key[2];
+    uint32_t counter[4];
+    uint32_t output[4];
+    int used;
+};
+
+void init_rng(struct rng *r, uint64_t seed, uint32_t purpose, uint32_t generation, uint32_t index);
+uint32_t rng_next(struct rng *r);
+int rng_randint(struct rng *r, int min, int max);
+double rng_probability(struct rng *r);
+void rng_shuffle(struct rng *r, int *a, int n);
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]);
+
 void start_srand(void);
+void use_rng_stream(uint32_t purpose, uint32_t generation, uint32_t index);
+void save_rng_stream(struct rng *r);
+void restore_rng_stream(const struct rng *r);
+void set_rng_island(uint32_t island);
+uint64_t get_rng_seed(void);
 int get_randint(int min, int max);
 double get_rand_probability();
 int *rand_indexes(int n);
@@ -0,0 +1,71 @@
+#ifndef PONY_GP_SEMANTIC_CACHE_H
+#define PONY_GP_SEMANTIC_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "../include/memmngr.h"
+#include "../include/binary_tree.h"
+#include "../include/dataset.h"
+#include "../include/program.h"
+#include "../include/kernels.h"
+
+// Stands in for a missing child in the prefix string of a tree.
+#define MISSING_NODE_SYMBOL '?'
+
+/**
+ * A cached output vector of a subtree.
+ * @field hash The hash of the subtree's prefix string.
+ * @field key The prefix string of the subtree, to rule out hash collisions.
+ * @field key_len The length of the key.
+ * @field outputs The output of the subtree for every fitness case.
+ * @field stamp The evaluation that last used the entry.
+ * @field newer, older The neighbours of the entry in least-recently-used order.
+ * @field chain The next entry in the same bucket.
+ */
+struct semantic_entry {
+    uint64_t hash;
+    char *key;
+    int key_len;
+    double *outputs;
+    unsigned long stamp;
+    struct semantic_entry *newer, *older;
+    struct semantic_entry *chain;
+};
+
+/**
+ * A bounded cache of subtree outputs (semantics) over a dataset.
+ * The least recently used entries are evicted when the memory budget
+ * is exceeded.
+ * @field buckets The hash table of entries.
+ * @field num_buckets The number of buckets, a power of two.
+ * @field newest, oldest The ends of the least-recently-used list.
+ * @field data The fitness cases the outputs are computed on.
+ * @field budget The memory budget (bytes).
+ * @field used The memory used by the entries (bytes).
+ * @field stamp The current evaluation.
+ * @field hits, misses, evictions Counters since the last call to print_semantic_cache().
+ */
+struct semantic_cache {
+    struct semantic_entry **buckets;
+    int num_buckets;
+    struct semantic_entry *newest, *oldest;
+    struct dataset *data;
+    size_t budget;
+    size_t used;
+    unsigned long stamp;
+    long hits, misses, evictions;
+};
+
+struct semantic_cache *init_semantic_cache(struct dataset *data, size_t budget);
+void free_semantic_cache(struct semantic_cache *c);
+uint64_t hash_symbols(const char *symbols, int len);
+int flatten_tree(struct node *node, char *prefix, int *sizes, int *pos);
+const double *get_semantic_cache(struct semantic_cache *c, uint64_t hash, const char *key, int key_len);
+bool put_semantic_cache(struct semantic_cache *c, uint64_t hash, const char *key, int key_len, double *outputs);
+double semantic_squared_error(struct semantic_cache *c, struct node *root);
+void print_semantic_cache(struct semantic_cache *c);
+
+#endif //PONY_GP_SEMANTIC_CACHE_H
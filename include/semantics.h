@@ -0,0 +1,59 @@
+#ifndef PONY_GP_SEMANTICS_H
+#define PONY_GP_SEMANTICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "../include/memmngr.h"
+#include "../include/binary_tree.h"
+#include "../include/dataset.h"
+#include "../include/program.h"
+#include "../include/kernels.h"
+#include "../include/semantic_cache.h"
+
+/**
+ * A reference counted output vector, shared between the semantics of
+ * individuals that contain the same subtree.
+ * @field refs The number of references.
+ * @field values The output for every fitness case.
+ */
+struct shared_outputs {
+    int refs;
+    double values[];
+};
+
+/**
+ * The outputs of every function node of a tree over the training data.
+ * Offspring look up their unchanged subtrees in the semantics of their
+ * parents, so that only the nodes on the path from a changed subtree to
+ * the root are evaluated again.
+ * @field refs The number of individuals referring to the semantics.
+ * @field len The number of symbols in the prefix string.
+ * @field prefix The prefix string of the tree.
+ * @field sizes The size of each subtree, indexed like the prefix string.
+ * @field hashes The hash of each subtree's prefix string.
+ * @field outputs The outputs of each function node (NULL for terminals).
+ * @field index A hash table from subtree hashes to indexes (-1 when empty).
+ * @field index_size The number of slots in the index, a power of two.
+ */
+struct semantics {
+    int refs;
+    int len;
+    char *prefix;
+    int *sizes;
+    uint64_t *hashes;
+    struct shared_outputs **outputs;
+    int *index;
+    int index_size;
+};
+
+struct semantics *evaluate_semantics(struct node *root, struct dataset *data,
+                                     struct semantics **origins, int num_origins);
+double semantics_squared_error(struct semantics *s, struct dataset *data);
+struct semantics *retain_semantics(struct semantics *s);
+void release_semantics(struct semantics *s);
+void print_semantics_stats(void);
+
+#endif //PONY_GP_SEMANTICS_H
@@ -10,5 +10,27 @@ void get_max_tree_depth_test(void);
 void subtree_mutation_test(void);
 void subtree_crossover_test(void);
 void evaluate_individual_test(void);
+void run_program_test(void);
+void kernels_test(void);
+void dataset_test(void);
+void jit_test(void);
+void semantic_cache_test(void);
+void semantics_test(void);
+void racing_test(void);
+void float_evaluation_test(void);
+void simplify_test(void);
+void dag_test(void);
+void thread_pool_test(void);
+void block_errors_test(void);
+void rng_test(void);
+void island_test(void);
+void migration_test(void);
+void steady_state_test(void);
+void variation_test(void);
+void node_arena_test(void);
+void prefix_genome_test(void);
+void fitness_cache_test(void);
+void fitness_store_test(void);
+void semantic_deduplication_test(void);
 
 #endif //PONY_GP_TESTS_H
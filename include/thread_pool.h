@@ -0,0 +1,67 @@
+#ifndef PONY_GP_THREAD_POOL_H
+#define PONY_GP_THREAD_POOL_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "../include/memmngr.h"
+
+#ifdef PONY_GP_THREADS
+#include <pthread.h>
+#endif
+
+/**
+ * A task function. Runs task number `task` of a batch.
+ */
+typedef void (*pool_task)(void *context, int task);
+
+/**
+ * The tasks queued for one worker. The worker takes tasks from the
+ * head, other workers steal from the tail.
+ * @field tasks The task numbers.
+ * @field head, tail The queued tasks are tasks[head] to tasks[tail - 1].
+ * @field stolen The number of tasks stolen from the queue.
+ * @field pool The pool the queue belongs to.
+ * @field lock Guards head, tail and stolen.
+ */
+struct pool_queue {
+    int *tasks;
+    int head, tail;
+    long stolen;
+    struct thread_pool *pool;
+#ifdef PONY_GP_THREADS
+    pthread_mutex_t lock;
+#endif
+};
+
+/**
+ * A pool of worker threads that run batches of tasks. The calling
+ * thread works as worker 0.
+ * @field num_threads The number of workers, including the calling thread.
+ * @field queues The task queue of each worker.
+ * @field run, context The task function of the current batch and its argument.
+ * @field batch The number of batches started, so that workers notice a new one.
+ * @field busy The number of workers still working on the current batch.
+ * @field shutdown Set to make the workers exit.
+ */
+struct thread_pool {
+    int num_threads;
+    struct pool_queue *queues;
+    pool_task run;
+    void *context;
+    unsigned long batch;
+    int busy;
+    bool shutdown;
+#ifdef PONY_GP_THREADS
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+#endif
+};
+
+struct thread_pool *new_thread_pool(int num_threads);
+void free_thread_pool(struct thread_pool *pool);
+void run_thread_pool(struct thread_pool *pool, pool_task run, void *context, const double *costs, int num_tasks);
+void print_thread_pool(struct thread_pool *pool);
+
+#endif //PONY_GP_THREAD_POOL_H
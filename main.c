@@ -41,8 +41,55 @@
 // The list of symbols the program uses to generate individuals.
 struct symbols *symbols;
 
-// Cache for fitness evaluation.
-struct hashmap *pop_cache;
+// Cache for fitness evaluation. Each island has its own. NULL if disabled.
+THREAD_LOCAL struct fitness_cache *pop_cache;
+
+// The first training cases, on which genomes are compared by their outputs
+// for semantic deduplication. NULL if disabled.
+struct dataset *probe_data;
+
+// Cache for fitness evaluation by the outputs on probe_data. Each island
+// has its own. NULL if disabled.
+THREAD_LOCAL struct fitness_cache *output_cache;
+
+// File of fitness values shared by runs on the same training data. NULL if disabled.
+struct fitness_store *fitness_store;
+
+// Cache for the outputs of subtrees on the training data. NULL if disabled.
+struct semantic_cache *semantic_cache;
+
+// Training evaluations stop once the fitness is known to be below this.
+// The statistics below are kept per thread as well, so that each island
+// has its own.
+THREAD_LOCAL double racing_threshold = DEFAULT_FITNESS;
+
+// Number of abandoned evaluations and skipped fitness cases since the
+// last printed statistics.
+THREAD_LOCAL long racing_abandoned = 0;
+THREAD_LOCAL long racing_skipped = 0;
+
+// Evaluates the individuals of a population in parallel. NULL if the
+// evaluation is sequential.
+struct thread_pool *thread_pool;
+
+// Single precision copy of the training data. NULL if disabled.
+struct float_dataset *float_training_data;
+
+// Number of individuals re-scored in double precision, how many of them
+// changed rank, and the largest relative error of a single precision
+// fitness, since the last printed statistics.
+THREAD_LOCAL long float_rescored = 0;
+THREAD_LOCAL long float_rank_changes = 0;
+THREAD_LOCAL double float_max_error = 0.0;
+// Statistics of the fitness values of offspring deduplicated by their
+// outputs on the probe cases, when they are checked.
+THREAD_LOCAL long dedup_rescored = 0;
+THREAD_LOCAL double dedup_max_error = 0.0;
+
+// Number of nodes evaluated with DAG evaluation, and the number of unique
+// nodes among them, since the last printed statistics.
+THREAD_LOCAL long dag_nodes = 0;
+THREAD_LOCAL long dag_unique_nodes = 0;
 
 int main(int argc, char *argv[]) {
     init_memory(DEFAULT_MEMORY_POOL_SIZE);
@@ -67,6 +114,9 @@ int main(int argc, char *argv[]) {
 
     }
 
+    if (thread_pool) free_thread_pool(thread_pool);
+    if (fitness_store) close_fitness_store(fitness_store);
+
     destroy_memory();
 
     exit(EXIT_SUCCESS);
@@ -74,14 +124,18 @@ int main(int argc, char *argv[]) {
 
 /**
  * Return the best solution. Initialize a population.
- * Perform an evolutionary search.
+ * Perform an evolutionary search, generational or steady-state. With islands or processes, each island
+ * has its own population instead.
  * @param pop The population to initialize.
  * @return The best individual solution.
  */
 struct individual *run(struct individual **pop) {
+    if (PROCESSES > 1) return search_processes();
+    if (ISLANDS > 1) return search_islands();
+
     init_population(pop);
 
-    struct individual *best_ever = search_loop(pop);
+    struct individual *best_ever = STEADY_STATE ? search_steady_state(pop) : search_loop(pop);
 
     return best_ever;
 }
@@ -93,8 +147,6 @@ void setup() {
     // Define symbols
     symbols = allocate_m(sizeof(struct symbols));
 
-    pop_cache = init_hashmap();
-
     FILE *config = fopen(CONFIG_DIR, "r");
 
     if (!config) {
@@ -107,6 +159,13 @@ void setup() {
 
     start_srand();
 
+    init_kernels();
+
+    if (JIT && !jit_available()) {
+        fprintf(stderr, "Native code generation is not supported here. Using the interpreter.\n");
+        JIT = false;
+    }
+
     FILE *csv = fopen(CSV_DIR, "r");
 
     if (!csv) {
@@ -117,6 +176,199 @@ void setup() {
     csv_add_constants(csv, symbols);
     set_test_and_train_data(csv);
     fclose(csv);
+
+    if (SEMANTIC_CACHE_SIZE > 0) {
+        semantic_cache = init_semantic_cache(training_data, (size_t) (SEMANTIC_CACHE_SIZE * 1e6));
+    }
+
+    if (DAG_EVALUATION && (semantic_cache || INCREMENTAL_EVALUATION)) {
+        fprintf(stderr, "DAG evaluation is not used with the semantic cache or incremental evaluation.\n");
+        DAG_EVALUATION = false;
+    }
+
+#ifndef PONY_GP_PROCESSES
+    if (PROCESSES > 1) {
+        fprintf(stderr, "Processes are not supported here. Using one process.\n");
+        PROCESSES = 1;
+    }
+#endif
+
+    if (PROCESSES > 1) {
+        // Each process has its own caches, but threads do not survive
+        // starting a process.
+        if (ISLANDS > 1) fprintf(stderr, "Islands are not used with processes. Each process is one island.\n");
+        if (THREADS > 1) fprintf(stderr, "Threads are not used with processes.\n");
+
+        ISLANDS = 1;
+        THREADS = 1;
+    }
+
+    if (STEADY_STATE && (ISLANDS > 1 || PROCESSES > 1)) {
+        fprintf(stderr, "Steady-state evolution is not used with islands or processes.\n");
+        STEADY_STATE = false;
+    }
+
+    if (STEADY_STATE && DAG_EVALUATION) {
+        // There is no generation of offspring to evaluate together.
+        fprintf(stderr, "DAG evaluation is not used with steady-state evolution.\n");
+        DAG_EVALUATION = false;
+    }
+
+    if (ISLANDS > 1 && (semantic_cache || INCREMENTAL_EVALUATION)) {
+        fprintf(stderr, "Islands are not used with the semantic cache or incremental evaluation.\n");
+        ISLANDS = 1;
+    }
+
+    if (MIGRATION_SIZE > POPULATION_SIZE) MIGRATION_SIZE = POPULATION_SIZE;
+    if (MIGRATION_SIZE < 0) MIGRATION_SIZE = 0;
+
+    if (ISLANDS > 1) {
+        if (THREADS > 1) fprintf(stderr, "Threads are not used with islands. Each island has its own thread.\n");
+    } else if (THREADS > 1) {
+        // The caches are shared by every evaluation.
+        if (semantic_cache || INCREMENTAL_EVALUATION || DAG_EVALUATION) {
+            fprintf(stderr, "Threads are not used with the semantic cache, incremental evaluation "
+                            "or DAG evaluation.\n");
+        } else {
+            thread_pool = new_thread_pool(THREADS);
+        }
+    }
+
+    if (FLOAT_EVALUATION) {
+        if (semantic_cache || INCREMENTAL_EVALUATION) {
+            fprintf(stderr, "Single precision evaluation is not used with the semantic cache "
+                            "or incremental evaluation.\n");
+        } else {
+            float_training_data = new_float_dataset(training_data);
+        }
+    }
+
+    if (FITNESS_CACHE_FILE) {
+        // The terminals name the columns, and single precision fitness
+        // values are kept apart from double precision ones.
+        uint64_t fingerprint = hash_dataset(training_data) ^
+                               hash_symbols(symbols->terminals, (int) strlen(symbols->terminals));
+
+        if (float_training_data) fingerprint = ~fingerprint;
+
+        fitness_store = open_fitness_store(FITNESS_CACHE_FILE, fingerprint);
+    }
+
+    if (SEMANTIC_DEDUPLICATION > 0 && FITNESS_CACHE_SIZE <= 0) {
+        fprintf(stderr, "Semantic deduplication is not used without the fitness cache.\n");
+        SEMANTIC_DEDUPLICATION = 0;
+    }
+
+    if (SEMANTIC_DEDUPLICATION > 0) {
+        // The training data is shuffled, so its first cases are a random sample.
+        int n = SEMANTIC_DEDUPLICATION;
+
+        if (n > training_data->len) n = training_data->len;
+        if (n > EVAL_BLOCK_SIZE) n = EVAL_BLOCK_SIZE;
+
+        int *indexes = allocate_m(sizeof(int) * n);
+
+        for (int i = 0; i < n; i++) indexes[i] = i;
+
+        probe_data = dataset_subset(training_data, indexes, n);
+        free_pointer(indexes);
+    }
+
+    init_pop_cache();
+}
+
+/**
+ * Create the fitness caches of the calling thread, unless it has them or
+ * they are disabled.
+ */
+void init_pop_cache() {
+    if (FITNESS_CACHE_SIZE <= 0) return;
+
+    if (!pop_cache) pop_cache = init_fitness_cache((size_t) FITNESS_CACHE_SIZE);
+    if (!output_cache && probe_data) output_cache = init_fitness_cache((size_t) FITNESS_CACHE_SIZE);
+}
+
+/**
+ * Get the outputs of a genome on the probe cases. Zeros are written as
+ * positive zeros, since their sign does not change the error.
+ * @param probe The probe cases, at most EVAL_BLOCK_SIZE.
+ * @param genome The genome.
+ * @param outputs Space for `probe->len` outputs.
+ */
+void get_probe_outputs(struct dataset *probe, struct node *genome, double *outputs) {
+    struct program *p = compile_program(genome);
+    double *scratch = allocate_m(sizeof(double) * p->max_stack * EVAL_BLOCK_SIZE);
+    const double **stack = allocate_m(sizeof(double *) * p->max_stack);
+
+    const double *column = run_program_block(p, probe, 0, probe->len, scratch, stack);
+
+    for (int i = 0; i < probe->len; i++) outputs[i] = column[i] == 0.0 ? 0.0 : column[i];
+
+    free_pointer(scratch);
+    free_pointer(stack);
+    free_program(p);
+}
+
+/**
+ * Get the fitness of an individual from a fitness cache, or else from
+ * the fitness cache file, or else from the fitness of a genome with the
+ * same outputs on the probe cases, in which case the individual is marked
+ * as deduplicated. If it is not cached, the outputs are
+ * kept in the individual for cache_fitness(). Several threads may get
+ * at once, as long as no thread puts to the caches.
+ * @param cache The fitness cache, or NULL.
+ * @param outputs The cache by the outputs on the probe cases, or NULL.
+ * @param hash The hash of the genome, see hash_tree().
+ * @param ind The individual. Its fitness is set, if it is cached.
+ * @return Whether the fitness is cached.
+ */
+bool get_cached_fitness(struct fitness_cache *cache, struct fitness_cache *outputs, uint64_t hash,
+                        struct individual *ind) {
+    if (cache && get_fitness_cache(cache, hash, ind->genome, &ind->fitness)) return true;
+    if (fitness_store && get_fitness_store(fitness_store, hash, ind->genome, &ind->fitness)) return true;
+    if (!outputs) return false;
+
+    int key_len = (int) sizeof(double) * probe_data->len;
+
+    ind->probe = allocate_m((size_t) key_len);
+    get_probe_outputs(probe_data, ind->genome, ind->probe);
+
+    if (!get_fitness_cache_key(outputs, hash_symbols((char *) ind->probe, key_len), (char *) ind->probe, key_len,
+                               &ind->fitness)) {
+        return false;
+    }
+
+    ind->deduplicated = true;
+    release_probe(ind);
+
+    return true;
+}
+
+/**
+ * Add the exact fitness of an evaluated individual to the fitness caches
+ * of the thread, and to the fitness cache file unless the cache had it.
+ * @param hash The hash of the genome, see hash_tree().
+ * @param ind The individual.
+ */
+void cache_fitness(uint64_t hash, struct individual *ind) {
+    bool added = !pop_cache || put_fitness_cache(pop_cache, hash, ind->genome, ind->fitness);
+
+    if (added && fitness_store) put_fitness_store(fitness_store, hash, ind->genome, ind->fitness);
+
+    if (output_cache) {
+        int key_len = (int) sizeof(double) * probe_data->len;
+
+        // The outputs were kept if the fitness was looked up before the evaluation.
+        if (!ind->probe) {
+            ind->probe = allocate_m((size_t) key_len);
+            get_probe_outputs(probe_data, ind->genome, ind->probe);
+        }
+
+        put_fitness_cache_key(output_cache, hash_symbols((char *) ind->probe, key_len), (char *) ind->probe, key_len,
+                              ind->fitness);
+    }
+
+    release_probe(ind);
 }
 
 /**
@@ -180,25 +432,30 @@ void grow(struct node *node, int curr_depth, int max_depth, bool must_fill) {
         }
     }
 
+    // The children are grown, so the size and height are final.
+    update_node(node);
+
     assert(curr_depth <= max_depth);
 }
 
 /**
  * Randomly select a node and replace it with a new, randomly generated node.
- * @param root The root node of the tree.
+ * Only the path from the root to the node is copied, the rest is shared.
+ * @param root The root node of the tree. The reference is taken over.
+ * @return The mutated tree.
  */
-void subtree_mutation(struct node *root) {
+struct node *subtree_mutation(struct node *root) {
 
-    if (get_rand_probability() >= MUTATION_PROBABILITY) return;
+    if (get_rand_probability() >= MUTATION_PROBABILITY) return root;
 
     // Pick a node
     int end_node_i = get_number_of_nodes(root) - 1;
     int node_i = get_randint(0, end_node_i);
 
-    struct node *old_node = get_node_at_index_wrapper(root, node_i);
-
     // Get new subtree
-    int node_depth = get_depth_at_index_wrapper(root, node_i);
+    int node_depth;
+
+    find_node_at_index(root, node_i, &node_depth);
 
     char new_symbol = get_random_symbol(
             node_depth, MAX_DEPTH - node_depth, false
@@ -209,34 +466,41 @@ void subtree_mutation(struct node *root) {
     grow(new_subtree, node_depth, MAX_DEPTH, false);
 
     // Replace the old subtree with the new one
-    *old_node = *new_subtree;
+    struct node *mutated = replace_subtree(root, node_i, new_subtree);
+
+    free_node(root);
+
+    return mutated;
 }
 
 /**
- * Swap two random nodes from the two given trees.
+ * Swap two random nodes from the two given trees. The parents are left
+ * unchanged: the children share every subtree off the paths to the
+ * crossover points with them.
  * @param p1 A tree to crossover.
  * @param p2 The other tree to crossover.
  * @return The new trees.
  */
 struct node **subtree_crossover(struct node *p1, struct node *p2) {
 
-    struct node *parent1 = tree_deep_copy(p1);
-    struct node *parent2 = tree_deep_copy(p2);
+    struct node *parent1 = NULL;
+    struct node *parent2 = NULL;
 
     if (get_rand_probability() < CROSSOVER_PROBABILITY) {
         struct node *xo_nodes[2];
+        int xo_indexes[2];
         int node_depths[2][2];
 
         for (int i = 0; i < 2; i++) {
-            struct node *parent = (i ? parent2 : parent1);
+            struct node *parent = (i ? p2 : p1);
 
             // Pick a crossover point.
             int node_i = get_randint(0, get_number_of_nodes(parent) - 1);
 
             // Find the subtree at the crossover point
-            xo_nodes[i] = get_node_at_index_wrapper(parent, node_i);
+            xo_nodes[i] = find_node_at_index(parent, node_i, &node_depths[i][0]);
+            xo_indexes[i] = node_i;
 
-            node_depths[i][0] = get_depth_at_index_wrapper(parent, node_i);
             node_depths[i][1] = get_max_tree_depth(xo_nodes[i]);
         }
 
@@ -246,11 +510,8 @@ struct node **subtree_crossover(struct node *p1, struct node *p2) {
             if (VERBOSE) fprintf(stderr, "Crossover too deep.\n");
         } else {
             // Swap the nodes
-
-            struct node tmp = *xo_nodes[0];
-
-            *xo_nodes[0] = *xo_nodes[1];
-            *xo_nodes[1] = tmp;
+            parent1 = replace_subtree(p1, xo_indexes[0], share_tree(xo_nodes[1]));
+            parent2 = replace_subtree(p2, xo_indexes[1], share_tree(xo_nodes[0]));
 
             assert(
                     get_max_tree_depth(xo_nodes[0]) <= MAX_DEPTH &&
@@ -259,6 +520,10 @@ struct node **subtree_crossover(struct node *p1, struct node *p2) {
         }
     }
 
+    // Without crossover the children are the parents.
+    if (!parent1) parent1 = share_tree(p1);
+    if (!parent2) parent2 = share_tree(p2);
+
     struct node **new_parents = allocate_m(sizeof(struct node *) * 2);
     new_parents[0] = parent1;
     new_parents[1] = parent2;
@@ -266,6 +531,132 @@ struct node **subtree_crossover(struct node *p1, struct node *p2) {
     return new_parents;
 }
 
+/**
+ * Randomly select a node of a prefix genome and replace it with a new,
+ * randomly generated subtree. Draws the same random numbers as
+ * subtree_mutation().
+ * @param g The genome. Freed if it is mutated.
+ * @return The mutated genome.
+ */
+struct prefix_genome *prefix_mutation(struct prefix_genome *g) {
+
+    if (get_rand_probability() >= MUTATION_PROBABILITY) return g;
+
+    // Pick a node
+    int node_i = get_randint(0, g->len - 1);
+    int node_depth = g->depths[node_i];
+
+    char new_symbol = get_random_symbol(
+            node_depth, MAX_DEPTH - node_depth, false
+    );
+
+    struct node *new_subtree = new_node(new_symbol);
+
+    grow(new_subtree, node_depth, MAX_DEPTH, false);
+
+    struct prefix_genome *donor = new_prefix_genome(new_subtree);
+    struct prefix_genome *mutated = splice_prefix_genome(g, node_i, donor, 0);
+
+    free_node(new_subtree);
+    free_prefix_genome(donor);
+    free_prefix_genome(g);
+
+    return mutated;
+}
+
+/**
+ * Swap two random subtrees of two prefix genomes. Draws the same random
+ * numbers, and gives the same trees, as subtree_crossover().
+ * @param p1 A genome to crossover.
+ * @param p2 The other genome to crossover.
+ * @return The new genomes.
+ */
+struct prefix_genome **prefix_crossover(struct prefix_genome *p1, struct prefix_genome *p2) {
+    struct prefix_genome **children = allocate_m(sizeof(struct prefix_genome *) * 2);
+
+    children[0] = children[1] = NULL;
+
+    if (get_rand_probability() < CROSSOVER_PROBABILITY) {
+        int xo_indexes[2];
+        int node_depths[2][2];
+
+        for (int i = 0; i < 2; i++) {
+            struct prefix_genome *parent = (i ? p2 : p1);
+
+            // Pick a crossover point. The subtree is the run of symbols from there.
+            xo_indexes[i] = get_randint(0, parent->len - 1);
+
+            node_depths[i][0] = parent->depths[xo_indexes[i]];
+            node_depths[i][1] = get_prefix_subtree_depth(parent, xo_indexes[i]);
+        }
+
+        // Ensure the trees will not exceed max depth.
+        if ((node_depths[0][1] + node_depths[1][0] > MAX_DEPTH) ||
+            (node_depths[1][1] + node_depths[0][0] > MAX_DEPTH)) {
+            if (VERBOSE) fprintf(stderr, "Crossover too deep.\n");
+        } else {
+            children[0] = splice_prefix_genome(p1, xo_indexes[0], p2, xo_indexes[1]);
+            children[1] = splice_prefix_genome(p2, xo_indexes[1], p1, xo_indexes[0]);
+        }
+    }
+
+    // Without crossover the children are copies of the parents.
+    if (!children[0]) children[0] = copy_prefix_genome(p1);
+    if (!children[1]) children[1] = copy_prefix_genome(p2);
+
+    return children;
+}
+
+/**
+ * Create two offspring of two parents by crossover. With
+ * `PREFIX_VARIATION` the parents' prefix genomes are crossed over, and
+ * the offspring get their trees from mutate_offspring().
+ * @param p1, p2 The parents.
+ * @param offspring Set to the offspring.
+ */
+void crossover_individuals(struct individual *p1, struct individual *p2, struct individual **offspring) {
+    if (PREFIX_VARIATION) {
+        struct prefix_genome **children = prefix_crossover(p1->prefix, p2->prefix);
+
+        for (int k = 0; k < 2; k++) {
+            offspring[k] = new_individual(NULL, DEFAULT_FITNESS);
+            offspring[k]->prefix = children[k];
+        }
+
+        free_pointer(children);
+    } else {
+        struct node **children = subtree_crossover(p1->genome, p2->genome);
+
+        for (int k = 0; k < 2; k++) offspring[k] = new_individual(children[k], DEFAULT_FITNESS);
+
+        free_pointer(children);
+    }
+
+    for (int k = 0; k < 2; k++) set_origins(offspring[k], p1, p2);
+}
+
+/**
+ * Vary an offspring created by crossover_individuals() by mutation.
+ * @param ind The offspring.
+ */
+void mutate_offspring(struct individual *ind) {
+    if (PREFIX_VARIATION) {
+        ind->prefix = prefix_mutation(ind->prefix);
+        ind->genome = prefix_genome_to_tree(ind->prefix);
+    } else {
+        ind->genome = subtree_mutation(ind->genome);
+    }
+}
+
+/**
+ * Flatten the genome of an individual into a prefix genome, if it has not
+ * been yet, so that it can be a parent with `PREFIX_VARIATION`.
+ * @param ind The individual.
+ */
+void flatten_individual(struct individual *ind) {
+    if (!ind->prefix) ind->prefix = new_prefix_genome(ind->genome);
+}
+
 /**
  * Allocate space for a new individual.
  * @param genome The individual's tree.
@@ -277,19 +668,66 @@ struct individual *new_individual(struct node *genome, double fitness) {
 
     i->genome = genome;
     i->fitness = fitness;
+    i->exact = false;
+    i->deduplicated = false;
+    i->semantics = NULL;
+    i->probe = NULL;
+    i->origins[0] = i->origins[1] = NULL;
+    i->prefix = NULL;
 
     return i;
 }
 
+/**
+ * Record the semantics of the parents of an offspring, so that the
+ * subtrees it shares with them are not evaluated again.
+ * @param child The offspring.
+ * @param p1, p2 The parents.
+ */
+void set_origins(struct individual *child, struct individual *p1, struct individual *p2) {
+    if (p1->semantics) child->origins[0] = retain_semantics(p1->semantics);
+    if (p2->semantics) child->origins[1] = retain_semantics(p2->semantics);
+}
+
 /**
  * Free the memory allocated for an individual and it's genome.
  * @param i The individual to free.
  */
 void free_individual(struct individual *i) {
-    free_node(i->genome);
+    release_origins(i);
+    release_probe(i);
+
+    if (i->semantics) release_semantics(i->semantics);
+    if (i->prefix) free_prefix_genome(i->prefix);
+
+    if (i->genome) free_node(i->genome);
     free_pointer(i);
 }
 
+/**
+ * Drop the references an individual holds to its parents' semantics.
+ * @param i The individual.
+ */
+void release_origins(struct individual *i) {
+    for (int k = 0; k < 2; k++) {
+        if (i->origins[k]) {
+            release_semantics(i->origins[k]);
+            i->origins[k] = NULL;
+        }
+    }
+}
+
+/**
+ * Free the outputs an individual keeps on the probe cases, if any.
+ * @param i The individual.
+ */
+void release_probe(struct individual *i) {
+    if (i->probe) {
+        free_pointer(i->probe);
+        i->probe = NULL;
+    }
+}
+
 /**
  * Print an individuals genome and fitness to the console.
  * @param i The individual.
@@ -345,39 +783,157 @@ double evaluate(struct node *node, double *fitness_case) {
  * of an individual (symbolic expression) and the target values.
  * Evaluates and sets the fitness in an individual.
  * Fitness is the negative mean square error (MSE).
+ * On the training data, evaluation stops early once the fitness is
+ * known to be below `racing_threshold`. The fitness is then the
+ * negative MSE of the evaluated cases, which is an upper bound.
  * @param ind The individual to evaluate.
+ * @param test Whether to use the test data instead of the training data.
+ * @return The number of fitness cases evaluated. The fitness is exact if
+ *         this is every fitness case.
  */
-void evaluate_individual(struct individual *ind, bool test) {
-    double fitness = 0.0; // Initial fitness value
-    double *targets;
-    double **cases;
-    int len;
+int evaluate_individual(struct individual *ind, bool test) {
+    double fitness; // Sum of the squared errors
+    struct dataset *data = test ? test_data : training_data;
+    int evaluated = data->len;
+
+    if (INCREMENTAL_EVALUATION && !test) {
+        // Only evaluate the nodes that are not shared with a parent.
+        struct semantics *semantics = evaluate_semantics(ind->genome, data, ind->origins, 2);
+
+        fitness = semantics_squared_error(semantics, data);
 
-    if (test) {
-        targets = test_targets;
-        cases = test_cases;
-        len = test_len;
+        if (ind->semantics) release_semantics(ind->semantics);
+
+        ind->semantics = semantics;
+        release_origins(ind);
+    } else if (semantic_cache && !test) {
+        // Reuse the outputs of subtrees that have been evaluated before.
+        fitness = semantic_squared_error(semantic_cache, ind->genome);
     } else {
-        targets = training_targets;
-        cases = training_cases;
-        len = training_len;
+        // The sum of squared errors past which the individual is
+        // known to be worse than the threshold.
+        double limit = test ? HUGE_VAL : -racing_threshold * data->len;
+
+        // Compile the genome once, then calculate the error between the
+        // expected values (targets) and the actual values (outputs) a
+        // column at a time.
+        // The native code is double precision only.
+        bool single = float_training_data && !test;
+
+        struct program *program = compile_program(ind->genome);
+        struct jit_program *native = (JIT && !single) ? jit_compile(program) : NULL;
+
+        if (single) {
+            fitness = program_squared_error_float(program, float_training_data, limit, &evaluated);
+        } else if (native) {
+            fitness = jit_squared_error(native, data, limit, &evaluated);
+            jit_free(native);
+        } else {
+            fitness = program_squared_error(program, data, limit, &evaluated);
+        }
+
+        free_program(program);
     }
 
-    // Calculate the error between the expected value (training_targets[i])
-    // and the actual value (output).
-    for (int i = 0; i < len; i++) {
-        double output = evaluate(ind->genome, cases[i]);
+    // Get the mean fitness and assign it to the individual. For an
+    // abandoned evaluation the remaining errors are missing from the sum,
+    // so this is an upper bound, and still below the threshold.
+    ind->fitness = (fitness * -1) / (double) data->len;
 
-        // Get the squared error
-        double error = output - targets[i];
+    assert(ind->fitness <= 0);
+
+    return evaluated;
+}
 
-        fitness += error * error;
+/**
+ * Evaluate an individual on the training data in double precision,
+ * whatever the evaluation mode.
+ * @param ind The individual to evaluate.
+ */
+void rescore_individual(struct individual *ind) {
+    struct program *program = compile_program(ind->genome);
+    struct jit_program *native = JIT ? jit_compile(program) : NULL;
+    double fitness;
+
+    if (native) {
+        fitness = jit_squared_error(native, training_data, HUGE_VAL, NULL);
+        jit_free(native);
+    } else {
+        fitness = program_squared_error(program, training_data, HUGE_VAL, NULL);
     }
 
-    // Get the mean fitness and assign it to the individual.
-    ind->fitness = (fitness * -1) / (double) len;
+    free_program(program);
 
-    assert(ind->fitness <= 0);
+    ind->fitness = (fitness * -1) / (double) training_data->len;
+    ind->exact = true;
+    ind->deduplicated = false;
+}
+
+/**
+ * Re-score the best individuals of a population in double precision,
+ * so that the elite, and with it the best solution, have exact fitness
+ * values. Only used with single precision evaluation, or to check the
+ * fitness of deduplicated offspring (`SEMANTIC_DEDUPLICATION_CHECK`).
+ * An individual that moves into the best after the others are
+ * re-scored is re-scored too, until all of them are exact. Individuals
+ * that are exact already, such as the elite of the last generation, are
+ * not re-scored. Records how far the approximate fitness values were
+ * off, and how often the two precisions rank the individuals
+ * differently. The population is sorted afterwards, if it is re-scored.
+ * @param pop The population.
+ */
+void rescore_population(struct individual **pop) {
+    if (!float_training_data && !(SEMANTIC_DEDUPLICATION_CHECK && probe_data)) return;
+
+    int k = ELITE_SIZE > 0 ? ELITE_SIZE : 1;
+    int rescored = 0;
+    bool changed = true;
+
+    if (k > POPULATION_SIZE) k = POPULATION_SIZE;
+
+    sort_population(pop, POPULATION_SIZE);
+
+    struct individual **ranked = allocate_m(sizeof(struct individual *) * k);
+
+    for (int i = 0; i < k; i++) ranked[i] = pop[i];
+
+    while (changed) {
+        changed = false;
+
+        for (int i = 0; i < k; i++) {
+            bool checked = SEMANTIC_DEDUPLICATION_CHECK && pop[i]->deduplicated;
+
+            if (pop[i]->exact || !(float_training_data || checked)) continue;
+
+            double approximate = pop[i]->fitness;
+
+            rescore_individual(pop[i]);
+
+            double error = fabs(approximate - pop[i]->fitness) / fmax(fabs(pop[i]->fitness), DBL_MIN);
+
+            if (checked) {
+                if (!(error <= dedup_max_error)) dedup_max_error = error;
+
+                dedup_rescored++;
+            } else {
+                if (!(error <= float_max_error)) float_max_error = error;
+
+                rescored++;
+            }
+
+            changed = true;
+        }
+
+        if (changed) sort_population(pop, POPULATION_SIZE);
+    }
+
+    for (int i = 0; i < k; i++) {
+        if (pop[i] != ranked[i] && pop[i]->fitness != ranked[i]->fitness) float_rank_changes++;
+    }
+
+    float_rescored += rescored;
+
+    free_pointer(ranked);
 }
 
 /**
@@ -392,6 +948,9 @@ void init_population(struct individual **pop) {
     char symbol;
 
     for (int i = 0; i < POPULATION_SIZE; i++) {
+        // Each individual has its own stream, so it does not depend on
+        // how many numbers the others used.
+        use_rng_stream(RNG_INITIALIZATION, 0, (uint32_t) i);
 
         // Pick full or grow method
         full = (bool) get_randint(0, 1);
@@ -423,65 +982,318 @@ void init_population(struct individual **pop) {
  * @param pop The population to evaluate.
  */
 void evaluate_population(struct individual **pop) {
+    if (DAG_EVALUATION) {
+        evaluate_population_dag(pop);
+        return;
+    }
+
+    uint64_t *hashes = allocate_m(sizeof(uint64_t) * POPULATION_SIZE);
+    int *pending = allocate_m(sizeof(int) * POPULATION_SIZE);
+    int *evaluated = allocate_m(sizeof(int) * POPULATION_SIZE);
+    double *costs = allocate_m(sizeof(double) * POPULATION_SIZE);
+    int num_pending = 0;
+
     for (int i = 0; i < POPULATION_SIZE; i++) {
-        char *key = tree_to_string(pop[i]->genome);
-        double fitness = get_hashmap(pop_cache, key);
+        hashes[i] = hash_tree(pop[i]->genome);
 
-        if (!isnan(fitness)) {
-            pop[i]->fitness = fitness;
-        } else {
-            evaluate_individual(pop[i], false);
-            put_hashmap(pop_cache, key, pop[i]->fitness);
+        if (!get_cached_fitness(pop_cache, output_cache, hashes[i], pop[i])) {
+            // The evaluation time grows with the size of the tree.
+            costs[num_pending] = (double) get_number_of_nodes(pop[i]->genome);
+            pending[num_pending++] = i;
         }
     }
+
+    // The evaluations are independent, so they give the same fitness
+    // values in any order. The cache is only used by this thread.
+    struct evaluation_batch batch = {pop, pending, evaluated, racing_threshold};
+    int shards = get_num_shards(num_pending);
+
+    if (shards > 1) {
+        evaluate_sharded(pop, pending, num_pending, evaluated, shards);
+    } else if (thread_pool) {
+        run_thread_pool(thread_pool, evaluate_task, &batch, costs, num_pending);
+    } else {
+        for (int k = 0; k < num_pending; k++) evaluate_task(&batch, k);
+    }
+
+    record_evaluations(pop, hashes, pending, evaluated, num_pending);
+
+    free_pointer(hashes);
+    free_pointer(pending);
+    free_pointer(evaluated);
+    free_pointer(costs);
 }
 
 /**
- * Sort population in reverse order order with regards to fitness.
- * @param pop The population to sort.
- * @param size The size of the population.
+ * Record the evaluations of the individuals of a population: count the
+ * abandoned evaluations and add the exact fitness values to the cache.
+ * Frees the individuals' references to their parents.
+ * @param pop The population.
+ * @param hashes The hash of the genome of each individual.
+ * @param pending The indexes of the individuals that were evaluated.
+ * @param evaluated The number of fitness cases evaluated for each of them.
+ * @param num_pending The number of individuals that were evaluated.
  */
-void sort_population(struct individual **pop, int size) {
-    qsort(pop, (size_t) size, sizeof(*pop), fitness_comp);
+void record_evaluations(struct individual **pop, const uint64_t *hashes, const int *pending, const int *evaluated,
+                        int num_pending) {
+    for (int k = 0; k < num_pending; k++) {
+        int i = pending[k];
+
+        if (evaluated[k] < training_data->len) {
+            racing_abandoned++;
+            racing_skipped += training_data->len - evaluated[k];
+        } else {
+            // Only exact fitness values are cached.
+            cache_fitness(hashes[i], pop[i]);
+        }
+    }
+
+    for (int i = 0; i < POPULATION_SIZE; i++) release_origins(pop[i]);
 }
 
 /**
- * Helper function to compare individuals in term of their fitness.
- * Use with `qsort`.
- * @param elem1, elem2 The elements to compare.
- * @return Return 1 if `elem2` has a greater fitness,
- * return -1 if `elem1` has a greater fitness and return 0 if they
- * are equal.
+ * Evaluate one individual of a batch on the training data. Run by the
+ * thread pool.
+ * @param context The batch.
+ * @param task The index of the individual in the batch.
  */
-int fitness_comp(const void *elem1, const void *elem2) {
-    struct individual *i1 = *(struct individual **) elem1;
-    struct individual *i2 = *(struct individual **) elem2;
+void evaluate_task(void *context, int task) {
+    struct evaluation_batch *batch = context;
 
-    if (i1->fitness < i2->fitness) return 1;
-    if (i1->fitness > i2->fitness) return -1;
+    // The threshold is per thread.
+    racing_threshold = batch->threshold;
 
-    return 0;
+    batch->evaluated[task] = evaluate_individual(batch->pop[batch->pending[task]], false);
 }
 
 /**
- * Print the genome and fitness of each individual in a population.
- * @param pop The population to print.
- * @param size The size of the population.
+ * Return the number of shards to split the training cases of each
+ * individual into, so that there is enough work to keep every thread busy.
+ * @param num_individuals The number of individuals to evaluate.
+ * @return The number of shards. 1 to evaluate whole individuals.
  */
-void print_population(struct individual **pop, int size) {
-    for (int i = 0; i < size; i++) {
-        print_individual(pop[i]);
-        printf("\n");
+int get_num_shards(int num_individuals) {
+    if (!thread_pool || num_individuals == 0 || ROW_SHARDING == 1) return 1;
+
+    int threads = thread_pool->num_threads;
+    int blocks = (training_data->len + EVAL_BLOCK_SIZE - 1) / EVAL_BLOCK_SIZE;
+    int shards;
+
+    if (ROW_SHARDING == 2) {
+        shards = threads;
+    } else {
+        // Only split the fitness cases when there are fewer than two
+        // individuals per thread.
+        shards = (2 * threads + num_individuals - 1) / num_individuals;
     }
+
+    // A shard holds at least one block.
+    return shards < blocks ? shards : blocks;
 }
 
 /**
- * Print the statistics of a population.
- * @param generation The current generation.
+ * Evaluate individuals on the training data with the training cases split
+ * into shards. Each individual and shard is a task for the thread pool.
+ * The squared error of every block is kept and added up in order, so the
+ * fitness values are the same as with evaluate_individual().
  * @param pop The population.
- * @param duration Duration of computation.
+ * @param pending The indexes of the individuals to evaluate.
+ * @param num_pending The number of individuals to evaluate.
+ * @param evaluated Set to the number of fitness cases evaluated for each individual.
+ * @param shards The number of shards.
  */
-void print_stats(int generation, struct individual **pop, double duration) {
+void evaluate_sharded(struct individual **pop, const int *pending, int num_pending, int *evaluated, int shards) {
+    struct dataset *data = training_data;
+    struct shard_batch batch;
+
+    batch.num_blocks = (data->len + EVAL_BLOCK_SIZE - 1) / EVAL_BLOCK_SIZE;
+    batch.shard_blocks = (batch.num_blocks + shards - 1) / shards;
+    batch.shards = shards;
+    batch.programs = allocate_m(sizeof(struct program *) * num_pending);
+    batch.natives = allocate_m(sizeof(struct jit_program *) * num_pending);
+    batch.errors = allocate_m(sizeof(double) * batch.num_blocks * num_pending);
+
+    double *costs = allocate_m(sizeof(double) * num_pending * shards);
+
+    for (int k = 0; k < num_pending; k++) {
+        batch.programs[k] = compile_program(pop[pending[k]]->genome);
+        batch.natives[k] = (JIT && !float_training_data) ? jit_compile(batch.programs[k]) : NULL;
+
+        for (int s = 0; s < shards; s++) {
+            costs[k * shards + s] = (double) batch.programs[k]->len;
+        }
+    }
+
+    run_thread_pool(thread_pool, shard_task, &batch, costs, num_pending * shards);
+
+    // See evaluate_individual().
+    double limit = -racing_threshold * data->len;
+
+    for (int k = 0; k < num_pending; k++) {
+        double fitness = sum_block_errors(batch.errors + (size_t) k * batch.num_blocks, data->len,
+                                          limit, &evaluated[k]);
+
+        pop[pending[k]]->fitness = (fitness * -1) / (double) data->len;
+
+        if (batch.natives[k]) jit_free(batch.natives[k]);
+
+        free_program(batch.programs[k]);
+    }
+
+    free_pointer(batch.programs);
+    free_pointer(batch.natives);
+    free_pointer(batch.errors);
+    free_pointer(costs);
+}
+
+/**
+ * Evaluate one individual on one shard of the training data. Run by the
+ * thread pool.
+ * @param context The batch.
+ * @param task The index of the individual times the number of shards,
+ *             plus the index of the shard.
+ */
+void shard_task(void *context, int task) {
+    struct shard_batch *batch = context;
+    int k = task / batch->shards;
+    int first = (task % batch->shards) * batch->shard_blocks;
+
+    int start = first * EVAL_BLOCK_SIZE;
+    int end = start + batch->shard_blocks * EVAL_BLOCK_SIZE;
+
+    if (end > training_data->len) end = training_data->len;
+    if (start >= end) return;
+
+    double *errors = batch->errors + (size_t) k * batch->num_blocks + first;
+
+    if (float_training_data) {
+        program_block_errors_float(batch->programs[k], float_training_data, start, end, errors);
+    } else if (batch->natives[k]) {
+        jit_block_errors(batch->natives[k], training_data, start, end, errors);
+    } else {
+        program_block_errors(batch->programs[k], training_data, start, end, errors);
+    }
+}
+
+/**
+ * Evaluate each individual of a population that is not in the cache.
+ * The genomes are interned in one DAG, so that subtrees shared between
+ * individuals, and duplicate individuals, are evaluated once.
+ * @param pop The population to evaluate.
+ */
+void evaluate_population_dag(struct individual **pop) {
+    uint64_t *hashes = allocate_m(sizeof(uint64_t) * POPULATION_SIZE);
+    int *pending = allocate_m(sizeof(int) * POPULATION_SIZE);
+    int num_pending = 0;
+    int max_nodes = 0;
+
+    for (int i = 0; i < POPULATION_SIZE; i++) {
+        hashes[i] = hash_tree(pop[i]->genome);
+
+        if (!get_cached_fitness(pop_cache, output_cache, hashes[i], pop[i])) {
+            pending[num_pending++] = i;
+
+            // A missing child takes a node as well.
+            max_nodes += 2 * get_number_of_nodes(pop[i]->genome) + 1;
+        }
+
+        release_origins(pop[i]);
+    }
+
+    struct dag *dag = new_dag(max_nodes);
+    int *roots = allocate_m(sizeof(int) * (num_pending ? num_pending : 1));
+    double *errors = allocate_m(sizeof(double) * (num_pending ? num_pending : 1));
+
+    for (int k = 0; k < num_pending; k++) {
+        roots[k] = intern_tree(dag, pop[pending[k]]->genome);
+    }
+
+    dag_squared_errors(dag, roots, num_pending, training_data, errors);
+
+    for (int k = 0; k < num_pending; k++) {
+        struct individual *ind = pop[pending[k]];
+
+        ind->fitness = (errors[k] * -1) / (double) training_data->len;
+
+        cache_fitness(hashes[pending[k]], ind);
+    }
+
+    dag_nodes += dag->interned;
+    dag_unique_nodes += dag->len;
+
+    free_dag(dag);
+    free_pointer(roots);
+    free_pointer(errors);
+    free_pointer(pending);
+    free_pointer(hashes);
+}
+
+/**
+ * Sort population in reverse order order with regards to fitness.
+ * @param pop The population to sort.
+ * @param size The size of the population.
+ */
+void sort_population(struct individual **pop, int size) {
+    qsort(pop, (size_t) size, sizeof(*pop), fitness_comp);
+}
+
+/**
+ * Return the fitness of the `n`th best individual of a population,
+ * without reordering the population.
+ * @param pop The population.
+ * @param n The rank, 0 for the best individual.
+ * @return The fitness.
+ */
+double get_nth_best_fitness(struct individual **pop, int n) {
+    struct individual **sorted = allocate_m(sizeof(struct individual *) * POPULATION_SIZE);
+
+    memcpy(sorted, pop, sizeof(struct individual *) * POPULATION_SIZE);
+    sort_population(sorted, POPULATION_SIZE);
+
+    double fitness = sorted[n]->fitness;
+
+    free_pointer(sorted);
+
+    return fitness;
+}
+
+/**
+ * Helper function to compare individuals in term of their fitness.
+ * Use with `qsort`.
+ * @param elem1, elem2 The elements to compare.
+ * @return Return 1 if `elem2` has a greater fitness,
+ * return -1 if `elem1` has a greater fitness and return 0 if they
+ * are equal.
+ */
+int fitness_comp(const void *elem1, const void *elem2) {
+    struct individual *i1 = *(struct individual **) elem1;
+    struct individual *i2 = *(struct individual **) elem2;
+
+    if (i1->fitness < i2->fitness) return 1;
+    if (i1->fitness > i2->fitness) return -1;
+
+    return 0;
+}
+
+/**
+ * Print the genome and fitness of each individual in a population.
+ * @param pop The population to print.
+ * @param size The size of the population.
+ */
+void print_population(struct individual **pop, int size) {
+    for (int i = 0; i < size; i++) {
+        print_individual(pop[i]);
+        printf("\n");
+    }
+}
+
+/**
+ * Print the statistics of a population.
+ * @param generation The current generation.
+ * @param pop The population.
+ * @param duration Duration of computation.
+ */
+void print_stats(int generation, struct individual **pop, double duration) {
     sort_population(pop, POPULATION_SIZE);
 
     if (VERBOSE) {
@@ -526,6 +1338,43 @@ void print_stats(int generation, struct individual **pop, double duration) {
     print_individual(pop[0]);
     printf("\n");
 
+    if (pop_cache) print_fitness_cache(pop_cache, "Fitness cache");
+    if (output_cache) print_fitness_cache(output_cache, "Semantic deduplication");
+
+    if (output_cache && SEMANTIC_DEDUPLICATION_CHECK) {
+        printf("Semantic deduplication check: re-scored: %ld, max relative error: %e\n",
+               dedup_rescored, dedup_max_error);
+
+        dedup_rescored = 0;
+        dedup_max_error = 0.0;
+    }
+    if (fitness_store) print_fitness_store(fitness_store);
+    if (semantic_cache) print_semantic_cache(semantic_cache);
+    if (INCREMENTAL_EVALUATION) print_semantics_stats();
+
+    if (RACING) {
+        printf("Racing: evaluations abandoned: %ld, fitness cases skipped: %ld\n",
+               racing_abandoned, racing_skipped);
+
+        racing_abandoned = racing_skipped = 0;
+    }
+
+    if (DAG_EVALUATION) {
+        printf("DAG evaluation: nodes: %ld, unique nodes: %ld\n", dag_nodes, dag_unique_nodes);
+
+        dag_nodes = dag_unique_nodes = 0;
+    }
+
+    if (thread_pool) print_thread_pool(thread_pool);
+
+    if (float_training_data) {
+        printf("Float evaluation: re-scored: %ld, ranking changes: %ld, max relative error: %e\n",
+               float_rescored, float_rank_changes, float_max_error);
+
+        float_rescored = float_rank_changes = 0;
+        float_max_error = 0.0;
+    }
+
     free_pointer(fitness_values);
     free_pointer(size_values);
     free_pointer(depth_values);
@@ -539,7 +1388,8 @@ void print_stats(int generation, struct individual **pop, double duration) {
  * competitors randomly and selecting the best of the competitors.
  * `POPULATION_SIZE` number of tournaments are held.
  * @param pop The population the select from.
- * @return The winners of the tournaments.
+ * @return The winners of the tournaments. The individuals belong to `pop`,
+ *         only the array is to be freed.
  */
 struct individual **tournament_selection(struct individual **pop) {
     struct individual **winners = allocate_m(sizeof(struct individual *) * POPULATION_SIZE);
@@ -562,8 +1412,7 @@ struct individual **tournament_selection(struct individual **pop) {
 
         sort_population(competitors, TOURNAMENT_SIZE);
 
-        // Copy individuals.
-        winners[win_i++] = new_individual(competitors[0]->genome, competitors[0]->fitness);
+        winners[win_i++] = competitors[0];
     }
 
     free_pointer(competitors);
@@ -607,6 +1456,8 @@ struct individual *search_loop(struct individual **pop) {
 
     evaluate_population(pop);
 
+    rescore_population(pop);
+
     if (!EXPERIMENTAL_OUTPUT) print_stats(0, pop, get_time() - time);
 
     // Set best solution
@@ -616,7 +1467,7 @@ struct individual *search_loop(struct individual **pop) {
     int generation = 1;
 
     struct individual **new_pop = allocate_m(sizeof(struct individual *) * POPULATION_SIZE);
-    struct individual **parents;
+    struct node_arena *arena = NULL;
 
     /////////////////////
     // Generation Loop //
@@ -625,84 +1476,831 @@ struct individual *search_loop(struct individual **pop) {
     while (generation < GENERATIONS) {
         time = get_time();
 
-        int new_pop_i = 0;
+        next_generation(&pop, &new_pop, &arena, generation);
+
+        // Set best solution
+        best_ever = pop[0];
+
+        // Print the Stats of the population
+        if (!EXPERIMENTAL_OUTPUT) print_stats(generation, pop, get_time() - time);
+
+        generation++;
+    }
+
+    return best_ever;
+}
+
+/**
+ * Replace a population with the next generation: selection, variation,
+ * evaluation and replacement. The new population is sorted.
+ * @param population The population. Set to the new population.
+ * @param scratch Space for a population. Set to the space of the old population.
+ * @param arena The arena of the population's genomes, or NULL if they are on
+ *              the heap. Set to the arena of the new population.
+ * @param generation The number of the new generation.
+ */
+void next_generation(struct individual ***population, struct individual ***scratch, struct node_arena **arena,
+                     int generation) {
+    struct individual **pop = *population;
+    struct individual **new_pop = *scratch;
+    struct individual **parents;
 
-        ///////////////
-        // Selection //
-        ///////////////
+    ///////////////
+    // Selection //
+    ///////////////
 
-        parents = tournament_selection(pop);
+    use_rng_stream(RNG_SELECTION, (uint32_t) generation, 0);
 
-        ///////////////////////////////////////////////////
-        // Variation -- Generate new individual solutions //
-        ///////////////////////////////////////////////////
+    parents = tournament_selection(pop);
 
-        // Crossover
-        while (new_pop_i < POPULATION_SIZE) {
-            int idx = get_randint(0, POPULATION_SIZE - 1);
-            struct individual *p1 = parents[idx];
-            struct individual *p2;
+    // Offspring worse than the worst elite cannot take its place, so
+    // their evaluation may stop as soon as that is known.
+    if (RACING) racing_threshold = get_nth_best_fitness(pop, ELITE_SIZE > 0 ? ELITE_SIZE - 1 : POPULATION_SIZE - 1);
 
-            // Swap p1 with the last element so that it cannot be picked again
-            struct individual *tmp = parents[POPULATION_SIZE - 1];
+    ///////////////////////////////////////////////////
+    // Variation -- Generate new individual solutions //
+    ///////////////////////////////////////////////////
 
-            parents[POPULATION_SIZE - 1] = p1;
-            parents[idx] = tmp;
+    int num_pairs = (POPULATION_SIZE + 1) / 2;
+    struct variation_batch batch;
 
-            p2 = parents[get_randint(0, POPULATION_SIZE - 2)];
+    batch.pairs = allocate_m(sizeof(struct individual *) * 2 * num_pairs);
+    batch.streams = allocate_m(sizeof(struct rng) * num_pairs);
+    batch.new_pop = new_pop;
+    batch.arena = *arena;
+    batch.generation = generation;
 
-            struct node **children = subtree_crossover(p1->genome, p2->genome);
+    // With a thread pool, each thread evaluates the offspring it has
+    // varied straight away, while the other threads vary or evaluate
+    // other offspring, unless the fitness cases are split between threads.
+    batch.evaluate = thread_pool && get_num_shards(POPULATION_SIZE) == 1;
 
-            // Append the first child to the population.
-            struct individual *i1 = new_individual(children[0], DEFAULT_FITNESS);
-            evaluate_individual(i1, false);
-            new_pop[new_pop_i++] = i1;
+    // The parents' genomes are flattened once, when they first are parents.
+    if (PREFIX_VARIATION) {
+        for (int i = 0; i < POPULATION_SIZE; i++) flatten_individual(pop[i]);
+    }
 
-            // Ensure that too many elements can't be added.
-            // Handles uneven population sizes, since crossover returns 2 offspring.
-            if (new_pop_i < POPULATION_SIZE) {
-                struct individual *i2 = new_individual(children[1], DEFAULT_FITNESS);
-                evaluate_individual(i2, false);
-                new_pop[new_pop_i++] = i2;
-            }
+    pair_parents(parents, &batch);
+
+    ////////////////////
+    //Evaluate fitness//
+    ////////////////////
+
+    if (batch.evaluate) {
+        double *costs = allocate_m(sizeof(double) * num_pairs);
+
+        batch.hashes = allocate_m(sizeof(uint64_t) * POPULATION_SIZE);
+        batch.evaluated = allocate_m(sizeof(int) * POPULATION_SIZE);
+        batch.cache = pop_cache;
+        batch.output_cache = output_cache;
+        batch.threshold = racing_threshold;
+
+        // The work grows with the size of the parents.
+        for (int k = 0; k < num_pairs; k++) {
+            costs[k] = (double) (get_number_of_nodes(batch.pairs[2 * k]->genome) +
+                                 get_number_of_nodes(batch.pairs[2 * k + 1]->genome));
         }
 
-        // Vary the population by mutation
+        run_thread_pool(thread_pool, variation_task, &batch, costs, num_pairs);
+
+        // Gather the offspring that were not in the cache.
+        int *pending = allocate_m(sizeof(int) * POPULATION_SIZE);
+        int num_pending = 0;
+
         for (int i = 0; i < POPULATION_SIZE; i++) {
-            subtree_mutation(new_pop[i]->genome);
+            if (batch.evaluated[i] >= 0) {
+                batch.evaluated[num_pending] = batch.evaluated[i];
+                pending[num_pending++] = i;
+            }
         }
 
-        ////////////////////
-        //Evaluate fitness//
-        ////////////////////
+        record_evaluations(new_pop, batch.hashes, pending, batch.evaluated, num_pending);
+
+        free_pointer(batch.hashes);
+        free_pointer(batch.evaluated);
+        free_pointer(pending);
+        free_pointer(costs);
+    } else {
+        for (int k = 0; k < num_pairs; k++) variation_task(&batch, k);
+
         evaluate_population(new_pop);
+    }
 
-        /////////////////////////////////////////////////////////////////
-        // Replacement. Replace individual solutions in the population //
-        /////////////////////////////////////////////////////////////////
-        generational_replacement(new_pop, pop);
+    racing_threshold = DEFAULT_FITNESS;
 
-        swap_populations(&new_pop, &pop);
+    free_pointer(batch.pairs);
+    free_pointer(batch.streams);
 
-        for (int i=0; i < POPULATION_SIZE; i++) {
-            if (new_pop[i]) {
-                free_individual(new_pop[i]);
-            }
+    // The tournament winners belong to `pop`.
+    free_pointer(parents);
+
+    /////////////////////////////////////////////////////////////////
+    // Replacement. Replace individual solutions in the population //
+    /////////////////////////////////////////////////////////////////
+    generational_replacement(new_pop, pop);
+
+    swap_populations(&new_pop, &pop);
+
+    for (int i=0; i < POPULATION_SIZE; i++) {
+        if (new_pop[i]) {
+            free_individual(new_pop[i]);
         }
+    }
 
-        // Set best solution
-        sort_population(pop, POPULATION_SIZE);
-        best_ever = pop[0];
+    // The survivors are copied into a fresh arena, and the old one is
+    // freed with every other genome of the generation.
+    struct node_arena *survivors = new_node_arena();
 
-        // Print the Stats of the population
-        if (!EXPERIMENTAL_OUTPUT) print_stats(generation, pop, get_time() - time);
+    for (int i = 0; i < POPULATION_SIZE; i++) pop[i]->genome = compact_tree(pop[i]->genome, survivors);
 
-        generation++;
+    if (*arena) free_node_arena(*arena);
+
+    *arena = survivors;
+
+    // The best solution, and the elite of the next generation,
+    // are compared by exact fitness values.
+    rescore_population(pop);
+
+    // Put the best solution first.
+    sort_population(pop, POPULATION_SIZE);
+
+    *population = pop;
+    *scratch = new_pop;
+}
+
+/**
+ * Choose the parents of each pair of offspring of a generation. Each
+ * choice depends on the ones before it, so this is done in order. The
+ * stream of each pair is saved for its crossover.
+ * @param parents The winners of the tournaments. Reordered.
+ * @param batch The batch. Its pairs and streams are set.
+ */
+void pair_parents(struct individual **parents, struct variation_batch *batch) {
+    for (int k = 0; 2 * k < POPULATION_SIZE; k++) {
+        use_rng_stream(RNG_VARIATION, (uint32_t) batch->generation, (uint32_t) (2 * k));
+
+        int idx = get_randint(0, POPULATION_SIZE - 1);
+        struct individual *p1 = parents[idx];
+
+        // Swap p1 with the last element so that it cannot be picked again
+        struct individual *tmp = parents[POPULATION_SIZE - 1];
+
+        parents[POPULATION_SIZE - 1] = p1;
+        parents[idx] = tmp;
+
+        batch->pairs[2 * k] = p1;
+        batch->pairs[2 * k + 1] = parents[get_randint(0, POPULATION_SIZE - 2)];
+
+        save_rng_stream(&batch->streams[k]);
     }
+}
+
+/**
+ * Create a pair of offspring by crossover and mutation, and evaluate them
+ * if the batch says so, through the fitness cache. Run by the thread pool.
+ * @param context The variation_batch.
+ * @param task The pair.
+ */
+void variation_task(void *context, int task) {
+    struct variation_batch *batch = context;
+    struct individual *p1 = batch->pairs[2 * task];
+    struct individual *p2 = batch->pairs[2 * task + 1];
+
+    restore_rng_stream(&batch->streams[task]);
+
+    // The offspring are allocated with the generation.
+    struct node_arena *previous = use_node_arena(batch->arena);
+
+    struct individual *offspring[2];
+
+    crossover_individuals(p1, p2, offspring);
+
+    for (int k = 0; k < 2; k++) {
+        int i = 2 * task + k;
+        struct individual *child = offspring[k];
+
+        // Handles uneven population sizes, since crossover returns 2 offspring.
+        if (i >= POPULATION_SIZE) {
+            free_individual(child);
+            continue;
+        }
+
+        // Vary the offspring by mutation
+        use_rng_stream(RNG_MUTATION, (uint32_t) batch->generation, (uint32_t) i);
+        mutate_offspring(child);
+
+        batch->new_pop[i] = child;
+
+        if (!batch->evaluate) continue;
+
+        // The cache is not changed until the batch is done.
+        batch->hashes[i] = hash_tree(child->genome);
+
+        if (get_cached_fitness(batch->cache, batch->output_cache, batch->hashes[i], child)) {
+            batch->evaluated[i] = -1;
+        } else {
+            // The threshold is per thread.
+            racing_threshold = batch->threshold;
+            batch->evaluated[i] = evaluate_individual(child, false);
+        }
+    }
+
+    use_node_arena(previous);
+}
+
+/**
+ * Get the best individual from a steady-state search, starting from an
+ * initial population. Each job selects two parents, varies them,
+ * evaluates the two offspring and inserts each one in place of the loser
+ * of an inverse tournament, if it is better. The jobs run on the thread
+ * pool without waiting for each other, so a large offspring only holds
+ * up its own job. The statistics are printed every `POPULATION_SIZE`
+ * evaluations, as a generation. With more than one thread, the jobs
+ * see the population in the order they happen to run in, so runs are
+ * only repeatable with one thread.
+ * @param pop The initial population.
+ * @return The best individual.
+ */
+struct individual *search_steady_state(struct individual **pop) {
+    double time = get_time();
+
+    evaluate_population(pop);
+
+    rescore_population(pop);
+
+    if (!EXPERIMENTAL_OUTPUT) print_stats(0, pop, get_time() - time);
+
+    struct steady_state ss;
+
+    ss.pop = pop;
+    ss.evaluations = 0;
+    ss.generation = 0;
+    ss.time = get_time();
+    ss.racing_abandoned = ss.racing_skipped = 0;
+    memset(&ss.cache_counts, 0, sizeof(ss.cache_counts));
+    memset(&ss.output_counts, 0, sizeof(ss.output_counts));
+
+#ifdef PONY_GP_THREADS
+    pthread_mutex_init(&ss.lock, NULL);
+#endif
+
+    // As many evaluations as the generational search, two per job.
+    int num_jobs = ((GENERATIONS - 1) * POPULATION_SIZE + 1) / 2;
+    double *costs = allocate_m(sizeof(double) * (num_jobs > 0 ? num_jobs : 1));
+
+    for (int k = 0; k < num_jobs; k++) costs[k] = 1.0;
+
+    if (thread_pool) {
+        run_thread_pool(thread_pool, steady_state_task, &ss, costs, num_jobs);
+    } else {
+        for (int k = 0; k < num_jobs; k++) steady_state_task(&ss, k);
+    }
+
+#ifdef PONY_GP_THREADS
+    pthread_mutex_destroy(&ss.lock);
+#endif
+
+    free_pointer(costs);
+
+    sort_population(pop, POPULATION_SIZE);
+
+    return pop[0];
+}
+
+/**
+ * Run one job of a steady-state search: selection, variation, evaluation
+ * and replacement of two offspring. The population is only locked while
+ * it is read or changed, not during evaluation. Run by the thread pool.
+ * @param context The steady_state.
+ * @param task The number of the job.
+ */
+void steady_state_task(void *context, int task) {
+    struct steady_state *ss = context;
+    struct individual *offspring[2];
+
+    // Each job has its own stream, whichever thread runs it.
+    use_rng_stream(RNG_STEADY_STATE, 0, (uint32_t) task);
+
+    init_pop_cache();
+
+    lock_steady_state(ss);
+
+    // The offspring hold their own references to the parents' subtrees,
+    // since the parents may be replaced before the offspring are evaluated.
+    struct individual *p1 = ss->pop[steady_state_tournament(ss->pop, false)];
+    struct individual *p2 = ss->pop[steady_state_tournament(ss->pop, false)];
+
+    if (PREFIX_VARIATION) {
+        flatten_individual(p1);
+        flatten_individual(p2);
+    }
+
+    crossover_individuals(p1, p2, offspring);
+
+    // An offspring worse than every individual cannot win an inverse
+    // tournament, then or later.
+    double threshold = DEFAULT_FITNESS;
+
+    if (RACING) {
+        threshold = ss->pop[0]->fitness;
+
+        for (int i = 1; i < POPULATION_SIZE; i++) {
+            if (ss->pop[i]->fitness < threshold) threshold = ss->pop[i]->fitness;
+        }
+    }
+
+    unlock_steady_state(ss);
+
+    racing_threshold = threshold;
+
+    for (int k = 0; k < 2; k++) {
+        mutate_offspring(offspring[k]);
+        evaluate_offspring(offspring[k]);
+    }
+
+    racing_threshold = DEFAULT_FITNESS;
+
+    lock_steady_state(ss);
+
+    for (int k = 0; k < 2; k++) {
+        int loser = steady_state_tournament(ss->pop, true);
+
+        if (offspring[k]->fitness > ss->pop[loser]->fitness) {
+            free_individual(ss->pop[loser]);
+            ss->pop[loser] = offspring[k];
+        } else {
+            free_individual(offspring[k]);
+        }
+    }
+
+    ss->evaluations += 2;
+    ss->racing_abandoned += racing_abandoned;
+    ss->racing_skipped += racing_skipped;
+    racing_abandoned = racing_skipped = 0;
+
+    // Each thread has its own caches, so the statistics sum their counters.
+    if (pop_cache) move_fitness_cache_counts(&ss->cache_counts, pop_cache);
+    if (output_cache) move_fitness_cache_counts(&ss->output_counts, output_cache);
+
+    if (ss->evaluations / POPULATION_SIZE > ss->generation) {
+        ss->generation = (int) (ss->evaluations / POPULATION_SIZE);
+
+        // The elite is re-scored, as after a generation.
+        rescore_population(ss->pop);
+
+        if (!EXPERIMENTAL_OUTPUT) {
+            racing_abandoned = ss->racing_abandoned;
+            racing_skipped = ss->racing_skipped;
+            ss->racing_abandoned = ss->racing_skipped = 0;
+
+            if (pop_cache) move_fitness_cache_counts(pop_cache, &ss->cache_counts);
+            if (output_cache) move_fitness_cache_counts(output_cache, &ss->output_counts);
+
+            print_stats(ss->generation, ss->pop, get_time() - ss->time);
+        }
+
+        ss->time = get_time();
+    }
+
+    unlock_steady_state(ss);
+}
+
+/**
+ * Evaluate an offspring on the training data, using the fitness cache.
+ * @param ind The offspring.
+ */
+void evaluate_offspring(struct individual *ind) {
+    uint64_t hash = hash_tree(ind->genome);
+
+    if (!get_cached_fitness(pop_cache, output_cache, hash, ind)) {
+        int evaluated = evaluate_individual(ind, false);
+
+        if (evaluated < training_data->len) {
+            racing_abandoned++;
+            racing_skipped += training_data->len - evaluated;
+        } else {
+            // Only exact fitness values are cached.
+            cache_fitness(hash, ind);
+        }
+    }
+
+    release_origins(ind);
+}
+
+/**
+ * Return the index of the best of `TOURNAMENT_SIZE` individuals drawn
+ * randomly from a population, or with `inverse` the worst of them.
+ * Reorders the population.
+ * @param pop The population.
+ * @param inverse Whether to return the worst instead of the best.
+ * @return The index of the winner.
+ */
+int steady_state_tournament(struct individual **pop, bool inverse) {
+    int winner = -1;
+
+    for (int i = 0; i < TOURNAMENT_SIZE && i < POPULATION_SIZE; i++) {
+        int last = POPULATION_SIZE - i - 1;
+        int idx = get_randint(0, last);
+
+        // Swap the competitor with the last element so that it cannot
+        // be picked again.
+        struct individual *tmp = pop[last];
+        pop[last] = pop[idx];
+        pop[idx] = tmp;
+
+        if (winner < 0 || (inverse ? pop[last]->fitness < pop[winner]->fitness
+                                   : pop[last]->fitness > pop[winner]->fitness)) {
+            winner = last;
+        }
+    }
+
+    return winner;
+}
+
+/**
+ * Stop other threads reading or changing the population of a
+ * steady-state search until unlock_steady_state() is called.
+ * @param ss The search.
+ */
+void lock_steady_state(struct steady_state *ss) {
+#ifdef PONY_GP_THREADS
+    pthread_mutex_lock(&ss->lock);
+#endif
+}
+
+/**
+ * Let other threads use the population again. See lock_steady_state().
+ * @param ss The search.
+ */
+void unlock_steady_state(struct steady_state *ss) {
+#ifdef PONY_GP_THREADS
+    pthread_mutex_unlock(&ss->lock);
+#endif
+}
+
+/**
+ * Get the best individual from an island model search. Each island
+ * evolves its own population, and every `MIGRATION_INTERVAL` generations
+ * sends copies of its `MIGRATION_SIZE` best individuals to another island.
+ * @return The best individual of all islands.
+ */
+struct individual *search_islands() {
+    struct island_populations islands;
+
+    islands.pops = allocate_m(sizeof(struct individual **) * ISLANDS);
+    islands.new_pops = allocate_m(sizeof(struct individual **) * ISLANDS);
+    islands.arenas = allocate_m(sizeof(struct node_arena *) * ISLANDS);
+
+    for (int i = 0; i < ISLANDS; i++) {
+        islands.pops[i] = allocate_m(sizeof(struct individual *) * POPULATION_SIZE);
+        islands.new_pops[i] = allocate_m(sizeof(struct individual *) * POPULATION_SIZE);
+        islands.arenas[i] = NULL;
+    }
+
+    struct archipelago *a = new_archipelago(ISLANDS, GENERATIONS, MIGRATION_INTERVAL, MIGRATION_TOPOLOGY);
+
+    run_archipelago(a, island_generation, select_migrants, accept_migrants, &islands);
+
+    struct individual *best_ever = NULL;
+
+    for (int i = 0; i < ISLANDS; i++) {
+        struct individual *best = islands.pops[i][0];
+
+        if (!best_ever || best->fitness > best_ever->fitness) best_ever = best;
+    }
+
+    if (!EXPERIMENTAL_OUTPUT) print_archipelago(a);
+
+    free_archipelago(a);
 
     return best_ever;
 }
 
+/**
+ * Create the next generation of an island, or its initial population,
+ * and print its statistics. Run by the thread of the island.
+ * @param context The island_populations.
+ * @param island The island.
+ * @param generation The generation.
+ */
+void island_generation(void *context, int island, int generation) {
+    struct island_populations *islands = context;
+    double time = get_time();
+
+    evolve_island(islands, island, generation);
+
+    if (!EXPERIMENTAL_OUTPUT) {
+        lock_output();
+        printf("Island: %d, ", island);
+        print_stats(generation, islands->pops[island], get_time() - time);
+        unlock_output();
+    }
+}
+
+/**
+ * Create the next generation of an island, or its initial population.
+ * @param islands The populations of the islands.
+ * @param island The island.
+ * @param generation The generation.
+ */
+void evolve_island(struct island_populations *islands, int island, int generation) {
+    // The random numbers of each island are different.
+    set_rng_island((uint32_t) island);
+
+    if (generation == 0) {
+        init_pop_cache();
+
+        struct individual **pop = islands->pops[island];
+
+        init_population(pop);
+        evaluate_population(pop);
+
+        rescore_population(pop);
+
+        sort_population(pop, POPULATION_SIZE);
+    } else {
+        next_generation(&islands->pops[island], &islands->new_pops[island], &islands->arenas[island], generation);
+    }
+}
+
+/**
+ * Return copies of the `MIGRATION_SIZE` best individuals of an island.
+ * @param context The island_populations.
+ * @param island The island.
+ * @return The migrants.
+ */
+void *select_migrants(void *context, int island) {
+    struct island_populations *islands = context;
+    struct individual **pop = islands->pops[island];
+    struct migrants *m = allocate_m(sizeof(struct migrants));
+
+    m->count = MIGRATION_SIZE;
+    m->individuals = allocate_m(sizeof(struct individual *) * (MIGRATION_SIZE ? MIGRATION_SIZE : 1));
+
+    // The population is sorted after every generation.
+    for (int i = 0; i < m->count; i++) {
+        m->individuals[i] = new_individual(tree_deep_copy(pop[i]->genome), pop[i]->fitness);
+        m->individuals[i]->exact = pop[i]->exact;
+        m->individuals[i]->deduplicated = pop[i]->deduplicated;
+    }
+
+    return m;
+}
+
+/**
+ * Replace the worst individuals of an island with migrants.
+ * @param context The island_populations.
+ * @param island The island.
+ * @param migrants The migrants, freed afterwards.
+ */
+void accept_migrants(void *context, int island, void *migrants) {
+    struct island_populations *islands = context;
+    struct individual **pop = islands->pops[island];
+    struct migrants *m = migrants;
+
+    for (int i = 0; i < m->count; i++) {
+        free_individual(pop[POPULATION_SIZE - i - 1]);
+        pop[POPULATION_SIZE - i - 1] = m->individuals[i];
+    }
+
+    sort_population(pop, POPULATION_SIZE);
+
+    free_pointer(m->individuals);
+    free_pointer(m);
+}
+
+/**
+ * Get the best individual from an island model search where each island
+ * is a separate process. See run_island_processes().
+ * @return The best individual of all islands.
+ */
+struct individual *search_processes() {
+    struct node *genome;
+    double fitness;
+
+    if (!run_island_processes(PROCESSES, island_process_main, &genome, &fitness)) {
+        fprintf(stderr, "The island processes failed. Aborting.\n");
+        abort();
+    }
+
+    return new_individual(genome, fitness);
+}
+
+/**
+ * Evolve one island in an island process. The statistics of every
+ * generation, the migrants and the best individual are sent to the
+ * coordinating process, and migrants are received from it.
+ * @param island The island.
+ * @param fd The socket connected to the coordinating process.
+ */
+void island_process_main(int island, int fd) {
+    struct archipelago *a = new_archipelago(PROCESSES, GENERATIONS, MIGRATION_INTERVAL, MIGRATION_TOPOLOGY);
+    struct island_populations islands;
+
+    // Only the island of this process is used.
+    islands.pops = allocate_m(sizeof(struct individual **) * PROCESSES);
+    islands.new_pops = allocate_m(sizeof(struct individual **) * PROCESSES);
+    islands.arenas = allocate_m(sizeof(struct node_arena *) * PROCESSES);
+    islands.pops[island] = allocate_m(sizeof(struct individual *) * POPULATION_SIZE);
+    islands.new_pops[island] = allocate_m(sizeof(struct individual *) * POPULATION_SIZE);
+    islands.arenas[island] = NULL;
+
+    // Migrants for a later migration can arrive first, since the island
+    // that sends them can be ahead.
+    int max_early = GENERATIONS;
+    int num_early = 0;
+    unsigned char **early = allocate_m(sizeof(unsigned char *) * max_early);
+    struct message_header *early_headers = allocate_m(sizeof(struct message_header) * max_early);
+
+    for (int generation = 0; generation < GENERATIONS; generation++) {
+        double time = get_time();
+
+        evolve_island(&islands, island, generation);
+        send_island_stats(fd, island, generation, islands.pops[island], get_time() - time);
+
+        if (!is_migration(a, generation)) continue;
+
+        size_t length;
+        struct migrants *m = select_migrants(&islands, island);
+        unsigned char *payload = pack_migrants(m, &length);
+
+        send_message(fd, MSG_MIGRANTS, get_migration_target(a, island, generation, false), generation,
+                     payload, length);
+
+        free_migrants(m);
+        free_pointer(payload);
+
+        struct message_header header;
+        payload = NULL;
+
+        for (int k = 0; k < num_early && !payload; k++) {
+            if (early_headers[k].generation == generation) {
+                payload = early[k];
+                header = early_headers[k];
+                early[k] = early[--num_early];
+                early_headers[k] = early_headers[num_early];
+            }
+        }
+
+        while (!payload) {
+            payload = receive_message(fd, &header);
+
+            if (!payload) {
+                fprintf(stderr, "Island %d lost the connection to the coordinating process.\n", island);
+                abort();
+            }
+
+            if (header.generation != generation && num_early < max_early) {
+                early[num_early] = payload;
+                early_headers[num_early++] = header;
+                payload = NULL;
+            }
+        }
+
+        accept_migrants(&islands, island, unpack_migrants(payload, header.length));
+        free_pointer(payload);
+    }
+
+    // The best individual, with its fitness first.
+    struct individual *best = islands.pops[island][0];
+    size_t length = sizeof(double) + get_encoded_size(best->genome);
+    unsigned char *payload = allocate_m(length);
+
+    memcpy(payload, &best->fitness, sizeof(double));
+    encode_genome(best->genome, payload + sizeof(double));
+
+    send_message(fd, MSG_BEST, island, GENERATIONS - 1, payload, length);
+
+    free_pointer(payload);
+    free_pointer(early);
+    free_pointer(early_headers);
+    free_archipelago(a);
+}
+
+/**
+ * Send the statistics of a generation of an island to the coordinating
+ * process.
+ * @param fd The socket connected to the coordinating process.
+ * @param island The island.
+ * @param generation The generation.
+ * @param pop The population of the island, sorted.
+ * @param duration The time taken by the generation.
+ */
+void send_island_stats(int fd, int island, int generation, struct individual **pop, double duration) {
+    double *fitness_values = allocate_m(sizeof(double) * POPULATION_SIZE);
+    double *size_values = allocate_m(sizeof(double) * POPULATION_SIZE);
+
+    for (int i = 0; i < POPULATION_SIZE; i++) {
+        fitness_values[i] = pop[i]->fitness;
+        size_values[i] = (double) get_number_of_nodes(pop[i]->genome);
+    }
+
+    double *fit_stats = get_ave_and_std(fitness_values, POPULATION_SIZE);
+    double *size_stats = get_ave_and_std(size_values, POPULATION_SIZE);
+
+    struct island_stats stats = {duration, fit_stats[0], fit_stats[1], size_stats[0], pop[0]->fitness};
+    size_t length = sizeof(stats) + get_encoded_size(pop[0]->genome);
+    unsigned char *payload = allocate_m(length);
+
+    memcpy(payload, &stats, sizeof(stats));
+    encode_genome(pop[0]->genome, payload + sizeof(stats));
+
+    send_message(fd, MSG_STATS, island, generation, payload, length);
+
+    free_pointer(payload);
+    free_pointer(fitness_values);
+    free_pointer(size_values);
+    free_pointer(fit_stats);
+    free_pointer(size_stats);
+}
+
+/**
+ * Encode migrants for sending to another process: the number of
+ * migrants, then the fitness, encoded size and encoded genome of each.
+ * @param m The migrants.
+ * @param length Set to the number of bytes of the encoding.
+ * @return The encoding.
+ */
+unsigned char *pack_migrants(struct migrants *m, size_t *length) {
+    int32_t count = m->count;
+
+    *length = sizeof(count);
+
+    for (int i = 0; i < m->count; i++) {
+        *length += sizeof(double) + sizeof(uint32_t) + get_encoded_size(m->individuals[i]->genome);
+    }
+
+    unsigned char *payload = allocate_m(*length);
+    unsigned char *p = payload;
+
+    memcpy(p, &count, sizeof(count));
+    p += sizeof(count);
+
+    for (int i = 0; i < m->count; i++) {
+        uint32_t size = (uint32_t) get_encoded_size(m->individuals[i]->genome);
+
+        memcpy(p, &m->individuals[i]->fitness, sizeof(double));
+        memcpy(p + sizeof(double), &size, sizeof(size));
+        p += sizeof(double) + sizeof(size);
+        p += encode_genome(m->individuals[i]->genome, p);
+    }
+
+    return payload;
+}
+
+/**
+ * Decode migrants encoded by pack_migrants().
+ * @param payload The encoding.
+ * @param length The number of bytes of the encoding.
+ * @return The migrants.
+ */
+struct migrants *unpack_migrants(const unsigned char *payload, size_t length) {
+    const unsigned char *end = payload + length;
+    struct migrants *m = allocate_m(sizeof(struct migrants));
+    int32_t count = 0;
+
+    if (length >= sizeof(count)) memcpy(&count, payload, sizeof(count));
+
+    payload += sizeof(count);
+
+    m->count = 0;
+    m->individuals = allocate_m(sizeof(struct individual *) * (count > 0 ? count : 1));
+
+    for (int i = 0; i < count && payload + sizeof(double) + sizeof(uint32_t) < end; i++) {
+        double fitness;
+        uint32_t size;
+
+        memcpy(&fitness, payload, sizeof(double));
+        memcpy(&size, payload + sizeof(double), sizeof(size));
+        payload += sizeof(double) + sizeof(size);
+
+        const unsigned char *genome_end = payload + size < end ? payload + size : end;
+        struct node *genome = decode_genome(&payload, genome_end);
+
+        payload = genome_end;
+
+        if (!genome) break;
+
+        m->individuals[m->count] = new_individual(genome, fitness);
+
+        // Whether the fitness was checked is not sent, so it is checked again.
+        m->individuals[m->count++]->deduplicated = probe_data != NULL;
+    }
+
+    return m;
+}
+
+/**
+ * Free migrants that were not added to an island.
+ * @param m The migrants.
+ */
+void free_migrants(struct migrants *m) {
+    for (int i = 0; i < m->count; i++) free_individual(m->individuals[i]);
+
+    free_pointer(m->individuals);
+    free_pointer(m);
+}
+
 /**
  * Swap the pointers of two populations.
  * @param pop1, pop2 The populations to swap.
@@ -744,7 +2342,7 @@ void print_settings() {
 
         if (i < num_headers - 1) printf(", ");
     }
-    printf("}, Number of Exemplars: %d\n", num_exemplars);
+    printf("}, Number of Exemplars: %d\n", fitness_data->len);
 
     printf("GP Settings:\n[[Population Size: %d, Max Depth: %d, Elite Size: %d, Generations: %d, "
                         "Tournament Size: %d, Seed: %f, Crossover Probability: %f, "
@@ -773,26 +2371,26 @@ void print_settings() {
 
     printf(", Fitness Cases: {");
 
-    for (int i=0; i < fitness_len; i++) {
+    for (int i=0; i < fitness_data->len; i++) {
         printf("[");
 
-        for (int k=0; k < num_columns - 1; k++) {
-            printf("%f", fitness_cases[i][k]);
+        for (int k=0; k < fitness_data->num_inputs; k++) {
+            printf("%f", fitness_data->columns[k][i]);
 
-            if (k < num_columns - 2) printf(", ");
+            if (k < fitness_data->num_inputs - 1) printf(", ");
         }
 
         printf("]");
 
-        if (i < fitness_len - 1) printf(", ");
+        if (i < fitness_data->len - 1) printf(", ");
     }
 
     printf("}, Targets: {");
 
-    for (int i=0; i < targets_len; i++) {
-        printf("%f", targets[i]);
+    for (int i=0; i < fitness_data->len; i++) {
+        printf("%f", fitness_data->targets[i]);
 
-        if (i < targets_len - 1) printf(", ");
+        if (i < fitness_data->len - 1) printf(", ");
     }
 
     printf("}]]\n");
@@ -1,15 +1,29 @@
 #include "../include/binary_tree.h"
+#include "../include/node_arena.h"
+
+static void write_index_order(struct node *node, char *str, int *pos);
+static bool matches_index_order(struct node *node, const char *str, int *pos);
+static void print_index_order(struct node *node, bool *first);
 
 /**
- * Allocate memory for a binary tree node.
+ * Allocate memory for a binary tree node, from the node arena of the
+ * calling thread if it has one. See use_node_arena().
  * Set the value of the node and set children to NULL.
  * @param v The value of the node.
  * @return The newly allocated node.
  */
 struct node *new_node(char v) {
-    struct node *node = allocate_m(sizeof(struct node));
+    struct node *node = allocate_arena_node();
+
+    if (!node) {
+        node = allocate_m(sizeof(struct node));
+        node->in_arena = false;
+    }
 
     node->value = v;
+    node->refs = 1;
+    node->size = 1;
+    node->height = 0;
     node->left = NULL;
     node->right = NULL;
 
@@ -17,10 +31,28 @@ struct node *new_node(char v) {
 }
 
 /**
- * Free the memory allocated for a binary tree node.
+ * Add a reference to a subtree, so that it can be shared by another tree.
+ * Nodes allocated from an arena live as long as the arena, so they are
+ * not counted.
+ * @param node The root of the subtree.
+ * @return The subtree.
+ */
+struct node *retain_node(struct node *node) {
+    // Subtrees are shared between threads, so their counts change atomically.
+    if (!node->in_arena) ADD_RELAXED(&node->refs, 1);
+
+    return node;
+}
+
+/**
+ * Drop a reference to a binary tree node, and free it, and drop its
+ * references to its children, when no references are left. Nodes
+ * allocated from an arena, and their children, are freed with the arena.
  * @param node The node to free.
  */
 void free_node(struct node *node) {
+    if (node->in_arena || SUB_ACQ_REL(&node->refs, 1) > 0) return;
+
     if (VERBOSE) {
         printf("Delete: %p\n  Node: ", node);
         print_nodes_index_order(node);
@@ -34,69 +66,38 @@ void free_node(struct node *node) {
 }
 
 /**
- * Get the number of nodes in a binary tree through the
- * Morris Tree Traversal algorithm.
- * @param root The root of the tree.
- * @return The number of nodes in the binary tree.
+ * Recompute the size and height of a node from its children, after its
+ * children are set.
+ * @param node The node.
  */
-int get_number_of_nodes(struct node *root) {
-    if (!root) return 0;
-
-    int count = 0;
-    struct node *pre, *current = root;
+void update_node(struct node *node) {
+    int left_height = node->left ? node->left->height : -1;
+    int right_height = node->right ? node->right->height : -1;
 
-    while (current) {
-        if (!current->left) {
-            count++;
-            current = current->right;
-        }
-        else {
-            pre = current->left;
-
-            while (pre->right && pre->right != current) {
-                pre = pre->right;
-            }
-
-            if (!pre->right) {
-                pre->right = current;
-                current = current->left;
-
-            }
-            else {
-                pre->right = NULL;
-                count++;
-                current = current->right;
-            }
-        }
-    }
-
-    return count;
+    node->size = 1 + get_number_of_nodes(node->left) + get_number_of_nodes(node->right);
+    node->height = 1 + (left_height > right_height ? left_height : right_height);
 }
 
 /**
- * Return an array of the children of a binary tree.
- * @param root The root of the binary tree.
- * @return An array of children nodes.
+ * Recompute the size and height of every node of a tree whose children
+ * were set directly instead of with append_node().
+ * @param root The root of the tree.
  */
-struct node **get_children(struct node *root) {
-    short l = 0, r = 0;
-
-    // Check that the root has a left and right descendant.
-    if (root->left)  l = 1;
-    if (root->right) r = 1;
-
-    // If neither, it has no children.
-    if (!(r + l)) return NULL;
-
-    // Determine array capacity based on the number of children;
-    struct node **children = allocate_m((r + l) * sizeof(struct node *));
+void annotate_tree(struct node *root) {
+    if (!root) return;
 
-    int i = 0;
-
-    if (l) children[i++] = root->left;
-    if (r) children[i] = root->right;
+    annotate_tree(root->left);
+    annotate_tree(root->right);
+    update_node(root);
+}
 
-    return children;
+/**
+ * Get the number of nodes in a binary tree.
+ * @param root The root of the tree.
+ * @return The number of nodes in the binary tree.
+ */
+int get_number_of_nodes(struct node *root) {
+    return root ? root->size : 0;
 }
 
 /**
@@ -110,96 +111,63 @@ int get_num_children(struct node *root) {
 }
 
 /**
- * Get the depth of a node in relation to the root of the tree based on the index.
- * The index is based on depth-first left-to-right traversal.
- * @param root The root tree node.
+ * Get the node in a tree at a given index, and its depth. The index is
+ * according to a depth-first left-to-right ordering. Walks down from the
+ * root, skipping subtrees by their size.
+ * @param root The root node.
  * @param goal_i The index to search for.
- * @param curr_i The current index in the tree.
- * @param curr_depth The current depth in the tree.
- * @param i_depth The max depth so far.
- * @return The depth of the node at the given index.
+ * @param depth Set to the depth of the node, if not NULL.
+ * @return The node in the tree at the given index, or NULL if there is none.
  */
-int get_depth_at_index(struct node *root, int goal_i,
-                       int *curr_i, int curr_depth, int *i_depth) {
-    if (goal_i < 0) return -1;
-    if (goal_i == 0) return 0;
+struct node *find_node_at_index(struct node *root, int goal_i, int *depth) {
+    struct node *node = root;
+    int node_depth = 0;
 
-    if (goal_i == *curr_i) *i_depth = curr_depth;
+    if (goal_i < 0 || goal_i >= get_number_of_nodes(root)) return NULL;
 
-    struct node **children = get_children(root);
+    while (goal_i > 0) {
+        int left_size = get_number_of_nodes(node->left);
 
-    for (int i=0; (*i_depth == -1) && i < get_num_children(root); i++) {
-        (*curr_i)++;
+        goal_i--;
+        node_depth++;
 
-        *i_depth = get_depth_at_index(children[i], goal_i, curr_i, curr_depth + 1, i_depth);
+        if (goal_i < left_size) {
+            node = node->left;
+        } else {
+            goal_i -= left_size;
+            node = node->right;
+        }
     }
 
-    if (children) free_pointer(children);
+    if (depth) *depth = node_depth;
 
-    return *i_depth;
+    return node;
 }
 
 /**
- * A wrapper for get_depth_at_index().
+ * Get the depth of a node in relation to the root of the tree based on the index.
+ * The index is based on depth-first left-to-right traversal.
  * @param root The root of the tree.
  * @param goal_i The index to search for.
- * @return The depth of the node at the given index.
+ * @return The depth of the node at the given index, or -1 if there is none.
  */
 int get_depth_at_index_wrapper(struct node *root, int goal_i) {
-    int index = 0;
-    int i_depth = -1;
+    int depth = -1;
 
-    return get_depth_at_index(root, goal_i, &index, 0, &i_depth);
+    find_node_at_index(root, goal_i, &depth);
+
+    return depth;
 }
 
 /**
  * Get the node in a tree at a given index. The index is
  * according to a depth-first left-to-right ordering.
  * @param root The root node.
- * @param goal_i The index to search for.
- * @param curr_i The current index in the tree.
- * @param goal The node to be returned.
- * @return The node in the tree at the given index.
- */
-struct node *get_node_at_index(
-        struct node *root, int goal_i, int *curr_i, struct node **goal) {
-
-    if (goal_i < 0) return NULL;
-    if (goal_i == 0) return root;
-
-    struct node **children = get_children(root);
-
-    // Recursively loop through the tree
-    // until the index is reached.
-    for (int i = 0; i < get_num_children(root); i++) {
-
-        (*curr_i)++;
-
-        if (*curr_i == goal_i) *goal = children[i];
-        else get_node_at_index(children[i], goal_i, curr_i, goal);
-    }
-
-    if (children) free_pointer(children);
-
-    return *goal;
-}
-
-/**
- * A wrapper for get_node_at_index().
- * @param root The root node.
- * @param goal The node to be returned.
+ * @param goal The index to search for.
  * @return The node in the tree at the given index.
  */
 struct node *get_node_at_index_wrapper(struct node *root, int goal) {
-    int i = 0;
-    int *ip = &i;
-    struct node **tmp = allocate_m(sizeof(struct node **));
-
-    struct node *tmp1 = get_node_at_index(root, goal, ip, tmp);
-
-    free_pointer(tmp);
-
-    return tmp1;
+    return find_node_at_index(root, goal, NULL);
 }
 
 /**
@@ -208,19 +176,30 @@ struct node *get_node_at_index_wrapper(struct node *root, int goal) {
  * @param root The root of the tree to print.
  */
 void print_nodes_index_order(struct node *root) {
-    int num_nodes = get_number_of_nodes(root);
+    bool first = true;
+
+    if (root) print_index_order(root, &first);
+}
 
-    for (int i = 0; i < num_nodes; i++) {
-        printf("'%c'", get_node_at_index_wrapper(root, i)->value);
+/**
+ * Print the nodes of a subtree in index order, after the nodes before it.
+ * @param node The root of the subtree.
+ * @param first Whether no node has been printed yet.
+ */
+static void print_index_order(struct node *node, bool *first) {
+    if (!*first) printf(", ");
 
-        if (i != num_nodes - 1) {
-            printf(", ");
-        }
-    }
+    printf("'%c'", node->value);
+    *first = false;
+
+    if (node->left) print_index_order(node->left, first);
+    if (node->right) print_index_order(node->right, first);
 }
 
 /**
- * Append a child node to the given node.
+ * Append a child node to the given node, and update the node's size and
+ * height. The sizes and heights of the node's ancestors are updated by
+ * whoever builds the tree, after its subtrees are built (see grow()).
  * @param node The node to append to.
  * @param value The value of the child.
  * @param side The side of the parent node to append to.
@@ -228,64 +207,28 @@ void print_nodes_index_order(struct node *root) {
  *                    1 = right side
  *             Use the macros LEFT_SIDE and RIGHT_SIDE defined
  *             in binary_tree.h
- * @return The new child node.
+ * @return The new child node, or NULL if the side is taken.
  */
 struct node *append_node(struct node *node, char value, bool side) {
+    if (side == LEFT_SIDE ? node->left != NULL : node->right != NULL) return NULL;
+
     struct node *new = new_node(value);
 
-    if (side == LEFT_SIDE) {
-        if (node->left) return NULL;
-        node->left = new;
-    }
-    else if (side == RIGHT_SIDE) {
-        if (node->right) return NULL;
-        node->right = new;
-    }
+    if (side == LEFT_SIDE) node->left = new;
+    else node->right = new;
+
+    update_node(node);
 
     return new;
 }
 
 /**
- * Get the max depth of a tree through iterative traversal using a queue.
+ * Get the max depth of a tree.
  * @param root The root of the tree.
  * @return The max depth of the tree.
  */
 int get_max_tree_depth(struct node *root) {
-    if (!root) return 0;
-
-    struct queue *q = create_queue();
-
-    enqueue(q, root);
-
-    int height = 0;
-    int node_count;
-
-    // Get the height of the tree.
-    while ((node_count = q->size)) {
-        height++;
-
-        while (node_count > 0) {
-            struct node *node = q->front->value;
-
-            free_q_node(dequeue(q));
-
-            if (node->left) {
-                enqueue(q, node->left);
-            }
-
-            if (node->right) {
-                enqueue(q, node->right);
-            }
-
-            node_count--;
-        }
-    }
-
-    free_queue(q);
-
-    // Height is one more than depth.
-    return height-1;
-
+    return root ? root->height : 0;
 }
 
 /**
@@ -300,11 +243,56 @@ struct node *tree_deep_copy(struct node *node) {
         copy = new_node(node->value);
         copy->left = tree_deep_copy(node->left);
         copy->right = tree_deep_copy(node->right);
+
+        update_node(copy);
     }
 
     return copy;
 }
 
+/**
+ * Return a tree with the subtree at an index replaced, copying only the
+ * nodes on the path from the root to that index. The rest of the tree is
+ * shared with the original, which is left unchanged.
+ * @param root The tree.
+ * @param goal_i The index of the subtree to replace, in depth-first
+ *               left-to-right order.
+ * @param subtree The new subtree. The new tree takes over the reference.
+ * @return The new tree.
+ */
+struct node *replace_subtree(struct node *root, int goal_i, struct node *subtree) {
+    if (goal_i == 0) return subtree;
+
+    struct node *copy = new_node(root->value);
+    int left_size = get_number_of_nodes(root->left);
+
+    if (goal_i <= left_size) {
+        copy->left = replace_subtree(root->left, goal_i - 1, subtree);
+        if (root->right) copy->right = share_tree(root->right);
+    } else {
+        if (root->left) copy->left = share_tree(root->left);
+        copy->right = replace_subtree(root->right, goal_i - 1 - left_size, subtree);
+    }
+
+    update_node(copy);
+
+    return copy;
+}
+
+/**
+ * Return a subtree to put into a tree that is being built. The subtree
+ * is shared if it is allocated like the new nodes of the calling thread
+ * (see use_node_arena()), and copied otherwise, so that a tree is
+ * allocated either from an arena or on the heap.
+ * @param node The root of the subtree.
+ * @return The subtree, or its copy.
+ */
+struct node *share_tree(struct node *node) {
+    if (node->in_arena == is_node_arena_used()) return retain_node(node);
+
+    return tree_deep_copy(node);
+}
+
 /**
  * Return a string of a trees nodes in index order.
  * @param root The root of the tree.
@@ -312,18 +300,62 @@ struct node *tree_deep_copy(struct node *node) {
  */
 char *tree_to_string(struct node *root) {
     int num_nodes = get_number_of_nodes(root);
+    int pos = 0;
 
     char *str = allocate_m((size_t) (num_nodes + 1));
 
-    for (int i=0; i < num_nodes; i++) {
-        str[i] = get_node_at_index_wrapper(root, i)->value;
-    }
+    if (root) write_index_order(root, str, &pos);
 
     str[num_nodes] = '\0';
 
     return str;
 }
 
+/**
+ * Write the values of a tree's nodes in index order.
+ * @param node The root of the tree.
+ * @param str The string to write to.
+ * @param pos The position to write the root at. Set to the position after the tree.
+ */
+static void write_index_order(struct node *node, char *str, int *pos) {
+    str[(*pos)++] = node->value;
+
+    if (node->left) write_index_order(node->left, str, pos);
+    if (node->right) write_index_order(node->right, str, pos);
+}
+
+/**
+ * Check whether a string is the string of a tree (see tree_to_string()),
+ * without building the tree's string.
+ * @param root The root of the tree.
+ * @param str The string, which need not be NUL terminated.
+ * @param len The length of the string.
+ * @return Whether the string is the tree's.
+ */
+bool tree_matches_string(struct node *root, const char *str, int len) {
+    int pos = 0;
+
+    if (len != get_number_of_nodes(root)) return false;
+
+    return !root || matches_index_order(root, str, &pos);
+}
+
+/**
+ * Check the values of a tree's nodes, in index order, against a string.
+ * @param node The root of the tree.
+ * @param str The string, at least as long as the tree.
+ * @param pos The position of the root in the string. Set to the position after the tree.
+ * @return Whether the values are the same.
+ */
+static bool matches_index_order(struct node *node, const char *str, int *pos) {
+    if (str[(*pos)++] != node->value) return false;
+
+    if (node->left && !matches_index_order(node->left, str, pos)) return false;
+    if (node->right && !matches_index_order(node->right, str, pos)) return false;
+
+    return true;
+}
+
 
 void print_infix(struct node *root) {
     if (root) {
@@ -1,5 +1,7 @@
 #include "../include/config_parser.h"
 
+// The options that are set to -1 here are -1 until given, so that 0 given
+// on the command line is not replaced by the config file.
 bool VERBOSE;
 int POPULATION_SIZE;
 int MAX_DEPTH;
@@ -10,14 +12,43 @@ double SEED;
 double CROSSOVER_PROBABILITY;
 double MUTATION_PROBABILITY;
 double TEST_TRAIN_SPLIT;
+bool JIT;
+int FITNESS_CACHE_SIZE = -1;
+double SEMANTIC_CACHE_SIZE;
+int SEMANTIC_DEDUPLICATION;
+int SEMANTIC_DEDUPLICATION_CHECK = -1;
+bool INCREMENTAL_EVALUATION;
+bool RACING;
+bool FLOAT_EVALUATION;
+bool DAG_EVALUATION;
+int THREADS;
+int ROW_SHARDING;
+int ISLANDS;
+int MIGRATION_INTERVAL = -1;
+int MIGRATION_SIZE = -1;
+int MIGRATION_TOPOLOGY;
+int PROCESSES;
+bool STEADY_STATE;
+bool PREFIX_VARIATION;
 char *CONFIG_DIR;
 char *CSV_DIR;
+char *FITNESS_CACHE_FILE;
 
 char help_string[] = "usage: ./pony_gp --config <CONFIG> --fc <FITNESS_CASES>\n"
         "                    [-p <POPULATION_SIZE>] [-m <MAX_DEPTH>] [-e <ELITE_SIZE>]\n"
         "                    [-g <GENERATIONS>] [--ts <TOURNAMENT_SIZE>] [-s <SEED>]\n"
         "                    [--cp <CROSSOVER_PROBABILITY>] [--mp <MUTATION_PROBABILITY>]\n"
-        "                    [--tts <TEST_TRAIN_SPLIT>] [-v <VERBOSE>]\n"
+        "                    [--tts <TEST_TRAIN_SPLIT>] [--jit <JIT>]\n"
+        "                    [--fcs <FITNESS_CACHE_SIZE>] [--fcf <FITNESS_CACHE_FILE>]\n"
+        "                    [--scs <SEMANTIC_CACHE_SIZE>] [--sdd <SEMANTIC_DEDUPLICATION>]\n"
+        "                    [--sddc <SEMANTIC_DEDUPLICATION_CHECK>] [--ie <INCREMENTAL_EVALUATION>]\n"
+        "                    [--racing <RACING>] [--fe <FLOAT_EVALUATION>]\n"
+        "                    [--dag <DAG_EVALUATION>] [--threads <THREADS>]\n"
+        "                    [--rs <ROW_SHARDING>] [--islands <ISLANDS>]\n"
+        "                    [--mi <MIGRATION_INTERVAL>] [--ms <MIGRATION_SIZE>]\n"
+        "                    [--mt <MIGRATION_TOPOLOGY>] [--processes <PROCESSES>]\n"
+        "                    [--ss <STEADY_STATE>] [--pv <PREFIX_VARIATION>]\n"
+        "                    [-v <VERBOSE>]\n"
         "\n"
         "\n"
         "Required arguments:\n"
@@ -58,6 +89,82 @@ char help_string[] = "usage: ./pony_gp --config <CONFIG> --fc <FITNESS_CASES>\n"
         "  --tts <TEST_TRAIN_SPLIT> --test_train_split <TEST_TRAIN_SPLIT>\n"
         "                             Test-train data split, [0.0, 1.0]. The ratio of fitness\n"
         "                             cases used for training individual solutions.\n"
+        "  --jit <JIT>\n"
+        "                             Set to 1 to compile individual solutions to native\n"
+        "                             code before evaluating them (x86-64 Linux only).\n"
+        "                             Otherwise, 0.\n"
+        "  --fcs <FITNESS_CACHE_SIZE> --fitness_cache_size <FITNESS_CACHE_SIZE>\n"
+        "                             Number of genomes whose fitness is cached, so that\n"
+        "                             they are not evaluated again.\n"
+        "  --fcf <FITNESS_CACHE_FILE> --fitness_cache_file <FITNESS_CACHE_FILE>\n"
+        "                             Path of a file of fitness values shared by runs on\n"
+        "                             the same training data (the same fitness cases, seed\n"
+        "                             and test-train split), which is created if it does\n"
+        "                             not exist. Genomes in the file are not evaluated, and\n"
+        "                             the genomes that are evaluated are added to it. Unix only.\n"
+        "  --scs <SEMANTIC_CACHE_SIZE> --semantic_cache_size <SEMANTIC_CACHE_SIZE>\n"
+        "                             Memory (MB) for caching the outputs of subtrees on\n"
+        "                             the training data. Set to 0 to disable the cache.\n"
+        "  --sdd <SEMANTIC_DEDUPLICATION> --semantic_deduplication <SEMANTIC_DEDUPLICATION>\n"
+        "                             Number of training cases (at most 256) on which an\n"
+        "                             offspring is run before it is evaluated. If a genome\n"
+        "                             evaluated before had the same outputs on them, its\n"
+        "                             fitness is used. Needs the fitness cache. Set to 0 to\n"
+        "                             evaluate every offspring.\n"
+        "  --sddc <SEMANTIC_DEDUPLICATION_CHECK> --semantic_deduplication_check <SEMANTIC_DEDUPLICATION_CHECK>\n"
+        "                             Whether deduplicated offspring are evaluated on all of\n"
+        "                             the training data before they join the elite or are\n"
+        "                             the best solution.\n"
+        "  --ie <INCREMENTAL_EVALUATION> --incremental_evaluation <INCREMENTAL_EVALUATION>\n"
+        "                             Set to 1 to keep the outputs of every node of every\n"
+        "                             individual, so that offspring only evaluate the nodes\n"
+        "                             changed by variation. Otherwise, 0.\n"
+        "  --racing <RACING>\n"
+        "                             Set to 1 to stop evaluating offspring as soon as they\n"
+        "                             are known to be worse than the worst elite. Their\n"
+        "                             fitness is then an upper bound. Otherwise, 0.\n"
+        "  --fe <FLOAT_EVALUATION> --float_evaluation <FLOAT_EVALUATION>\n"
+        "                             Set to 1 to evaluate on the training data in single\n"
+        "                             precision. The best individuals are re-scored in\n"
+        "                             double precision every generation. Otherwise, 0.\n"
+        "  --dag <DAG_EVALUATION> --dag_evaluation <DAG_EVALUATION>\n"
+        "                             Set to 1 to evaluate the offspring of a generation\n"
+        "                             together, with every unique subtree evaluated once.\n"
+        "                             Otherwise, 0.\n"
+        "  --threads <THREADS>\n"
+        "                             Number of threads that vary and evaluate individual\n"
+        "                             solutions in parallel.\n"
+        "  --rs <ROW_SHARDING> --row_sharding <ROW_SHARDING>\n"
+        "                             How evaluation is split between threads. 0 to choose\n"
+        "                             from the number of individuals and fitness cases, 1\n"
+        "                             to split by individual, 2 to split the fitness cases\n"
+        "                             of each individual as well.\n"
+        "  --islands <ISLANDS>\n"
+        "                             Number of islands, each with its own population of\n"
+        "                             POPULATION_SIZE individual solutions, evolved in its\n"
+        "                             own thread.\n"
+        "  --mi <MIGRATION_INTERVAL> --migration_interval <MIGRATION_INTERVAL>\n"
+        "                             Number of generations between migrations between\n"
+        "                             islands. Set to 0 for no migration.\n"
+        "  --ms <MIGRATION_SIZE> --migration_size <MIGRATION_SIZE>\n"
+        "                             Number of best individual solutions of an island that\n"
+        "                             migrate, replacing the worst of another island.\n"
+        "  --mt <MIGRATION_TOPOLOGY> --migration_topology <MIGRATION_TOPOLOGY>\n"
+        "                             0 to migrate to the next island in a ring, 1 to\n"
+        "                             migrate around a random cycle of the islands.\n"
+        "  --processes <PROCESSES>\n"
+        "                             Number of processes, each evolving one island. The\n"
+        "                             processes exchange migrants over Unix domain sockets\n"
+        "                             through this process, which prints their statistics.\n"
+        "  --ss <STEADY_STATE> --steady_state <STEADY_STATE>\n"
+        "                             Set to 1 to replace individual solutions one at a\n"
+        "                             time instead of a generation at a time, with no wait\n"
+        "                             between generations. Statistics are printed every\n"
+        "                             POPULATION_SIZE evaluations. Otherwise, 0.\n"
+        "  --pv <PREFIX_VARIATION> --prefix_variation <PREFIX_VARIATION>\n"
+        "                             Set to 1 to cross over and mutate genomes stored\n"
+        "                             as arrays of symbols in prefix order. Gives the same\n"
+        "                             results. Otherwise, 0.\n"
         "  -v <VERBOSE> --verbose <VERBOSE>\n"
         "                             Set to 1 for verbose printing. Otherwise, 0.";
 
@@ -72,10 +179,36 @@ void arg_parse(int argc, char *argv[]) {
     bool config_def = false;
 
     for (int i=1; i < argc; i+=2) {
-        if (strstr(argv[i], "-p") || strstr(argv[i], "--population_size")) {
+        // Checked first, since "--scs", "--sdd" and "--ss" also contain "-s", and "--processes"
+        // and "--pv" "-p". "--fcs" and "--fcf" also contain "--fc".
+        if (strstr(argv[i], "--scs") || strstr(argv[i], "--semantic_cache_size")) {
+            SEMANTIC_CACHE_SIZE = atof(argv[i+1]);
+        } else if (strstr(argv[i], "--fcs") || strstr(argv[i], "--fitness_cache_size")) {
+            FITNESS_CACHE_SIZE = (int) atof(argv[i+1]);
+        } else if (strstr(argv[i], "--fcf") || strstr(argv[i], "--fitness_cache_file")) {
+            FITNESS_CACHE_FILE = argv[i+1];
+        } else if (strstr(argv[i], "--sddc") || strstr(argv[i], "--semantic_deduplication_check")) {
+            // Checked first, since "--sddc" contains "--sdd".
+            SEMANTIC_DEDUPLICATION_CHECK = (bool)atof(argv[i+1]);
+        } else if (strstr(argv[i], "--sdd") || strstr(argv[i], "--semantic_deduplication")) {
+            SEMANTIC_DEDUPLICATION = (int) atof(argv[i+1]);
+        } else if (strstr(argv[i], "--ss") || strstr(argv[i], "--steady_state")) {
+            STEADY_STATE = (bool)atof(argv[i+1]);
+        } else if (strstr(argv[i], "--pv") || strstr(argv[i], "--prefix_variation")) {
+            PREFIX_VARIATION = (bool)atof(argv[i+1]);
+        } else if (strstr(argv[i], "--processes")) {
+            PROCESSES = (int) atof(argv[i+1]);
+        } else if (strstr(argv[i], "-p") || strstr(argv[i], "--population_size")) {
             POPULATION_SIZE = (int) atof(argv[i+1]);
         } else if(strstr(argv[i], "--mp") || strstr(argv[i], "--mutation_probability")) {
             MUTATION_PROBABILITY = atof(argv[i+1]);
+        } else if(!strcmp(argv[i], "--mi") || !strcmp(argv[i], "--migration_interval")) {
+            // Compared whole, since "--migration_size" and "--migration_topology" contain "--mi".
+            MIGRATION_INTERVAL = (int) atof(argv[i+1]);
+        } else if(!strcmp(argv[i], "--ms") || !strcmp(argv[i], "--migration_size")) {
+            MIGRATION_SIZE = (int) atof(argv[i+1]);
+        } else if(!strcmp(argv[i], "--mt") || !strcmp(argv[i], "--migration_topology")) {
+            MIGRATION_TOPOLOGY = (int) atof(argv[i+1]);
         } else if(strstr(argv[i], "-m") || strstr(argv[i], "--max_depth")) {
             MAX_DEPTH = (int) atof(argv[i+1]);
         } else if(strstr(argv[i], "-e") || strstr(argv[i], "--elite_size")) {
@@ -90,6 +223,22 @@ void arg_parse(int argc, char *argv[]) {
             CROSSOVER_PROBABILITY = atof(argv[i+1]);
         } else if(strstr(argv[i], "--tts") || strstr(argv[i], "--test_train_split")) {
             TEST_TRAIN_SPLIT = atof(argv[i+1]);
+        } else if(strstr(argv[i], "--jit")) {
+            JIT = (bool)atof(argv[i+1]);
+        } else if(strstr(argv[i], "--ie") || strstr(argv[i], "--incremental_evaluation")) {
+            INCREMENTAL_EVALUATION = (bool)atof(argv[i+1]);
+        } else if(strstr(argv[i], "--racing")) {
+            RACING = (bool)atof(argv[i+1]);
+        } else if(strstr(argv[i], "--fe") || strstr(argv[i], "--float_evaluation")) {
+            FLOAT_EVALUATION = (bool)atof(argv[i+1]);
+        } else if(strstr(argv[i], "--dag")) {
+            DAG_EVALUATION = (bool)atof(argv[i+1]);
+        } else if(strstr(argv[i], "--threads")) {
+            THREADS = (int) atof(argv[i+1]);
+        } else if(strstr(argv[i], "--rs") || strstr(argv[i], "--row_sharding")) {
+            ROW_SHARDING = (int) atof(argv[i+1]);
+        } else if(strstr(argv[i], "--islands")) {
+            ISLANDS = (int) atof(argv[i+1]);
         } else if(strstr(argv[i], "-v") || strstr(argv[i], "--verbose")) {
             VERBOSE = (bool)atof(argv[i+1]);
         } else if(strstr(argv[i], "--config")) {
@@ -216,6 +365,43 @@ void set_params(FILE *file, struct symbols *s) {
                         MUTATION_PROBABILITY = td;
                     } else if (strstr(line, "test_train_split") && !TEST_TRAIN_SPLIT) {
                         TEST_TRAIN_SPLIT = td;
+                    } else if (strstr(line, "jit") && !JIT) {
+                        JIT = (bool) td;
+                    } else if (strstr(line, "fitness_cache_size") && FITNESS_CACHE_SIZE < 0) {
+                        FITNESS_CACHE_SIZE = (int) td;
+                    } else if (strstr(line, "semantic_cache_size") && !SEMANTIC_CACHE_SIZE) {
+                        SEMANTIC_CACHE_SIZE = td;
+                    } else if (strstr(line, "semantic_deduplication_check")) {
+                        // Matched apart from its value, since it contains "semantic_deduplication".
+                        if (SEMANTIC_DEDUPLICATION_CHECK < 0) SEMANTIC_DEDUPLICATION_CHECK = (bool) td;
+                    } else if (strstr(line, "semantic_deduplication") && !SEMANTIC_DEDUPLICATION) {
+                        SEMANTIC_DEDUPLICATION = (int) td;
+                    } else if (strstr(line, "incremental_evaluation") && !INCREMENTAL_EVALUATION) {
+                        INCREMENTAL_EVALUATION = (bool) td;
+                    } else if (strstr(line, "racing") && !RACING) {
+                        RACING = (bool) td;
+                    } else if (strstr(line, "float_evaluation") && !FLOAT_EVALUATION) {
+                        FLOAT_EVALUATION = (bool) td;
+                    } else if (strstr(line, "dag_evaluation") && !DAG_EVALUATION) {
+                        DAG_EVALUATION = (bool) td;
+                    } else if (strstr(line, "threads") && !THREADS) {
+                        THREADS = (int) td;
+                    } else if (strstr(line, "row_sharding") && !ROW_SHARDING) {
+                        ROW_SHARDING = (int) td;
+                    } else if (strstr(line, "islands") && !ISLANDS) {
+                        ISLANDS = (int) td;
+                    } else if (strstr(line, "migration_interval") && MIGRATION_INTERVAL < 0) {
+                        MIGRATION_INTERVAL = (int) td;
+                    } else if (strstr(line, "migration_size") && MIGRATION_SIZE < 0) {
+                        MIGRATION_SIZE = (int) td;
+                    } else if (strstr(line, "migration_topology") && !MIGRATION_TOPOLOGY) {
+                        MIGRATION_TOPOLOGY = (int) td;
+                    } else if (strstr(line, "processes") && !PROCESSES) {
+                        PROCESSES = (int) td;
+                    } else if (strstr(line, "steady_state") && !STEADY_STATE) {
+                        STEADY_STATE = (bool) td;
+                    } else if (strstr(line, "prefix_variation") && !PREFIX_VARIATION) {
+                        PREFIX_VARIATION = (bool) td;
                     }
 
                     // Default verbose to false unless defined
@@ -236,5 +422,11 @@ void set_params(FILE *file, struct symbols *s) {
     s->terminals[t_i] = '\0';
     s->term_size = t_i;
     s->func_size = f_i;
+
+    // Options given neither on the command line nor in the config file.
+    if (FITNESS_CACHE_SIZE < 0) FITNESS_CACHE_SIZE = 0;
+    if (SEMANTIC_DEDUPLICATION_CHECK < 0) SEMANTIC_DEDUPLICATION_CHECK = 0;
+    if (MIGRATION_INTERVAL < 0) MIGRATION_INTERVAL = 0;
+    if (MIGRATION_SIZE < 0) MIGRATION_SIZE = 0;
 }
 
@@ -1,28 +1,12 @@
-
 #include "../include/csv_parser.h"
 
-double **fitness_cases;
-double *targets;
-
-int fitness_len;
-int targets_len;
-int num_columns;
-
-int fitness_split;
-
-double **test_cases;
-double *test_targets;
-double **training_cases;
-double *training_targets;
-
-int training_len;
-int test_len;
+struct dataset *fitness_data;
+struct dataset *training_data;
+struct dataset *test_data;
 
 char *headers;
 int num_headers;
 
-int num_exemplars;
-
 
 /**
  * Parse a CSV file for any variables/constants then add them
@@ -89,19 +73,13 @@ void parse_exemplars(FILE *file) {
     char **lines = get_lines(file);
 
     int num_lines = get_num_lines(file);
-    num_exemplars = num_lines - 1;
-    num_columns = get_num_columns(file);
-
-    // Allocate fitness_cases.
-    // Leave space for NULL
-    fitness_cases = allocate_m(sizeof(double *) * num_lines);
-    targets = allocate_m(sizeof(double) * num_lines);
+    int num_columns = get_num_columns(file);
 
-    int t_i = 0; // Index counter for targets
-    int f_i = 0; // Index counter for fitness cases
+    // Ignore the header.
+    fitness_data = new_dataset(num_lines - 1, num_columns - 1);
 
     char *line;
-    // Ignore the header.
+
     for (int i = 1; i < num_lines; i++) {
         line = lines[i];
         remove_spaces(line);
@@ -110,30 +88,18 @@ void parse_exemplars(FILE *file) {
         // Current column
         int c = 0;
 
-        double *inputs = allocate_m(sizeof(double) * num_columns); // Leave space for NAN.
-
         for (char *t = strtok(line, const_delimeter); t != NULL; t = strtok(NULL, const_delimeter), c++) {
 
             if (c == num_columns - 1) {
                 // The last column will always contain a target/desired output.
-                targets[t_i++] = atof(t);
-            } else {
-                inputs[c] = atof(t);
+                fitness_data->targets[i - 1] = atof(t);
+            } else if (c < num_columns - 1) {
+                fitness_data->columns[c][i - 1] = atof(t);
             }
         }
 
-        inputs[c-1] = NAN;
-
-        fitness_cases[f_i++] = inputs;
+        assert(c == num_columns);
     }
-
-    fitness_cases[f_i] = NULL;
-    targets[t_i] = NAN;
-
-    fitness_len = f_i;
-    targets_len = t_i;
-
-    assert(fitness_len == targets_len);
 }
 
 /**
@@ -143,48 +109,16 @@ void parse_exemplars(FILE *file) {
 void set_test_and_train_data(FILE *file) {
     parse_exemplars(file);
 
-    fitness_split = (int)floor(fitness_len * TEST_TRAIN_SPLIT);
-
-    // Leave space for NULL/NAN for easier looping
-    training_cases = allocate_m(sizeof(double *) * (fitness_split + 1));
-    test_cases = allocate_m(sizeof(double *) * (fitness_len - fitness_split + 1));
-    training_targets = allocate_m(sizeof(double) * (fitness_split + 1));
-    test_targets = allocate_m(sizeof(double) * (fitness_len - fitness_split + 1));
-
-    // Allocate the inner arrays.
-    for (int i=0; i < fitness_split; i++) {
-        training_cases[i] = allocate_m(sizeof(double) * num_columns);
-
-        if (i >= fitness_len) {
-            test_cases[i - fitness_split] = allocate_m(sizeof(double) * num_columns);
-        }
-    }
+    int fitness_len = fitness_data->len;
+    int fitness_split = (int)floor(fitness_len * TEST_TRAIN_SPLIT);
 
     // Randomize index order access.
-    // This function call is what causes the error. Specifically,
-    // the call to rand() within the function results in the errors.
     int *fit_rand_idxs = rand_indexes(fitness_len);
 
-    int rand_i;
-
     // Split fitness and target data into training and test cases.
-    for (int i=0; i < fitness_len; i++) {
-        rand_i = fit_rand_idxs[i];
-
-        if (i >= fitness_split) {
-            test_cases[i - fitness_split] = fitness_cases[rand_i];
-            test_targets[i - fitness_split] = targets[rand_i];
-        } else {
-            training_cases[i] = fitness_cases[rand_i];
-            training_targets[i] = targets[rand_i];
-        }
-    }
-
-    training_cases[fitness_split] = NULL;
-    test_cases[fitness_len - fitness_split] = NULL;
-    training_targets[fitness_split] = NAN;
-    test_targets[fitness_len - fitness_split] = NAN;
+    // Each split is a copy, so it can be streamed a column at a time.
+    training_data = dataset_subset(fitness_data, fit_rand_idxs, fitness_split);
+    test_data = dataset_subset(fitness_data, fit_rand_idxs + fitness_split, fitness_len - fitness_split);
 
-    training_len = fitness_split;
-    test_len = fitness_len - fitness_split;
-}
\ No newline at end of file
+    free_pointer(fit_rand_idxs);
+}
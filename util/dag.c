@@ -0,0 +1,251 @@
+#include "../include/dag.h"
+
+static int intern_node(struct dag *d, char value, int left, int right);
+static int schedule_slots(struct dag *d, const int *root_count, int *slots);
+
+/**
+ * Allocate an empty DAG store.
+ * @param capacity The largest number of unique nodes it will hold.
+ * @return The store.
+ */
+struct dag *new_dag(int capacity) {
+    struct dag *d = allocate_m(sizeof(struct dag));
+
+    d->nodes = allocate_m(sizeof(struct dag_node) * (capacity ? capacity : 1));
+    d->len = 0;
+    d->capacity = capacity;
+    d->interned = 0;
+
+    // Keep the load factor at or below one half.
+    d->num_buckets = 16;
+
+    while (d->num_buckets < 2 * capacity) d->num_buckets *= 2;
+
+    d->buckets = allocate_m(sizeof(int) * d->num_buckets);
+
+    for (int i = 0; i < d->num_buckets; i++) {
+        d->buckets[i] = -1;
+    }
+
+    return d;
+}
+
+/**
+ * Free the memory allocated for a DAG store.
+ * @param d The store to free.
+ */
+void free_dag(struct dag *d) {
+    free_pointer(d->nodes);
+    free_pointer(d->buckets);
+    free_pointer(d);
+}
+
+/**
+ * Intern a tree. Subtrees that are already in the store are shared
+ * instead of added again. A missing child is interned as a leaf.
+ * The store must have room for `2 * get_number_of_nodes(root) + 1`
+ * more nodes.
+ * @param d The store.
+ * @param root The root of the tree.
+ * @return The index of the root's node. The caller holds a reference to it.
+ */
+int intern_tree(struct dag *d, struct node *root) {
+    if (!root) return intern_node(d, MISSING_NODE_SYMBOL, -1, -1);
+
+    d->interned++;
+
+    char symbol = root->value;
+
+    if (symbol == '+' || symbol == '-' || symbol == '*' || symbol == '/') {
+        int left = intern_tree(d, root->left);
+        int right = intern_tree(d, root->right);
+
+        return intern_node(d, symbol, left, right);
+    }
+
+    return intern_node(d, symbol, -1, -1);
+}
+
+/**
+ * Find or add the node with the given symbol and children. The
+ * references to the children are handed over to the node, or dropped
+ * if the node already exists.
+ * @return The index of the node, with one more reference.
+ */
+static int intern_node(struct dag *d, char value, int left, int right) {
+    uint64_t hash = 14695981039346656037ULL;
+
+    hash = (hash ^ (unsigned char) value) * 1099511628211ULL;
+    hash = (hash ^ (uint32_t) left) * 1099511628211ULL;
+    hash = (hash ^ (uint32_t) right) * 1099511628211ULL;
+
+    int bucket = (int) (hash & (uint64_t) (d->num_buckets - 1));
+
+    for (int i = d->buckets[bucket]; i >= 0; i = d->nodes[i].chain) {
+        struct dag_node *n = &d->nodes[i];
+
+        if (n->value == value && n->left == left && n->right == right) {
+            if (left >= 0) d->nodes[left].refs--;
+            if (right >= 0) d->nodes[right].refs--;
+
+            n->refs++;
+
+            return i;
+        }
+    }
+
+    assert(d->len < d->capacity);
+
+    int i = d->len++;
+    struct dag_node *n = &d->nodes[i];
+
+    n->value = value;
+    n->left = left;
+    n->right = right;
+    n->refs = 1;
+    n->chain = d->buckets[bucket];
+
+    d->buckets[bucket] = i;
+
+    return i;
+}
+
+/**
+ * Assign each node a column of the scratch space to hold its outputs.
+ * A column is reused once the last node (or root) that reads it has
+ * been evaluated. Variables are read from the dataset and take no column.
+ * @param d The store.
+ * @param root_count The number of roots at each node.
+ * @param slots Set to the column of each node, or -1.
+ * @return The number of columns used.
+ */
+static int schedule_slots(struct dag *d, const int *root_count, int *slots) {
+    int *remaining = allocate_m(sizeof(int) * (d->len ? d->len : 1));
+    int *free_slots = allocate_m(sizeof(int) * (d->len ? d->len : 1));
+    int num_free = 0;
+    int num_slots = 0;
+
+    for (int i = 0; i < d->len; i++) {
+        struct dag_node *n = &d->nodes[i];
+
+        remaining[i] = n->refs;
+
+        if (isalpha(n->value)) {
+            slots[i] = -1;
+        } else {
+            slots[i] = num_free ? free_slots[--num_free] : num_slots++;
+        }
+
+        // The parent's column differs from its children's, so it can
+        // be written while they are read.
+        int children[2] = {n->left, n->right};
+
+        for (int c = 0; c < 2; c++) {
+            int child = children[c];
+
+            if (child >= 0 && --remaining[child] == 0 && slots[child] >= 0) {
+                free_slots[num_free++] = slots[child];
+            }
+        }
+
+        // The roots read the node as soon as it is evaluated.
+        remaining[i] -= root_count[i];
+
+        if (remaining[i] == 0 && slots[i] >= 0) free_slots[num_free++] = slots[i];
+    }
+
+    free_pointer(remaining);
+    free_pointer(free_slots);
+
+    return num_slots;
+}
+
+/**
+ * Calculate the sum of the squared errors of every root over a set of
+ * fitness cases. Every unique node is evaluated once, whatever the
+ * number of trees that share it. Gives the same results as
+ * program_squared_error().
+ * @param d The store.
+ * @param roots The nodes of the trees to evaluate, as returned by intern_tree().
+ * @param num_roots The number of roots.
+ * @param data The fitness cases.
+ * @param errors Set to the sum of the squared errors of each root.
+ */
+void dag_squared_errors(struct dag *d, const int *roots, int num_roots, struct dataset *data, double *errors) {
+    const struct kernels *k = get_kernels();
+    int size = d->len ? d->len : 1;
+
+    // The roots at each node, as linked lists.
+    int *root_count = allocate_m(sizeof(int) * size);
+    int *first_root = allocate_m(sizeof(int) * size);
+    int *next_root = allocate_m(sizeof(int) * (num_roots ? num_roots : 1));
+
+    for (int i = 0; i < d->len; i++) {
+        root_count[i] = 0;
+        first_root[i] = -1;
+    }
+
+    for (int r = 0; r < num_roots; r++) {
+        root_count[roots[r]]++;
+        next_root[r] = first_root[roots[r]];
+        first_root[roots[r]] = r;
+        errors[r] = 0.0;
+    }
+
+    int *slots = allocate_m(sizeof(int) * size);
+    int num_slots = schedule_slots(d, root_count, slots);
+
+    double *scratch = allocate_m(sizeof(double) * EVAL_BLOCK_SIZE * (num_slots ? num_slots : 1));
+    const double **outputs = allocate_m(sizeof(double *) * size);
+
+    for (int start = 0; start < data->len; start += EVAL_BLOCK_SIZE) {
+        int n = (data->len - start < EVAL_BLOCK_SIZE) ? data->len - start : EVAL_BLOCK_SIZE;
+
+        // The columns are padded, so run whole vectors past the last case.
+        int width = n;
+
+        if (start + n == data->len) {
+            width = ((n + DATASET_PADDING - 1) / DATASET_PADDING) * DATASET_PADDING;
+        }
+
+        for (int i = 0; i < d->len; i++) {
+            struct dag_node *node = &d->nodes[i];
+
+            if (isalpha(node->value)) {
+                int index = node->value - (islower(node->value) ? 'a' : 'A');
+
+                outputs[i] = data->columns[index] + start;
+            } else {
+                double *out = scratch + (size_t) slots[i] * EVAL_BLOCK_SIZE;
+
+                if (node->left < 0) {
+                    double value = (node->value == MISSING_NODE_SYMBOL) ?
+                                   MISSING_NODE_VALUE : (double) (node->value - '0');
+
+                    fill_column(out, value, width);
+                } else {
+                    const double *left = outputs[node->left];
+                    const double *right = outputs[node->right];
+
+                    if (node->value == '+') k->add(out, left, right, width);
+                    else if (node->value == '-') k->sub(out, left, right, width);
+                    else if (node->value == '*') k->mul(out, left, right, width);
+                    else k->pdiv(out, left, right, width);
+                }
+
+                outputs[i] = out;
+            }
+
+            for (int r = first_root[i]; r >= 0; r = next_root[r]) {
+                errors[r] += k->squared_error(outputs[i], data->targets + start, n);
+            }
+        }
+    }
+
+    free_pointer(root_count);
+    free_pointer(first_root);
+    free_pointer(next_root);
+    free_pointer(slots);
+    free_pointer(scratch);
+    free_pointer(outputs);
+}
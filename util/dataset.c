@@ -0,0 +1,141 @@
+#include "../include/dataset.h"
+
+/**
+ * Allocate a zeroed dataset. The columns (and the targets) are
+ * DATASET_ALIGNMENT aligned and padded to a multiple of DATASET_PADDING.
+ * @param len The number of fitness cases.
+ * @param num_inputs The number of input variables.
+ * @return The new dataset.
+ */
+struct dataset *new_dataset(int len, int num_inputs) {
+    struct dataset *d = allocate_m(sizeof(struct dataset));
+
+    d->len = len;
+    d->num_inputs = num_inputs;
+    d->stride = ((len + DATASET_PADDING - 1) / DATASET_PADDING) * DATASET_PADDING;
+
+    // Over-allocate so that the first column can be aligned.
+    size_t size = sizeof(double) * (size_t) d->stride * (num_inputs + 1);
+
+    d->block = allocate_m(size + DATASET_ALIGNMENT);
+    memset(d->block, 0, size + DATASET_ALIGNMENT);
+
+    uintptr_t start = ((uintptr_t) d->block + DATASET_ALIGNMENT - 1) & ~(uintptr_t) (DATASET_ALIGNMENT - 1);
+    double *values = (double *) start;
+
+    d->columns = allocate_m(sizeof(double *) * (num_inputs ? num_inputs : 1));
+
+    for (int c = 0; c < num_inputs; c++) {
+        d->columns[c] = values + (size_t) c * d->stride;
+    }
+
+    d->targets = values + (size_t) num_inputs * d->stride;
+
+    return d;
+}
+
+/**
+ * Free the memory allocated for a dataset.
+ * @param d The dataset to free.
+ */
+void free_dataset(struct dataset *d) {
+    free_pointer(d->columns);
+    free_pointer(d->block);
+    free_pointer(d);
+}
+
+/**
+ * Return the 64-bit FNV-1a hash of the fitness cases of a dataset, input
+ * columns first, then the targets.
+ * @param d The dataset.
+ * @return The hash.
+ */
+uint64_t hash_dataset(struct dataset *d) {
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (int c = 0; c <= d->num_inputs; c++) {
+        const unsigned char *bytes = (const unsigned char *) (c < d->num_inputs ? d->columns[c] : d->targets);
+
+        for (size_t i = 0; i < sizeof(double) * (size_t) d->len; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+
+    return hash;
+}
+
+/**
+ * Return a copy of some of the fitness cases of a dataset, in the
+ * given order.
+ * @param d The dataset to copy from.
+ * @param indexes The fitness cases to copy.
+ * @param len The number of indexes.
+ * @return The new dataset.
+ */
+struct dataset *dataset_subset(struct dataset *d, const int *indexes, int len) {
+    struct dataset *subset = new_dataset(len, d->num_inputs);
+
+    for (int c = 0; c < d->num_inputs; c++) {
+        for (int i = 0; i < len; i++) {
+            subset->columns[c][i] = d->columns[c][indexes[i]];
+        }
+    }
+
+    for (int i = 0; i < len; i++) {
+        subset->targets[i] = d->targets[indexes[i]];
+    }
+
+    return subset;
+}
+
+/**
+ * Return a single precision copy of a dataset. The columns are
+ * DATASET_ALIGNMENT aligned and padded to a multiple of
+ * FLOAT_DATASET_PADDING with zeros.
+ * @param d The dataset to copy.
+ * @return The new dataset.
+ */
+struct float_dataset *new_float_dataset(struct dataset *d) {
+    struct float_dataset *f = allocate_m(sizeof(struct float_dataset));
+
+    f->len = d->len;
+    f->num_inputs = d->num_inputs;
+    f->stride = ((d->len + FLOAT_DATASET_PADDING - 1) / FLOAT_DATASET_PADDING) * FLOAT_DATASET_PADDING;
+
+    size_t size = sizeof(float) * (size_t) f->stride * (d->num_inputs + 1);
+
+    f->block = allocate_m(size + DATASET_ALIGNMENT);
+    memset(f->block, 0, size + DATASET_ALIGNMENT);
+
+    uintptr_t start = ((uintptr_t) f->block + DATASET_ALIGNMENT - 1) & ~(uintptr_t) (DATASET_ALIGNMENT - 1);
+    float *values = (float *) start;
+
+    f->columns = allocate_m(sizeof(float *) * (d->num_inputs ? d->num_inputs : 1));
+
+    for (int c = 0; c < d->num_inputs; c++) {
+        f->columns[c] = values + (size_t) c * f->stride;
+
+        for (int i = 0; i < d->len; i++) {
+            f->columns[c][i] = (float) d->columns[c][i];
+        }
+    }
+
+    f->targets = values + (size_t) d->num_inputs * f->stride;
+
+    for (int i = 0; i < d->len; i++) {
+        f->targets[i] = (float) d->targets[i];
+    }
+
+    return f;
+}
+
+/**
+ * Free the memory allocated for a single precision dataset.
+ * @param d The dataset to free.
+ */
+void free_float_dataset(struct float_dataset *d) {
+    free_pointer(d->columns);
+    free_pointer(d->block);
+    free_pointer(d);
+}
@@ -0,0 +1,286 @@
+#include "../include/fitness_cache.h"
+
+static size_t find_slot(struct fitness_cache *c, uint64_t hash, struct node *genome, const char *key, int key_len);
+static bool get_entry(struct fitness_cache *c, uint64_t hash, struct node *genome, const char *key, int key_len,
+                      double *fitness);
+static bool put_entry(struct fitness_cache *c, uint64_t hash, struct node *genome, const char *key, int key_len,
+                      double fitness);
+static void hash_walk(struct node *node, uint64_t *hash);
+static void evict_entry(struct fitness_cache *c);
+static void remove_slot(struct fitness_cache *c, size_t i);
+
+/**
+ * Allocate a fitness cache.
+ * @param capacity The maximum number of genomes the cache holds.
+ * @return The empty cache.
+ */
+struct fitness_cache *init_fitness_cache(size_t capacity) {
+    struct fitness_cache *c = allocate_m(sizeof(struct fitness_cache));
+
+    c->capacity = capacity ? capacity : 1;
+    c->len = 0;
+    c->hand = 0;
+    c->hits = c->misses = c->evictions = 0;
+
+    // At most half of the slots are used, which keeps the probes short.
+    c->num_slots = 16;
+
+    while (c->num_slots < 2 * c->capacity) c->num_slots *= 2;
+
+    c->slots = allocate_m(sizeof(struct fitness_entry) * c->num_slots);
+
+    for (size_t i = 0; i < c->num_slots; i++) {
+        c->slots[i].key = NULL;
+    }
+
+    return c;
+}
+
+/**
+ * Free the memory allocated for a fitness cache and all its entries.
+ * @param c The cache to free.
+ */
+void free_fitness_cache(struct fitness_cache *c) {
+    for (size_t i = 0; i < c->num_slots; i++) {
+        if (c->slots[i].key) free_pointer(c->slots[i].key);
+    }
+
+    free_pointer(c->slots);
+    free_pointer(c);
+}
+
+/**
+ * Return the 64-bit FNV-1a hash of the string of a tree (see
+ * tree_to_string()), without building the string. The same as
+ * hash_symbols() of the string.
+ * @param root The root of the tree.
+ * @return The hash.
+ */
+uint64_t hash_tree(struct node *root) {
+    uint64_t hash = 14695981039346656037ULL;
+
+    if (root) hash_walk(root, &hash);
+
+    return hash;
+}
+
+/**
+ * Hash the values of a tree's nodes in index order.
+ */
+static void hash_walk(struct node *node, uint64_t *hash) {
+    *hash ^= (unsigned char) node->value;
+    *hash *= 1099511628211ULL;
+
+    if (node->left) hash_walk(node->left, hash);
+    if (node->right) hash_walk(node->right, hash);
+}
+
+/**
+ * Get the cached fitness of a genome. Several threads may get from the
+ * same cache at once, as long as no thread puts to it.
+ * @param c The cache.
+ * @param hash The hash of the genome, see hash_tree().
+ * @param genome The genome.
+ * @param fitness Set to the fitness, if the genome is cached.
+ * @return Whether the genome is cached.
+ */
+bool get_fitness_cache(struct fitness_cache *c, uint64_t hash, struct node *genome, double *fitness) {
+    return get_entry(c, hash, genome, NULL, 0, fitness);
+}
+
+/**
+ * Get the fitness cached under a key other than a genome, such as the
+ * outputs of a genome. See get_fitness_cache().
+ * @param c The cache.
+ * @param hash The hash of the key.
+ * @param key The key.
+ * @param key_len The length of the key.
+ * @param fitness Set to the fitness, if the key is cached.
+ * @return Whether the key is cached.
+ */
+bool get_fitness_cache_key(struct fitness_cache *c, uint64_t hash, const char *key, int key_len, double *fitness) {
+    return get_entry(c, hash, NULL, key, key_len, fitness);
+}
+
+/**
+ * Get the fitness cached under a genome, or if it is NULL, under a key.
+ */
+static bool get_entry(struct fitness_cache *c, uint64_t hash, struct node *genome, const char *key, int key_len,
+                      double *fitness) {
+    struct fitness_entry *e = &c->slots[find_slot(c, hash, genome, key, key_len)];
+
+    if (!e->key) {
+        ADD_RELAXED(&c->misses, 1);
+
+        return false;
+    }
+
+    ADD_RELAXED(&c->hits, 1);
+    STORE_RELAXED(&e->referenced, true);
+
+    *fitness = e->fitness;
+
+    return true;
+}
+
+/**
+ * Cache the fitness of a genome, unless it is cached already. When the
+ * cache is full, an entry that has not been used recently is evicted.
+ * @param c The cache.
+ * @param hash The hash of the genome, see hash_tree().
+ * @param genome The genome.
+ * @param fitness The fitness of the genome.
+ * @return Whether the genome was added, false if it was cached already.
+ */
+bool put_fitness_cache(struct fitness_cache *c, uint64_t hash, struct node *genome, double fitness) {
+    return put_entry(c, hash, genome, NULL, 0, fitness);
+}
+
+/**
+ * Cache a fitness under a key other than a genome, unless the key is
+ * cached already. See put_fitness_cache().
+ * @param c The cache.
+ * @param hash The hash of the key.
+ * @param key The key, which is copied.
+ * @param key_len The length of the key.
+ * @param fitness The fitness.
+ * @return Whether the key was added, false if it was cached already.
+ */
+bool put_fitness_cache_key(struct fitness_cache *c, uint64_t hash, const char *key, int key_len, double fitness) {
+    return put_entry(c, hash, NULL, key, key_len, fitness);
+}
+
+/**
+ * Cache a fitness under a genome, or if it is NULL, under a key.
+ */
+static bool put_entry(struct fitness_cache *c, uint64_t hash, struct node *genome, const char *key, int key_len,
+                      double fitness) {
+    if (c->slots[find_slot(c, hash, genome, key, key_len)].key) return false;
+
+    if (c->len == c->capacity) evict_entry(c);
+
+    // The eviction may have moved entries, so the slot is found again.
+    struct fitness_entry *e = &c->slots[find_slot(c, hash, genome, key, key_len)];
+
+    e->hash = hash;
+
+    if (genome) {
+        e->key = tree_to_string(genome);
+        e->key_len = get_number_of_nodes(genome);
+    } else {
+        e->key = allocate_m((size_t) key_len);
+        e->key_len = key_len;
+        memcpy(e->key, key, (size_t) key_len);
+    }
+
+    e->fitness = fitness;
+    // A new entry is spared by the hand once, like one that was used.
+    e->referenced = true;
+
+    c->len++;
+
+    return true;
+}
+
+/**
+ * Find the slot of a genome or a key, or the empty slot where it would go.
+ * @param c The cache.
+ * @param hash The hash of the genome or key.
+ * @param genome The genome, or NULL.
+ * @param key, key_len The key, if `genome` is NULL.
+ * @return The index of the slot.
+ */
+static size_t find_slot(struct fitness_cache *c, uint64_t hash, struct node *genome, const char *key, int key_len) {
+    size_t mask = c->num_slots - 1;
+    size_t i = (size_t) hash & mask;
+
+    for (;; i = (i + 1) & mask) {
+        struct fitness_entry *e = &c->slots[i];
+
+        if (!e->key) return i;
+
+        if (e->hash != hash) continue;
+
+        if (genome ? tree_matches_string(genome, e->key, e->key_len)
+                   : e->key_len == key_len && !memcmp(e->key, key, (size_t) key_len)) {
+            return i;
+        }
+    }
+}
+
+/**
+ * Evict the first entry after the clock hand that has not been used since
+ * the hand last passed it, clearing the mark of the used ones on the way.
+ * @param c The cache, which may not be empty.
+ */
+static void evict_entry(struct fitness_cache *c) {
+    for (;; c->hand = (c->hand + 1) & (c->num_slots - 1)) {
+        struct fitness_entry *e = &c->slots[c->hand];
+
+        if (!e->key) continue;
+
+        if (e->referenced) {
+            e->referenced = false;
+        } else {
+            // The hand stays, since the next entry may be moved into the slot.
+            remove_slot(c, c->hand);
+            c->evictions++;
+
+            return;
+        }
+    }
+}
+
+/**
+ * Remove the entry of a slot, moving the entries after it back so that
+ * every entry can still be found from its home slot.
+ * @param c The cache.
+ * @param i The slot.
+ */
+static void remove_slot(struct fitness_cache *c, size_t i) {
+    size_t mask = c->num_slots - 1;
+
+    free_pointer(c->slots[i].key);
+
+    for (size_t j = (i + 1) & mask; c->slots[j].key; j = (j + 1) & mask) {
+        size_t home = (size_t) c->slots[j].hash & mask;
+
+        // The entry at j can move to i if its home is not between them.
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            c->slots[i] = c->slots[j];
+            i = j;
+        }
+    }
+
+    c->slots[i].key = NULL;
+    c->len--;
+}
+
+/**
+ * Print the counters of a fitness cache, and reset them.
+ * @param c The cache.
+ * @param name What the cache is called in the output.
+ */
+void print_fitness_cache(struct fitness_cache *c, const char *name) {
+    long lookups = c->hits + c->misses;
+
+    printf("%s: hits: %ld, misses: %ld, hit rate: %.2f%%, evictions: %ld, entries: %zu/%zu\n",
+           name, c->hits, c->misses, lookups ? 100.0 * (double) c->hits / (double) lookups : 0.0,
+           c->evictions, c->len, c->capacity);
+
+    c->hits = c->misses = c->evictions = 0;
+}
+
+/**
+ * Add the counters of a fitness cache to those of another, and reset them,
+ * to print the counters of several threads' caches together.
+ * @param to The cache whose counters are added to.
+ * @param from The cache whose counters are moved.
+ */
+void move_fitness_cache_counts(struct fitness_cache *to, struct fitness_cache *from) {
+    to->hits += from->hits;
+    to->misses += from->misses;
+    to->evictions += from->evictions;
+
+    from->hits = from->misses = from->evictions = 0;
+}
@@ -0,0 +1,362 @@
+// Needed for mmap in strict C99 mode.
+#define _POSIX_C_SOURCE 200809L
+
+#include "../include/fitness_store.h"
+
+static size_t record_size(uint32_t key_len);
+static uint64_t record_check(const struct fitness_record *r, const char *key);
+static bool read_record(const unsigned char *map, size_t size, size_t offset, struct fitness_record *r);
+static size_t find_slot(struct fitness_store *s, uint64_t hash, const char *key, uint32_t key_len,
+                        struct node *genome);
+#ifdef PONY_GP_MMAP
+static bool mark_appended(struct fitness_store *s, uint64_t hash);
+static void insert_appended(uint64_t *slots, size_t num_slots, uint64_t hash);
+#endif
+
+/**
+ * The number of bytes of a record with its key.
+ */
+static size_t record_size(uint32_t key_len) {
+    return sizeof(struct fitness_record) + (((size_t) key_len + 7) & ~(size_t) 7);
+}
+
+/**
+ * Return the 64-bit FNV-1a hash of the fields of a record before `check`,
+ * and of its key.
+ * @param r The record.
+ * @param key The key.
+ * @return The hash.
+ */
+static uint64_t record_check(const struct fitness_record *r, const char *key) {
+    const unsigned char *bytes = (const unsigned char *) r;
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < offsetof(struct fitness_record, check); i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+
+    for (uint32_t i = 0; i < r->key_len; i++) {
+        hash ^= (unsigned char) key[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * Read the record at an offset of the mapped file, if a whole, valid
+ * record is there. The record is copied out, since a record after one
+ * that was only partly written need not be aligned.
+ * @param map The mapped file.
+ * @param size The number of bytes mapped.
+ * @param offset The offset.
+ * @param r Set to the record. Its key follows it in the file.
+ * @return Whether there is a valid record at the offset.
+ */
+static bool read_record(const unsigned char *map, size_t size, size_t offset, struct fitness_record *r) {
+    if (size - offset < sizeof(struct fitness_record)) return false;
+
+    memcpy(r, map + offset, sizeof(struct fitness_record));
+
+    if (r->magic != FITNESS_RECORD_MAGIC || record_size(r->key_len) > size - offset) return false;
+
+    return r->check == record_check(r, (const char *) map + offset + sizeof(struct fitness_record));
+}
+
+/**
+ * Find the slot of a genome, or the empty slot where it would go. The
+ * genome is given either as its key or as its tree.
+ * @param s The store.
+ * @param hash The hash of the genome.
+ * @param key, key_len The key of the genome, if `genome` is NULL.
+ * @param genome The genome, or NULL.
+ * @return The index of the slot.
+ */
+static size_t find_slot(struct fitness_store *s, uint64_t hash, const char *key, uint32_t key_len,
+                        struct node *genome) {
+    size_t mask = s->num_slots - 1;
+    size_t i = (size_t) hash & mask;
+
+    for (;; i = (i + 1) & mask) {
+        if (!s->index[i]) return i;
+
+        struct fitness_record r;
+        const char *r_key = (const char *) s->map + s->index[i] - 1 + sizeof(struct fitness_record);
+
+        memcpy(&r, s->map + s->index[i] - 1, sizeof(struct fitness_record));
+
+        if (r.hash != hash) continue;
+
+        if (genome ? tree_matches_string(genome, r_key, (int) r.key_len)
+                   : r.key_len == key_len && !memcmp(r_key, key, key_len)) {
+            return i;
+        }
+    }
+}
+
+/**
+ * Get the fitness of a genome from the records that were in the file
+ * when it was opened. Several threads may get at once.
+ * @param s The store.
+ * @param hash The hash of the genome, see hash_tree().
+ * @param genome The genome.
+ * @param fitness Set to the fitness, if the genome has a record.
+ * @return Whether the genome has a record.
+ */
+bool get_fitness_store(struct fitness_store *s, uint64_t hash, struct node *genome, double *fitness) {
+    if (!s->len) return false;
+
+    size_t i = find_slot(s, hash, NULL, 0, genome);
+
+    if (!s->index[i]) return false;
+
+    memcpy(fitness, s->map + s->index[i] - 1 + offsetof(struct fitness_record, fitness), sizeof(double));
+    ADD_RELAXED(&s->hits, 1);
+
+    return true;
+}
+
+/**
+ * Print the counters of a fitness cache file, and reset them.
+ * @param s The store.
+ */
+void print_fitness_store(struct fitness_store *s) {
+    printf("Fitness cache file: hits: %ld, records added: %ld, records loaded: %zu\n",
+           s->hits, s->added, s->len);
+
+    s->hits = s->added = 0;
+}
+
+#ifdef PONY_GP_MMAP
+/**
+ * Record that a genome is appended to the file, unless it was already.
+ * Genomes are told apart by their hash alone, so a genome whose hash
+ * collides with one appended before is not appended, which only costs
+ * its record.
+ * @param s The store.
+ * @param hash The hash of the genome.
+ * @return Whether the genome was not appended before.
+ */
+static bool mark_appended(struct fitness_store *s, uint64_t hash) {
+    bool added = false;
+
+    // 0 marks an empty slot.
+    if (!hash) hash = 1;
+
+#ifdef PONY_GP_THREADS
+    pthread_mutex_lock(&s->lock);
+#endif
+    size_t mask = s->appended_slots - 1;
+    size_t i = (size_t) hash & mask;
+
+    while (s->appended[i] && s->appended[i] != hash) i = (i + 1) & mask;
+
+    if (!s->appended[i]) {
+        // At most half of the slots are used, which keeps the probes short.
+        if (2 * (s->appended_len + 1) > s->appended_slots) {
+            size_t num_slots = 2 * s->appended_slots;
+            uint64_t *slots = allocate_m(sizeof(uint64_t) * num_slots);
+
+            for (size_t j = 0; j < num_slots; j++) slots[j] = 0;
+
+            for (size_t j = 0; j < s->appended_slots; j++) {
+                if (s->appended[j]) insert_appended(slots, num_slots, s->appended[j]);
+            }
+
+            free_pointer(s->appended);
+            s->appended = slots;
+            s->appended_slots = num_slots;
+        }
+
+        insert_appended(s->appended, s->appended_slots, hash);
+        s->appended_len++;
+        added = true;
+    }
+#ifdef PONY_GP_THREADS
+    pthread_mutex_unlock(&s->lock);
+#endif
+
+    return added;
+}
+
+/**
+ * Insert a hash that is not in a table of appended hashes.
+ */
+static void insert_appended(uint64_t *slots, size_t num_slots, uint64_t hash) {
+    size_t mask = num_slots - 1;
+    size_t i = (size_t) hash & mask;
+
+    while (slots[i]) i = (i + 1) & mask;
+
+    slots[i] = hash;
+}
+
+/**
+ * Open a fitness cache file, creating it if it does not exist, and index
+ * its records of a set of fitness cases.
+ * @param path The path of the file.
+ * @param fingerprint The fingerprint of the fitness cases.
+ * @return The store, or NULL if the file could not be opened.
+ */
+struct fitness_store *open_fitness_store(const char *path, uint64_t fingerprint) {
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    struct stat st;
+
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "Fitness cache file could not be opened.\n");
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+
+    struct fitness_store *s = allocate_m(sizeof(struct fitness_store));
+
+    s->fd = fd;
+    s->fingerprint = fingerprint;
+    s->map = NULL;
+    s->map_size = (size_t) st.st_size;
+    s->len = 0;
+    s->failed = false;
+    s->appended_slots = 16;
+    s->appended_len = 0;
+    s->appended = allocate_m(sizeof(uint64_t) * s->appended_slots);
+
+    for (size_t i = 0; i < s->appended_slots; i++) s->appended[i] = 0;
+
+#ifdef PONY_GP_THREADS
+    pthread_mutex_init(&s->lock, NULL);
+#endif
+    s->hits = s->added = 0;
+
+    if (s->map_size) {
+        void *map = mmap(NULL, s->map_size, PROT_READ, MAP_SHARED, fd, 0);
+
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "Fitness cache file could not be mapped. Its records are not used.\n");
+            s->map_size = 0;
+        } else {
+            s->map = map;
+        }
+    }
+
+    // Count the records, to size the index. A record that was only partly
+    // written is skipped a byte at a time, up to the next valid record.
+    size_t num_records = 0;
+    struct fitness_record r;
+
+    for (size_t offset = 0; offset < s->map_size;) {
+        if (!read_record(s->map, s->map_size, offset, &r)) {
+            offset++;
+            continue;
+        }
+
+        if (r.fingerprint == fingerprint) num_records++;
+
+        offset += record_size(r.key_len);
+    }
+
+    s->num_slots = 16;
+
+    while (s->num_slots < 2 * num_records) s->num_slots *= 2;
+
+    s->index = allocate_m(sizeof(size_t) * s->num_slots);
+
+    for (size_t i = 0; i < s->num_slots; i++) s->index[i] = 0;
+
+    // The first record of a genome is used. Runs that evaluated the same
+    // genome at the same time may both have added one.
+    for (size_t offset = 0; offset < s->map_size;) {
+        if (!read_record(s->map, s->map_size, offset, &r)) {
+            offset++;
+            continue;
+        }
+
+        if (r.fingerprint == fingerprint) {
+            const char *key = (const char *) s->map + offset + sizeof(struct fitness_record);
+            size_t i = find_slot(s, r.hash, key, r.key_len, NULL);
+
+            if (!s->index[i]) {
+                s->index[i] = offset + 1;
+                s->len++;
+            }
+        }
+
+        offset += record_size(r.key_len);
+    }
+
+    return s;
+}
+
+/**
+ * Close a fitness cache file and free the store.
+ * @param s The store.
+ */
+void close_fitness_store(struct fitness_store *s) {
+    if (s->map) munmap((void *) s->map, s->map_size);
+
+    close(s->fd);
+
+#ifdef PONY_GP_THREADS
+    pthread_mutex_destroy(&s->lock);
+#endif
+
+    free_pointer(s->appended);
+    free_pointer(s->index);
+    free_pointer(s);
+}
+
+/**
+ * Append a record of the fitness of a genome to the file, unless the
+ * genome had a record when the file was opened or was appended since.
+ * The record is written with one write to the end of the file, so
+ * records appended by other threads and processes at the same time do
+ * not interleave with it. The record is used by the runs that open the
+ * file later.
+ * @param s The store.
+ * @param hash The hash of the genome, see hash_tree().
+ * @param genome The genome.
+ * @param fitness The fitness of the genome.
+ */
+void put_fitness_store(struct fitness_store *s, uint64_t hash, struct node *genome, double fitness) {
+    if (LOAD_RELAXED(&s->failed)) return;
+    if (s->index[find_slot(s, hash, NULL, 0, genome)] || !mark_appended(s, hash)) return;
+
+    uint32_t key_len = (uint32_t) get_number_of_nodes(genome);
+    size_t size = record_size(key_len);
+    unsigned char *buffer = allocate_m(size);
+    struct fitness_record *r = (struct fitness_record *) buffer;
+    char *key = tree_to_string(genome);
+
+    // The padding is zeroed, so that the file does not depend on the heap.
+    memset(buffer, 0, size);
+
+    r->magic = FITNESS_RECORD_MAGIC;
+    r->key_len = key_len;
+    r->fingerprint = s->fingerprint;
+    r->hash = hash;
+    r->fitness = fitness;
+    memcpy(r + 1, key, key_len);
+    r->check = record_check(r, key);
+
+    if (write(s->fd, buffer, size) == (ssize_t) size) {
+        ADD_RELAXED(&s->added, 1);
+    } else {
+        fprintf(stderr, "Could not append to the fitness cache file. No more records are added.\n");
+        STORE_RELAXED(&s->failed, true);
+    }
+
+    free_pointer(key);
+    free_pointer(buffer);
+}
+#else
+struct fitness_store *open_fitness_store(const char *path, uint64_t fingerprint) {
+    fprintf(stderr, "Fitness cache files are not supported here.\n");
+    return NULL;
+}
+
+void close_fitness_store(struct fitness_store *s) {
+}
+
+void put_fitness_store(struct fitness_store *s, uint64_t hash, struct node *genome, double fitness) {
+}
+#endif
@@ -0,0 +1,287 @@
+// Needed for pthreads in strict C99 mode.
+#define _POSIX_C_SOURCE 200809L
+
+#include "../include/island.h"
+
+// The sending and the receiving island run in different threads, and
+// hand over the mailbox slots with LOAD_ACQUIRE and STORE_RELEASE.
+#ifdef PONY_GP_THREADS
+#include <sched.h>
+
+#define WAIT() sched_yield()
+#else
+#define WAIT() assert(!"Mailbox would wait forever.")
+#endif
+
+/**
+ * The argument of the thread that runs an island.
+ */
+struct island_thread {
+    struct archipelago *a;
+    int island;
+};
+
+static void send_migrants(struct archipelago *a, int island, int generation);
+static void receive_migrants(struct archipelago *a, int island, int generation);
+
+#ifdef PONY_GP_THREADS
+static void *island_main(void *arg);
+#endif
+
+/**
+ * Create a set of islands with empty mailboxes.
+ * @param num_islands The number of islands.
+ * @param generations The number of generations, including the initial one.
+ * @param interval The number of generations between migrations. 0 for none.
+ * @param topology RING_TOPOLOGY or RANDOM_TOPOLOGY.
+ * @return The islands.
+ */
+struct archipelago *new_archipelago(int num_islands, int generations, int interval, int topology) {
+    struct archipelago *a = allocate_m(sizeof(struct archipelago));
+
+    a->num_islands = num_islands;
+    a->interval = interval;
+    a->topology = topology;
+    a->mailboxes = allocate_m(sizeof(struct mailbox) * num_islands * num_islands);
+    a->migrations = allocate_m(sizeof(long) * num_islands);
+    a->step = NULL;
+    a->emigrate = NULL;
+    a->immigrate = NULL;
+    a->context = NULL;
+    a->generations = generations;
+
+    for (int i = 0; i < num_islands * num_islands; i++) {
+        a->mailboxes[i].head = a->mailboxes[i].tail = 0;
+    }
+
+    for (int i = 0; i < num_islands; i++) {
+        a->migrations[i] = 0;
+    }
+
+    return a;
+}
+
+/**
+ * Free the memory allocated for a set of islands. The mailboxes must be empty.
+ * @param a The islands.
+ */
+void free_archipelago(struct archipelago *a) {
+    free_pointer(a->mailboxes);
+    free_pointer(a->migrations);
+    free_pointer(a);
+}
+
+/**
+ * Run every island for a number of generations, each in its own thread
+ * where threads are supported. An island only waits for the migrants
+ * sent to it, so the islands do not run in lockstep, but every island
+ * receives the same migrants however the threads are scheduled.
+ * Without thread support the islands take turns, a generation at a time.
+ * @param a The islands.
+ * @param step Runs one generation of an island.
+ * @param emigrate Returns the migrants leaving an island.
+ * @param immigrate Adds migrants to an island.
+ * @param context The first argument of the functions.
+ */
+void run_archipelago(struct archipelago *a, island_step step, island_emigrate emigrate,
+                     island_immigrate immigrate, void *context) {
+    a->step = step;
+    a->emigrate = emigrate;
+    a->immigrate = immigrate;
+    a->context = context;
+
+#ifdef PONY_GP_THREADS
+    pthread_t *threads = allocate_m(sizeof(pthread_t) * a->num_islands);
+    struct island_thread *args = allocate_m(sizeof(struct island_thread) * a->num_islands);
+
+    for (int i = 0; i < a->num_islands; i++) {
+        args[i].a = a;
+        args[i].island = i;
+        pthread_create(&threads[i], NULL, island_main, &args[i]);
+    }
+
+    for (int i = 0; i < a->num_islands; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    free_pointer(threads);
+    free_pointer(args);
+#else
+    for (int generation = 0; generation < a->generations; generation++) {
+        for (int i = 0; i < a->num_islands; i++) step(context, i, generation);
+
+        if (!is_migration(a, generation)) continue;
+
+        // Every island sends before any island receives.
+        for (int i = 0; i < a->num_islands; i++) send_migrants(a, i, generation);
+        for (int i = 0; i < a->num_islands; i++) receive_migrants(a, i, generation);
+    }
+#endif
+}
+
+#ifdef PONY_GP_THREADS
+/**
+ * Run every generation of an island. The thread function of an island.
+ * @param arg The island_thread.
+ * @return NULL.
+ */
+static void *island_main(void *arg) {
+    struct island_thread *t = arg;
+    struct archipelago *a = t->a;
+
+    for (int generation = 0; generation < a->generations; generation++) {
+        a->step(a->context, t->island, generation);
+
+        if (is_migration(a, generation)) {
+            send_migrants(a, t->island, generation);
+            receive_migrants(a, t->island, generation);
+        }
+    }
+
+    return NULL;
+}
+#endif
+
+/**
+ * Return whether the islands exchange migrants after a generation. There
+ * is no migration after the initial or the last generation.
+ * @param a The islands.
+ * @param generation The generation.
+ */
+bool is_migration(struct archipelago *a, int generation) {
+    return a->num_islands > 1 && a->interval > 0 && generation > 0 &&
+           generation < a->generations - 1 && generation % a->interval == 0;
+}
+
+/**
+ * Send the migrants of an island.
+ * @param a The islands.
+ * @param island The sending island.
+ * @param generation The generation.
+ */
+static void send_migrants(struct archipelago *a, int island, int generation) {
+    int target = get_migration_target(a, island, generation, false);
+
+    mailbox_send(&a->mailboxes[island * a->num_islands + target], a->emigrate(a->context, island));
+    a->migrations[island]++;
+}
+
+/**
+ * Receive the migrants sent to an island, waiting for them if needed.
+ * @param a The islands.
+ * @param island The receiving island.
+ * @param generation The generation.
+ */
+static void receive_migrants(struct archipelago *a, int island, int generation) {
+    int source = get_migration_target(a, island, generation, true);
+
+    a->immigrate(a->context, island, mailbox_receive(&a->mailboxes[source * a->num_islands + island]));
+}
+
+/**
+ * Return the island that an island sends its migrants to in a migration,
+ * or the island it receives migrants from. Every island sends to exactly
+ * one island and receives from exactly one island. The random topology
+ * is the same for every island, since it only depends on the seed and
+ * the generation.
+ * @param a The islands.
+ * @param island The island.
+ * @param generation The generation of the migration.
+ * @param source Whether to return the island that sends to `island` instead.
+ * @return The island.
+ */
+int get_migration_target(struct archipelago *a, int island, int generation, bool source) {
+    int n = a->num_islands;
+    int step = source ? n - 1 : 1;
+
+    if (a->topology != RANDOM_TOPOLOGY) return (island + step) % n;
+
+    // A random cycle through all islands.
+    struct rng r;
+    int *order = allocate_m(sizeof(int) * n);
+    int position = 0;
+
+    init_rng(&r, get_rng_seed(), RNG_MIGRATION, (uint32_t) generation, 0);
+
+    for (int i = 0; i < n; i++) order[i] = i;
+
+    rng_shuffle(&r, order, n);
+
+    for (int i = 0; i < n; i++) {
+        if (order[i] == island) position = i;
+    }
+
+    int other = order[(position + step) % n];
+
+    free_pointer(order);
+
+    return other;
+}
+
+/**
+ * Add a message to a mailbox, waiting while the mailbox is full. Only
+ * one thread may send to a mailbox.
+ * @param m The mailbox.
+ * @param message The message.
+ */
+void mailbox_send(struct mailbox *m, void *message) {
+    unsigned long tail = m->tail;
+
+    while (tail - LOAD_ACQUIRE(&m->head) == MAILBOX_CAPACITY) WAIT();
+
+    m->messages[tail % MAILBOX_CAPACITY] = message;
+
+    // Publish the message after it is written.
+    STORE_RELEASE(&m->tail, tail + 1);
+}
+
+/**
+ * Take the oldest message from a mailbox, waiting while the mailbox is
+ * empty. Only one thread may receive from a mailbox.
+ * @param m The mailbox.
+ * @return The message.
+ */
+void *mailbox_receive(struct mailbox *m) {
+    unsigned long head = m->head;
+
+    while (LOAD_ACQUIRE(&m->tail) == head) WAIT();
+
+    void *message = m->messages[head % MAILBOX_CAPACITY];
+
+    // Free the slot only after the message is read.
+    STORE_RELEASE(&m->head, head + 1);
+
+    return message;
+}
+
+/**
+ * Stop other threads printing until unlock_output() is called, so that
+ * the lines printed by one island are not mixed with another's.
+ */
+void lock_output() {
+#ifdef PONY_GP_THREADS
+    flockfile(stdout);
+#endif
+}
+
+/**
+ * Let other threads print again. See lock_output().
+ */
+void unlock_output() {
+#ifdef PONY_GP_THREADS
+    funlockfile(stdout);
+#endif
+}
+
+/**
+ * Print the number of islands and the number of migrations so far.
+ * @param a The islands.
+ */
+void print_archipelago(struct archipelago *a) {
+    long migrations = 0;
+
+    for (int i = 0; i < a->num_islands; i++) migrations += a->migrations[i];
+
+    printf("Islands: %d, topology: %s, migrations: %ld\n", a->num_islands,
+           a->topology == RANDOM_TOPOLOGY ? "random" : "ring", migrations);
+}
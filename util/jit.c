@@ -0,0 +1,367 @@
+// Needed for MAP_ANONYMOUS in strict C99 mode.
+#define _DEFAULT_SOURCE
+
+#include "../include/jit.h"
+
+#ifdef PONY_GP_JIT_SUPPORTED
+#include <assert.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Slots of the constant table. Every slot holds two copies of its value,
+// one per lane. The constants of the program follow these.
+#define SLOT_ABS_MASK 0
+#define SLOT_LIMIT 1
+#define SLOT_ONE 2
+#define NUM_FIXED_SLOTS 3
+
+// The registers used as scratch space by the protected division.
+#define SCRATCH_A 14
+#define SCRATCH_B 15
+
+// An upper bound on the bytes emitted per instruction (the protected
+// division emits 53), and for the loop.
+#define MAX_INSTRUCTION_SIZE 64
+#define LOOP_SIZE 64
+
+// SSE2 opcodes (after the 0x66 prefix and 0x0F escape).
+#define SSE_MOVUPD_LOAD 0x10
+#define SSE_MOVUPD_STORE 0x11
+#define SSE_MOVAPD 0x28
+#define SSE_ANDPD 0x54
+#define SSE_ANDNPD 0x55
+#define SSE_ORPD 0x56
+#define SSE_ADDPD 0x58
+#define SSE_MULPD 0x59
+#define SSE_SUBPD 0x5C
+#define SSE_DIVPD 0x5E
+#define SSE_CMPPD 0xC2
+#define CMP_LT 1
+
+/**
+ * A buffer that machine code is written into.
+ * @field code The start of the code.
+ * @field len The number of bytes written.
+ */
+struct emitter {
+    unsigned char *code;
+    size_t len;
+};
+
+static void byte(struct emitter *e, unsigned char b) {
+    e->code[e->len++] = b;
+}
+
+static void int32(struct emitter *e, int32_t v) {
+    memcpy(e->code + e->len, &v, sizeof(v));
+    e->len += sizeof(v);
+}
+
+/**
+ * Emit a register to register SSE2 packed double operation.
+ * @param e The emitter.
+ * @param opcode The operation.
+ * @param dst, src The xmm registers.
+ */
+static void sse_reg(struct emitter *e, unsigned char opcode, int dst, int src) {
+    byte(e, 0x66);
+
+    if (dst >= 8 || src >= 8) byte(e, (unsigned char) (0x40 | (dst >= 8 ? 4 : 0) | (src >= 8 ? 1 : 0)));
+
+    byte(e, 0x0F);
+    byte(e, opcode);
+    byte(e, (unsigned char) (0xC0 | (dst & 7) << 3 | (src & 7)));
+}
+
+/**
+ * Emit an SSE2 packed double operation with a constant table slot
+ * ([r8 + 16 * slot]) as the source.
+ * @param e The emitter.
+ * @param opcode The operation.
+ * @param dst The xmm register.
+ * @param slot The constant table slot.
+ */
+static void sse_constant(struct emitter *e, unsigned char opcode, int dst, int slot) {
+    byte(e, 0x66);
+    byte(e, (unsigned char) (0x41 | (dst >= 8 ? 4 : 0)));
+    byte(e, 0x0F);
+    byte(e, opcode);
+    byte(e, (unsigned char) (0x80 | (dst & 7) << 3));
+    int32(e, 16 * slot);
+}
+
+/**
+ * Emit the instructions that push a value onto the register stack.
+ * @param e The emitter.
+ * @param in The instruction.
+ * @param dst The register at the top of the stack.
+ * @param slot The next free constant table slot.
+ */
+static void emit_push(struct emitter *e, const struct instruction *in, int dst, int *slot) {
+    if (in->opcode == OP_VAR) {
+        // mov r9, [rdi + 8 * index]
+        byte(e, 0x4C);
+        byte(e, 0x8B);
+        byte(e, 0x8F);
+        int32(e, 8 * in->index);
+
+        // movupd xmm<dst>, [r9 + rax * 8]
+        byte(e, 0x66);
+        byte(e, (unsigned char) (0x41 | (dst >= 8 ? 4 : 0)));
+        byte(e, 0x0F);
+        byte(e, SSE_MOVUPD_LOAD);
+        byte(e, (unsigned char) ((dst & 7) << 3 | 0x04));
+        byte(e, 0xC1);
+    } else {
+        sse_constant(e, SSE_MOVUPD_LOAD, dst, (*slot)++);
+    }
+}
+
+/**
+ * Emit a protected division of the register `left` by `right`. Small
+ * denominators are replaced by 1.0 with a mask, without branching.
+ * @param e The emitter.
+ * @param left The numerator and destination.
+ * @param right The denominator.
+ */
+static void emit_protected_division(struct emitter *e, int left, int right) {
+    // mask = |right| < limit
+    sse_reg(e, SSE_MOVAPD, SCRATCH_B, right);
+    sse_constant(e, SSE_ANDPD, SCRATCH_B, SLOT_ABS_MASK);
+    sse_constant(e, SSE_CMPPD, SCRATCH_B, SLOT_LIMIT);
+    byte(e, CMP_LT);
+
+    // denominator = (mask & 1.0) | (~mask & right)
+    sse_reg(e, SSE_MOVAPD, SCRATCH_A, SCRATCH_B);
+    sse_constant(e, SSE_ANDPD, SCRATCH_A, SLOT_ONE);
+    sse_reg(e, SSE_ANDNPD, SCRATCH_B, right);
+    sse_reg(e, SSE_ORPD, SCRATCH_B, SCRATCH_A);
+
+    sse_reg(e, SSE_DIVPD, left, SCRATCH_B);
+}
+
+/**
+ * Check whether native code can be generated and run on this machine.
+ * @return Whether the JIT can be used.
+ */
+bool jit_available() {
+    __builtin_cpu_init();
+
+    return __builtin_cpu_supports("sse2");
+}
+
+/**
+ * Compile a program to native x86-64 SSE2 code. The code loops over the
+ * fitness cases two at a time, keeping the whole stack in registers.
+ * @param p The program to compile.
+ * @return The compiled program, or NULL if the program is too large, or
+ *         the code could not be mapped.
+ */
+struct jit_program *jit_compile(struct program *p) {
+    if (p->max_stack > JIT_MAX_STACK || p->len > JIT_MAX_INSTRUCTIONS) return NULL;
+
+    int num_constants = 0;
+
+    for (int i = 0; i < p->len; i++) {
+        if (p->code[i].opcode == OP_CONST) num_constants++;
+    }
+
+    size_t table_size = sizeof(double) * 2 * (NUM_FIXED_SLOTS + num_constants);
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t size = table_size + LOOP_SIZE + MAX_INSTRUCTION_SIZE * (size_t) p->len;
+
+    size = (size + page - 1) / page * page;
+
+    void *buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (buffer == MAP_FAILED) return NULL;
+
+    // Fill in the constant table.
+    double *table = buffer;
+    uint64_t abs_mask = 0x7FFFFFFFFFFFFFFFULL;
+
+    memcpy(&table[2 * SLOT_ABS_MASK], &abs_mask, sizeof(double));
+    memcpy(&table[2 * SLOT_ABS_MASK + 1], &abs_mask, sizeof(double));
+    table[2 * SLOT_LIMIT] = table[2 * SLOT_LIMIT + 1] = PROTECTED_DIVISION_LIMIT;
+    table[2 * SLOT_ONE] = table[2 * SLOT_ONE + 1] = 1.0;
+
+    int slot = NUM_FIXED_SLOTS;
+
+    for (int i = 0; i < p->len; i++) {
+        if (p->code[i].opcode == OP_CONST) {
+            table[2 * slot] = table[2 * slot + 1] = p->code[i].constant;
+            slot++;
+        }
+    }
+
+    struct emitter e = {(unsigned char *) buffer + table_size, 0};
+
+    // mov rax, rdx; shl rdx, 3; sub rsi, rdx
+    // Offset `out` so that it can be indexed by the fitness case.
+    byte(&e, 0x48); byte(&e, 0x89); byte(&e, 0xD0);
+    byte(&e, 0x48); byte(&e, 0xC1); byte(&e, 0xE2); byte(&e, 0x03);
+    byte(&e, 0x48); byte(&e, 0x29); byte(&e, 0xD6);
+
+    size_t loop = e.len;
+
+    // cmp rax, rcx; jge done
+    byte(&e, 0x48); byte(&e, 0x39); byte(&e, 0xC8);
+    byte(&e, 0x0F); byte(&e, 0x8D);
+
+    size_t exit_jump = e.len;
+
+    int32(&e, 0);
+
+    int top = -1;
+    slot = NUM_FIXED_SLOTS;
+
+    for (int i = 0; i < p->len; i++) {
+        const struct instruction *in = &p->code[i];
+
+        if (in->opcode == OP_VAR || in->opcode == OP_CONST) {
+            emit_push(&e, in, ++top, &slot);
+            continue;
+        }
+
+        top--;
+
+        switch (in->opcode) {
+            case OP_ADD:
+                sse_reg(&e, SSE_ADDPD, top, top + 1);
+                break;
+            case OP_SUB:
+                sse_reg(&e, SSE_SUBPD, top, top + 1);
+                break;
+            case OP_MUL:
+                sse_reg(&e, SSE_MULPD, top, top + 1);
+                break;
+            case OP_DIV:
+                emit_protected_division(&e, top, top + 1);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // movupd [rsi + rax * 8], xmm0
+    byte(&e, 0x66); byte(&e, 0x0F); byte(&e, SSE_MOVUPD_STORE); byte(&e, 0x04); byte(&e, 0xC6);
+
+    // add rax, 2; jmp loop
+    byte(&e, 0x48); byte(&e, 0x83); byte(&e, 0xC0); byte(&e, 0x02);
+    byte(&e, 0xE9);
+    int32(&e, (int32_t) (loop - (e.len + 4)));
+
+    int32_t exit_offset = (int32_t) (e.len - (exit_jump + 4));
+
+    memcpy(e.code + exit_jump, &exit_offset, sizeof(exit_offset));
+
+    // done: ret
+    byte(&e, 0xC3);
+
+    assert(e.len <= size - table_size);
+
+    if (mprotect(buffer, size, PROT_READ | PROT_EXEC)) {
+        munmap(buffer, size);
+        return NULL;
+    }
+
+    struct jit_program *j = allocate_m(sizeof(struct jit_program));
+
+    j->constants = table;
+    j->buffer = buffer;
+    j->size = size;
+
+    // Converting an object pointer to a function pointer is not strictly
+    // C99, but is what every POSIX platform relies on for dlsym.
+    memcpy(&j->function, &e.code, sizeof(j->function));
+
+    return j;
+}
+
+/**
+ * Free a compiled program and unmap its code.
+ * @param j The compiled program.
+ */
+void jit_free(struct jit_program *j) {
+    munmap(j->buffer, j->size);
+    free_pointer(j);
+}
+
+#else
+
+bool jit_available() {
+    return false;
+}
+
+struct jit_program *jit_compile(struct program *p) {
+    (void) p;
+
+    return NULL;
+}
+
+void jit_free(struct jit_program *j) {
+    (void) j;
+}
+
+#endif
+
+/**
+ * Return the sum of the squared errors of a compiled program over a set
+ * of fitness cases. Gives the same result as program_squared_error().
+ * @param j The compiled program.
+ * @param data The fitness cases.
+ * @param limit Stop once the sum exceeds this. HUGE_VAL to evaluate every case.
+ * @param evaluated Set to the number of cases evaluated, if not NULL.
+ * @return The sum of the squared errors of the evaluated cases.
+ */
+double jit_squared_error(struct jit_program *j, struct dataset *data, double limit, int *evaluated) {
+    const struct kernels *k = get_kernels();
+
+    double *outputs = allocate_m(sizeof(double) * EVAL_BLOCK_SIZE);
+    double total = 0.0;
+    int start;
+
+    for (start = 0; start < data->len && !(total > limit); start += EVAL_BLOCK_SIZE) {
+        int n = (data->len - start < EVAL_BLOCK_SIZE) ? data->len - start : EVAL_BLOCK_SIZE;
+
+        // The columns are padded, so whole pairs can be run past the last case.
+        int width = (n + 1) / 2 * 2;
+
+        j->function(data->columns, outputs, start, start + width, j->constants);
+
+        total += k->squared_error(outputs, data->targets + start, n);
+    }
+
+    if (evaluated) *evaluated = (start < data->len) ? start : data->len;
+
+    free_pointer(outputs);
+
+    return total;
+}
+
+/**
+ * Calculate the sum of the squared errors of a compiled program for each
+ * block of a range of fitness cases. See program_block_errors().
+ * @param j The compiled program.
+ * @param data The fitness cases.
+ * @param start The first fitness case, a multiple of EVAL_BLOCK_SIZE.
+ * @param end The end of the range (exclusive), a multiple of
+ *            EVAL_BLOCK_SIZE or the number of fitness cases.
+ * @param errors Set to the sum of the squared errors of each block in the range.
+ */
+void jit_block_errors(struct jit_program *j, struct dataset *data, int start, int end, double *errors) {
+    const struct kernels *k = get_kernels();
+
+    double *outputs = allocate_m(sizeof(double) * EVAL_BLOCK_SIZE);
+
+    for (int b = 0; start < end; start += EVAL_BLOCK_SIZE, b++) {
+        int n = (end - start < EVAL_BLOCK_SIZE) ? end - start : EVAL_BLOCK_SIZE;
+        int width = (n + 1) / 2 * 2;
+
+        j->function(data->columns, outputs, start, start + width, j->constants);
+
+        errors[b] = k->squared_error(outputs, data->targets + start, n);
+    }
+
+    free_pointer(outputs);
+}
@@ -0,0 +1,461 @@
+#include "../include/kernels.h"
+
+#ifdef PONY_GP_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+// The squared error is summed in this many interleaved partial sums,
+// whatever the instruction set, so that every kernel set gives
+// bit-identical fitness values.
+#define REDUCTION_LANES 4
+
+// The same for the single precision kernels, which are twice as wide.
+#define REDUCTION_LANES_FLOAT 8
+
+static const struct kernels *active_kernels = NULL;
+
+/**
+ * Set every value of a column to a constant.
+ * @param out The column.
+ * @param value The value.
+ * @param n The length of the column.
+ */
+void fill_column(double *out, double value, int n) {
+    for (int i = 0; i < n; i++) {
+        out[i] = value;
+    }
+}
+
+/**
+ * Set every value of a single precision column to a constant.
+ * @param out The column.
+ * @param value The value.
+ * @param n The length of the column.
+ */
+void fill_column_float(float *out, float value, int n) {
+    for (int i = 0; i < n; i++) {
+        out[i] = value;
+    }
+}
+
+/**
+ * Combine the partial sums of the single precision squared error kernels.
+ */
+static double sum_lanes_float(const float *lanes) {
+    return (((double) lanes[0] + lanes[1]) + ((double) lanes[2] + lanes[3])) +
+           (((double) lanes[4] + lanes[5]) + ((double) lanes[6] + lanes[7]));
+}
+
+static void add_scalar(double *out, const double *left, const double *right, int n) {
+    for (int i = 0; i < n; i++) out[i] = left[i] + right[i];
+}
+
+static void sub_scalar(double *out, const double *left, const double *right, int n) {
+    for (int i = 0; i < n; i++) out[i] = left[i] - right[i];
+}
+
+static void mul_scalar(double *out, const double *left, const double *right, int n) {
+    for (int i = 0; i < n; i++) out[i] = left[i] * right[i];
+}
+
+static void pdiv_scalar(double *out, const double *left, const double *right, int n) {
+    for (int i = 0; i < n; i++) {
+        double denominator = right[i];
+
+        if (fabs(denominator) < PROTECTED_DIVISION_LIMIT) denominator = 1.0;
+
+        out[i] = left[i] / denominator;
+    }
+}
+
+/**
+ * Add the squared errors of the values from `start` to `n` to the lanes
+ * they belong to. Used for the tails the vector kernels do not cover.
+ */
+static void squared_error_tail(const double *outputs, const double *targets,
+                               int start, int n, double *lanes) {
+    for (int i = start; i < n; i++) {
+        double error = outputs[i] - targets[i];
+
+        lanes[i % REDUCTION_LANES] += error * error;
+    }
+}
+
+static double squared_error_scalar(const double *outputs, const double *targets, int n) {
+    double lanes[REDUCTION_LANES] = {0.0, 0.0, 0.0, 0.0};
+
+    squared_error_tail(outputs, targets, 0, n, lanes);
+
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+static void add_float_scalar(float *out, const float *left, const float *right, int n) {
+    for (int i = 0; i < n; i++) out[i] = left[i] + right[i];
+}
+
+static void sub_float_scalar(float *out, const float *left, const float *right, int n) {
+    for (int i = 0; i < n; i++) out[i] = left[i] - right[i];
+}
+
+static void mul_float_scalar(float *out, const float *left, const float *right, int n) {
+    for (int i = 0; i < n; i++) out[i] = left[i] * right[i];
+}
+
+static void pdiv_float_scalar(float *out, const float *left, const float *right, int n) {
+    for (int i = 0; i < n; i++) {
+        float denominator = right[i];
+
+        if (fabsf(denominator) < (float) PROTECTED_DIVISION_LIMIT) denominator = 1.0f;
+
+        out[i] = left[i] / denominator;
+    }
+}
+
+static void squared_error_float_tail(const float *outputs, const float *targets,
+                                     int start, int n, float *lanes) {
+    for (int i = start; i < n; i++) {
+        float error = outputs[i] - targets[i];
+
+        lanes[i % REDUCTION_LANES_FLOAT] += error * error;
+    }
+}
+
+static double squared_error_float_scalar(const float *outputs, const float *targets, int n) {
+    float lanes[REDUCTION_LANES_FLOAT] = {0.0f};
+
+    squared_error_float_tail(outputs, targets, 0, n, lanes);
+
+    return sum_lanes_float(lanes);
+}
+
+static const struct kernels scalar_kernels = {
+        "scalar", add_scalar, sub_scalar, mul_scalar, pdiv_scalar, squared_error_scalar,
+        add_float_scalar, sub_float_scalar, mul_float_scalar, pdiv_float_scalar,
+        squared_error_float_scalar
+};
+
+#ifdef PONY_GP_X86_KERNELS
+
+#define SSE2_TARGET __attribute__((target("sse2")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+SSE2_TARGET static void add_sse2(double *out, const double *left, const double *right, int n) {
+    int i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(out + i, _mm_add_pd(_mm_loadu_pd(left + i), _mm_loadu_pd(right + i)));
+    }
+
+    add_scalar(out + i, left + i, right + i, n - i);
+}
+
+SSE2_TARGET static void sub_sse2(double *out, const double *left, const double *right, int n) {
+    int i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(out + i, _mm_sub_pd(_mm_loadu_pd(left + i), _mm_loadu_pd(right + i)));
+    }
+
+    sub_scalar(out + i, left + i, right + i, n - i);
+}
+
+SSE2_TARGET static void mul_sse2(double *out, const double *left, const double *right, int n) {
+    int i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(left + i), _mm_loadu_pd(right + i)));
+    }
+
+    mul_scalar(out + i, left + i, right + i, n - i);
+}
+
+SSE2_TARGET static void pdiv_sse2(double *out, const double *left, const double *right, int n) {
+    const __m128d sign = _mm_set1_pd(-0.0);
+    const __m128d limit = _mm_set1_pd(PROTECTED_DIVISION_LIMIT);
+    const __m128d one = _mm_set1_pd(1.0);
+    int i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        __m128d denominator = _mm_loadu_pd(right + i);
+        __m128d small = _mm_cmplt_pd(_mm_andnot_pd(sign, denominator), limit);
+
+        // Replace the small denominators with 1.0 without branching.
+        denominator = _mm_or_pd(_mm_and_pd(small, one), _mm_andnot_pd(small, denominator));
+
+        _mm_storeu_pd(out + i, _mm_div_pd(_mm_loadu_pd(left + i), denominator));
+    }
+
+    pdiv_scalar(out + i, left + i, right + i, n - i);
+}
+
+SSE2_TARGET static double squared_error_sse2(const double *outputs, const double *targets, int n) {
+    __m128d low = _mm_setzero_pd();
+    __m128d high = _mm_setzero_pd();
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128d error_low = _mm_sub_pd(_mm_loadu_pd(outputs + i), _mm_loadu_pd(targets + i));
+        __m128d error_high = _mm_sub_pd(_mm_loadu_pd(outputs + i + 2), _mm_loadu_pd(targets + i + 2));
+
+        low = _mm_add_pd(low, _mm_mul_pd(error_low, error_low));
+        high = _mm_add_pd(high, _mm_mul_pd(error_high, error_high));
+    }
+
+    double lanes[REDUCTION_LANES];
+
+    _mm_storeu_pd(lanes, low);
+    _mm_storeu_pd(lanes + 2, high);
+
+    squared_error_tail(outputs, targets, i, n, lanes);
+
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+SSE2_TARGET static void add_float_sse2(float *out, const float *left, const float *right, int n) {
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(left + i), _mm_loadu_ps(right + i)));
+    }
+
+    add_float_scalar(out + i, left + i, right + i, n - i);
+}
+
+SSE2_TARGET static void sub_float_sse2(float *out, const float *left, const float *right, int n) {
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(out + i, _mm_sub_ps(_mm_loadu_ps(left + i), _mm_loadu_ps(right + i)));
+    }
+
+    sub_float_scalar(out + i, left + i, right + i, n - i);
+}
+
+SSE2_TARGET static void mul_float_sse2(float *out, const float *left, const float *right, int n) {
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(left + i), _mm_loadu_ps(right + i)));
+    }
+
+    mul_float_scalar(out + i, left + i, right + i, n - i);
+}
+
+SSE2_TARGET static void pdiv_float_sse2(float *out, const float *left, const float *right, int n) {
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 limit = _mm_set1_ps((float) PROTECTED_DIVISION_LIMIT);
+    const __m128 one = _mm_set1_ps(1.0f);
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128 denominator = _mm_loadu_ps(right + i);
+        __m128 small = _mm_cmplt_ps(_mm_andnot_ps(sign, denominator), limit);
+
+        denominator = _mm_or_ps(_mm_and_ps(small, one), _mm_andnot_ps(small, denominator));
+
+        _mm_storeu_ps(out + i, _mm_div_ps(_mm_loadu_ps(left + i), denominator));
+    }
+
+    pdiv_float_scalar(out + i, left + i, right + i, n - i);
+}
+
+SSE2_TARGET static double squared_error_float_sse2(const float *outputs, const float *targets, int n) {
+    __m128 low = _mm_setzero_ps();
+    __m128 high = _mm_setzero_ps();
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128 error_low = _mm_sub_ps(_mm_loadu_ps(outputs + i), _mm_loadu_ps(targets + i));
+        __m128 error_high = _mm_sub_ps(_mm_loadu_ps(outputs + i + 4), _mm_loadu_ps(targets + i + 4));
+
+        low = _mm_add_ps(low, _mm_mul_ps(error_low, error_low));
+        high = _mm_add_ps(high, _mm_mul_ps(error_high, error_high));
+    }
+
+    float lanes[REDUCTION_LANES_FLOAT];
+
+    _mm_storeu_ps(lanes, low);
+    _mm_storeu_ps(lanes + 4, high);
+
+    squared_error_float_tail(outputs, targets, i, n, lanes);
+
+    return sum_lanes_float(lanes);
+}
+
+static const struct kernels sse2_kernels = {
+        "sse2", add_sse2, sub_sse2, mul_sse2, pdiv_sse2, squared_error_sse2,
+        add_float_sse2, sub_float_sse2, mul_float_sse2, pdiv_float_sse2,
+        squared_error_float_sse2
+};
+
+AVX2_TARGET static void add_avx2(double *out, const double *left, const double *right, int n) {
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(left + i), _mm256_loadu_pd(right + i)));
+    }
+
+    add_scalar(out + i, left + i, right + i, n - i);
+}
+
+AVX2_TARGET static void sub_avx2(double *out, const double *left, const double *right, int n) {
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_sub_pd(_mm256_loadu_pd(left + i), _mm256_loadu_pd(right + i)));
+    }
+
+    sub_scalar(out + i, left + i, right + i, n - i);
+}
+
+AVX2_TARGET static void mul_avx2(double *out, const double *left, const double *right, int n) {
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(left + i), _mm256_loadu_pd(right + i)));
+    }
+
+    mul_scalar(out + i, left + i, right + i, n - i);
+}
+
+AVX2_TARGET static void pdiv_avx2(double *out, const double *left, const double *right, int n) {
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const __m256d limit = _mm256_set1_pd(PROTECTED_DIVISION_LIMIT);
+    const __m256d one = _mm256_set1_pd(1.0);
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m256d denominator = _mm256_loadu_pd(right + i);
+        __m256d small = _mm256_cmp_pd(_mm256_andnot_pd(sign, denominator), limit, _CMP_LT_OQ);
+
+        denominator = _mm256_blendv_pd(denominator, one, small);
+
+        _mm256_storeu_pd(out + i, _mm256_div_pd(_mm256_loadu_pd(left + i), denominator));
+    }
+
+    pdiv_scalar(out + i, left + i, right + i, n - i);
+}
+
+AVX2_TARGET static double squared_error_avx2(const double *outputs, const double *targets, int n) {
+    __m256d sum = _mm256_setzero_pd();
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m256d error = _mm256_sub_pd(_mm256_loadu_pd(outputs + i), _mm256_loadu_pd(targets + i));
+
+        sum = _mm256_add_pd(sum, _mm256_mul_pd(error, error));
+    }
+
+    double lanes[REDUCTION_LANES];
+
+    _mm256_storeu_pd(lanes, sum);
+
+    squared_error_tail(outputs, targets, i, n, lanes);
+
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+AVX2_TARGET static void add_float_avx2(float *out, const float *left, const float *right, int n) {
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(left + i), _mm256_loadu_ps(right + i)));
+    }
+
+    add_float_scalar(out + i, left + i, right + i, n - i);
+}
+
+AVX2_TARGET static void sub_float_avx2(float *out, const float *left, const float *right, int n) {
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(out + i, _mm256_sub_ps(_mm256_loadu_ps(left + i), _mm256_loadu_ps(right + i)));
+    }
+
+    sub_float_scalar(out + i, left + i, right + i, n - i);
+}
+
+AVX2_TARGET static void mul_float_avx2(float *out, const float *left, const float *right, int n) {
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(left + i), _mm256_loadu_ps(right + i)));
+    }
+
+    mul_float_scalar(out + i, left + i, right + i, n - i);
+}
+
+AVX2_TARGET static void pdiv_float_avx2(float *out, const float *left, const float *right, int n) {
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 limit = _mm256_set1_ps((float) PROTECTED_DIVISION_LIMIT);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256 denominator = _mm256_loadu_ps(right + i);
+        __m256 small = _mm256_cmp_ps(_mm256_andnot_ps(sign, denominator), limit, _CMP_LT_OQ);
+
+        denominator = _mm256_blendv_ps(denominator, one, small);
+
+        _mm256_storeu_ps(out + i, _mm256_div_ps(_mm256_loadu_ps(left + i), denominator));
+    }
+
+    pdiv_float_scalar(out + i, left + i, right + i, n - i);
+}
+
+AVX2_TARGET static double squared_error_float_avx2(const float *outputs, const float *targets, int n) {
+    __m256 sum = _mm256_setzero_ps();
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256 error = _mm256_sub_ps(_mm256_loadu_ps(outputs + i), _mm256_loadu_ps(targets + i));
+
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(error, error));
+    }
+
+    float lanes[REDUCTION_LANES_FLOAT];
+
+    _mm256_storeu_ps(lanes, sum);
+
+    squared_error_float_tail(outputs, targets, i, n, lanes);
+
+    return sum_lanes_float(lanes);
+}
+
+static const struct kernels avx2_kernels = {
+        "avx2", add_avx2, sub_avx2, mul_avx2, pdiv_avx2, squared_error_avx2,
+        add_float_avx2, sub_float_avx2, mul_float_avx2, pdiv_float_avx2,
+        squared_error_float_avx2
+};
+
+#endif
+
+/**
+ * Pick the fastest kernel set the CPU supports. Call once before
+ * evaluating any individual.
+ */
+void init_kernels() {
+    active_kernels = &scalar_kernels;
+
+#ifdef PONY_GP_X86_KERNELS
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        active_kernels = &avx2_kernels;
+    } else if (__builtin_cpu_supports("sse2")) {
+        active_kernels = &sse2_kernels;
+    }
+#endif
+
+    if (VERBOSE) printf("Evaluation kernels: %s\n", active_kernels->name);
+}
+
+/**
+ * Get the kernel set picked by init_kernels().
+ * @return The kernels.
+ */
+const struct kernels *get_kernels() {
+    if (!active_kernels) init_kernels();
+
+    return active_kernels;
+}
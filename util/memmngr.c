@@ -1,12 +1,72 @@
+// Needed for pthreads in strict C99 mode.
+#define _POSIX_C_SOURCE 200809L
+
 #include "../include/memmngr.h"
 
-static void resize_memory(size_t size, size_t new_max_size);
-static void append_memory(void *p);
+#ifdef PONY_GP_THREADS
+#include <pthread.h>
+
+// Allocations and frees may come from several threads at once.
+static pthread_mutex_t memory_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK_MEMORY() pthread_mutex_lock(&memory_lock)
+#define UNLOCK_MEMORY() pthread_mutex_unlock(&memory_lock)
+#else
+#define LOCK_MEMORY()
+#define UNLOCK_MEMORY()
+#endif
+
+// The size class of blocks too large for the pools.
+#define LARGE_BLOCK ((size_t) -1)
+// Marks a block that is allocated, in debug builds.
+#define LIVE_MAGIC 0x6c697665u
+
+/**
+ * The header in front of every block. Keeps the block aligned.
+ * @field size_class The size class of the block, or LARGE_BLOCK.
+ * @field magic LIVE_MAGIC while the block is allocated (debug builds only).
+ */
+union block_header {
+    struct {
+        size_t size_class;
+        unsigned magic;
+    } block;
+    char align[MEMORY_ALIGNMENT];
+};
+
+/**
+ * The links in front of the header of a large block. Large blocks are
+ * kept in a list so that destroy_memory() can free them.
+ * @field prev, next The neighbours in the list of large blocks.
+ */
+union large_header {
+    struct {
+        union large_header *prev, *next;
+    } links;
+    char align[MEMORY_ALIGNMENT];
+};
+
+/**
+ * A block of memory that the pools carve small blocks from.
+ * @field next The slab allocated before this one.
+ */
+union slab {
+    union slab *next;
+    char align[MEMORY_ALIGNMENT];
+};
+
+static void *allocate_small(size_t size_class);
+static void *allocate_large(size_t size);
 static void print_malloc_error(void);
 
-static void **memory;
+// The free blocks of each size class, linked through their first bytes.
+static void *free_lists[NUM_SIZE_CLASSES];
+// The slab the pools are carving blocks from, and where the next block starts.
+static union slab *slabs = NULL;
+static size_t slab_used = 0;
+static size_t slab_size;
+static union large_header *large_blocks = NULL;
 static int num_elements = 0;
-static size_t max_elements;
+static size_t num_blocks = 0;
 static bool initialized = false;
 
 /**
@@ -17,10 +77,10 @@ bool is_initialized() {
 }
 
 /**
- * Get the current max number of elements.
+ * Get the number of blocks the pools have carved, free or not.
  */
 size_t get_current_max_size() {
-    return max_elements;
+    return num_blocks;
 }
 
 /**
@@ -31,103 +91,164 @@ int get_num_elements() {
 }
 
 /**
- * Initialize the memory pool.
- * @param size The size (bytes) to allocate to the memory pool.
+ * Initialize the memory pools.
+ * @param size The size (bytes) of each slab the pools carve blocks from.
  */
 void init_memory(size_t size) {
-    memory = malloc(size * sizeof(void *));
+    size_t largest = sizeof(union block_header) + NUM_SIZE_CLASSES * MEMORY_ALIGNMENT;
 
-    if (!memory) {
-        print_malloc_error();
-    } else {
-        max_elements = size;
-        initialized = true;
-    }
-}
+    // A slab holds at least one block of every size class.
+    slab_size = size > largest + sizeof(union slab) ? size : largest + sizeof(union slab);
+    slab_used = slab_size;
 
-/**
- * Resize the memory pool size.
- * @param size The size (bytes) to reallocate to the memory pool.
- */
-static void resize_memory(size_t size, size_t new_max_size) {
-    memory = realloc(memory, size);
+    for (int i = 0; i < NUM_SIZE_CLASSES; i++) free_lists[i] = NULL;
 
-    if (!memory) {
-        fprintf(stderr, "Reallocation failed.");
-    } else {
-        max_elements = new_max_size;
-        if (VERBOSE) {
-            printf("New size: %d\n", (int)max_elements);
-        }
-    }
+    initialized = true;
 }
 
 /**
- * Allocate memory. Memory is defined with malloc then added to an array.
+ * Allocate memory. Small blocks come from the free list of their size
+ * class, larger ones from malloc.
  * @param size The size in bytes of how much memory to allocate.
  * @return If successful, return the pointer to the lowest byte in the allocated memory block.
  */
 void *allocate_m(size_t size) {
-    if (initialized) {
-        void *p = malloc(size);
-        if (!p) print_malloc_error();
-        else append_memory(p);
+    if (!initialized) {
+        printf("Memory not initialized.");
+        return NULL;
+    }
+
+    void *p;
 
-        return p;
+    LOCK_MEMORY();
 
+    if (size <= NUM_SIZE_CLASSES * MEMORY_ALIGNMENT) {
+        // Zero bytes still get a block of their own.
+        p = allocate_small(size ? (size - 1) / MEMORY_ALIGNMENT : 0);
     } else {
-        printf("Memory not initialized.");
-        return NULL;
+        p = allocate_large(size);
     }
+
+    if (p) num_elements++;
+
+    UNLOCK_MEMORY();
+
+    if (!p) print_malloc_error();
+
+    return p;
 }
 
 /**
- * Append a pointer at <num_elements> to the memory.
- * @param p The pointer to append.
+ * Take a block from the free list of a size class, or carve a new one.
+ * The lock must be held.
+ * @param size_class The size class. Holds (size_class + 1) * MEMORY_ALIGNMENT bytes.
+ * @return The block, after its header, or NULL if a slab could not be allocated.
  */
-static void append_memory(void *p) {
-    if (max_elements < num_elements) {
-        size_t max = max_elements * 2;
-        resize_memory(max * sizeof(void *), max);
+static void *allocate_small(size_t size_class) {
+    union block_header *h;
+
+    if (free_lists[size_class]) {
+        h = (union block_header *) free_lists[size_class] - 1;
+        free_lists[size_class] = *(void **) free_lists[size_class];
+    } else {
+        size_t length = sizeof(union block_header) + (size_class + 1) * MEMORY_ALIGNMENT;
+
+        if (slab_used + length > slab_size) {
+            union slab *s = malloc(slab_size);
+
+            if (!s) return NULL;
+
+            s->next = slabs;
+            slabs = s;
+            slab_used = sizeof(union slab);
+
+            if (VERBOSE) printf("New slab: %p\n", (void *) s);
+        }
+
+        h = (union block_header *) ((char *) slabs + slab_used);
+        slab_used += length;
+        num_blocks++;
     }
 
-    memory[num_elements++] = p;
+    h->block.size_class = size_class;
+#ifdef PONY_GP_MEMORY_DEBUG
+    h->block.magic = LIVE_MAGIC;
+#endif
+
+    return h + 1;
 }
 
 /**
- * Free all the memory in the memory pool.
+ * Allocate a block too large for the pools and add it to the list of
+ * large blocks. The lock must be held.
+ * @param size The size in bytes of the block.
+ * @return The block, after its header, or NULL if malloc failed.
+ */
+static void *allocate_large(size_t size) {
+    union large_header *l = malloc(sizeof(union large_header) + sizeof(union block_header) + size);
+
+    if (!l) return NULL;
+
+    l->links.prev = NULL;
+    l->links.next = large_blocks;
+    if (large_blocks) large_blocks->links.prev = l;
+    large_blocks = l;
+
+    union block_header *h = (union block_header *) (l + 1);
+
+    h->block.size_class = LARGE_BLOCK;
+#ifdef PONY_GP_MEMORY_DEBUG
+    h->block.magic = LIVE_MAGIC;
+#endif
+
+    return h + 1;
+}
+
+/**
+ * Free all the memory in the memory pools.
  */
 void free_all() {
     if (initialized) {
-        if (num_elements) {
-            for (int i = 0; i < num_elements; i++) {
-                if (VERBOSE) printf("Delete: %p\n", memory[i]);
+        // Long-lived blocks, such as the data sets and the caches, are
+        // only freed here, so blocks that are still live are not reported.
+        while (slabs) {
+            union slab *next = slabs->next;
+
+            if (VERBOSE) printf("Delete: %p\n", (void *) slabs);
 
-                free(memory[i]);
-            }
-            // Reset number of elements.
-            num_elements = 0;
+            free(slabs);
+            slabs = next;
+        }
+
+        while (large_blocks) {
+            union large_header *next = large_blocks->links.next;
+
+            if (VERBOSE) printf("Delete: %p\n", (void *) large_blocks);
 
-        } else if (VERBOSE){
-            printf("Memory pool is already empty.");
+            free(large_blocks);
+            large_blocks = next;
         }
+
+        for (int i = 0; i < NUM_SIZE_CLASSES; i++) free_lists[i] = NULL;
+
+        // Reset number of elements.
+        slab_used = slab_size;
+        num_elements = 0;
+        num_blocks = 0;
     } else {
         fprintf(stderr, "Memory not initialized.");
     }
 }
 
 /**
- * Free the memory pool.
+ * Mark the memory pools as no longer initialized.
  */
 void deinit_memory() {
-    if (initialized) {
-        free(memory);
-        initialized = false;
-    }
+    initialized = false;
 }
 
 /**
- * Deallocate all memory in the memory pool and the memory pool itself.
+ * Deallocate all memory in the memory pools and the memory pools themselves.
  */
 void destroy_memory() {
     free_all();
@@ -142,7 +263,8 @@ void print_malloc_error() {
 }
 
 /**
- * Free an allocated memory address.
+ * Free an allocated memory address. Small blocks go back to the free
+ * list of their size class, large ones to the system.
  * @param p The pointer to the memory address.
  */
 void free_pointer(void *p) {
@@ -151,19 +273,34 @@ void free_pointer(void *p) {
         return;
     }
 
-    bool found = false;
-    for (int i = 0; i < num_elements; i++) {
-        if (p == memory[i]) {
-            found = true;
-            free(memory[i]);
+    union block_header *h = (union block_header *) p - 1;
 
-            // Fill the space of the freed pointer with the last memory address in the memory pool.
-            memory[i] = memory[num_elements-1];
-            memory[num_elements-1] = NULL;
+#ifdef PONY_GP_MEMORY_DEBUG
+    // Catches double frees and pointers that were not allocated here.
+    if (h->block.magic != LIVE_MAGIC) {
+        printf("Memory address not found.\n");
+        return;
+    }
 
-            num_elements--;
-        }
+    h->block.magic = 0;
+#endif
+
+    LOCK_MEMORY();
+
+    if (h->block.size_class == LARGE_BLOCK) {
+        union large_header *l = (union large_header *) h - 1;
+
+        if (l->links.prev) l->links.prev->links.next = l->links.next;
+        else large_blocks = l->links.next;
+        if (l->links.next) l->links.next->links.prev = l->links.prev;
+
+        free(l);
+    } else {
+        *(void **) p = free_lists[h->block.size_class];
+        free_lists[h->block.size_class] = p;
     }
 
-    if (!found) printf("Memory address not found.\n");
-}
\ No newline at end of file
+    num_elements--;
+
+    UNLOCK_MEMORY();
+}
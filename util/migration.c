@@ -0,0 +1,324 @@
+// Needed for sockets and processes in strict C99 mode.
+#define _POSIX_C_SOURCE 200809L
+
+#include "../include/migration.h"
+
+#ifdef PONY_GP_PROCESSES
+static bool write_all(int fd, const void *buffer, size_t length);
+static bool read_all(int fd, void *buffer, size_t length);
+static void print_island_stats(struct message_header *header, const unsigned char *payload);
+#endif
+
+/**
+ * Get the number of bytes of the encoding of a tree. See encode_genome().
+ * @param root The root of the tree.
+ * @return The number of bytes.
+ */
+size_t get_encoded_size(struct node *root) {
+    if (!root) return 1;
+
+    if (!root->left && !root->right) return 1;
+
+    return 1 + get_encoded_size(root->left) + get_encoded_size(root->right);
+}
+
+/**
+ * Encode a tree in prefix order, one byte per node. A node with children
+ * has ENCODED_CHILDREN set on its symbol and is followed by its left and
+ * right child. A missing child is a 0 byte.
+ * @param root The root of the tree.
+ * @param buffer Space for get_encoded_size() bytes.
+ * @return The number of bytes written.
+ */
+size_t encode_genome(struct node *root, unsigned char *buffer) {
+    if (!root) {
+        buffer[0] = 0;
+        return 1;
+    }
+
+    if (!root->left && !root->right) {
+        buffer[0] = (unsigned char) root->value;
+        return 1;
+    }
+
+    buffer[0] = (unsigned char) root->value | ENCODED_CHILDREN;
+
+    size_t length = 1 + encode_genome(root->left, buffer + 1);
+
+    return length + encode_genome(root->right, buffer + length);
+}
+
+/**
+ * Decode a tree encoded by encode_genome().
+ * @param buffer The encoding. Set to the byte after it.
+ * @param end The end of the buffer.
+ * @return The tree. NULL for a missing node, or if the encoding is cut short.
+ */
+struct node *decode_genome(const unsigned char **buffer, const unsigned char *end) {
+    if (*buffer >= end) return NULL;
+
+    unsigned char code = *(*buffer)++;
+
+    if (!code) return NULL;
+
+    struct node *node = new_node((char) (code & ~ENCODED_CHILDREN));
+
+    if (code & ENCODED_CHILDREN) {
+        node->left = decode_genome(buffer, end);
+        node->right = decode_genome(buffer, end);
+
+        update_node(node);
+    }
+
+    return node;
+}
+
+#ifdef PONY_GP_PROCESSES
+/**
+ * Send a message over a socket.
+ * @param fd The socket.
+ * @param type The type of the message.
+ * @param island The island field of the header.
+ * @param generation The generation field of the header.
+ * @param payload The payload.
+ * @param length The number of bytes of the payload.
+ * @return Whether the message was sent.
+ */
+bool send_message(int fd, uint32_t type, int island, int generation, const void *payload, size_t length) {
+    struct message_header header = {type, island, generation, (uint32_t) length};
+
+    return write_all(fd, &header, sizeof(header)) && write_all(fd, payload, length);
+}
+
+/**
+ * Receive a message from a socket, waiting for it if needed.
+ * @param fd The socket.
+ * @param header Set to the header of the message.
+ * @return The payload, to be freed by the caller. NULL if the socket was
+ *         closed or failed.
+ */
+void *receive_message(int fd, struct message_header *header) {
+    if (!read_all(fd, header, sizeof(*header))) return NULL;
+
+    unsigned char *payload = allocate_m(header->length + 1);
+
+    if (!read_all(fd, payload, header->length)) {
+        free_pointer(payload);
+        return NULL;
+    }
+
+    return payload;
+}
+
+/**
+ * Run islands in separate processes, connected to this process by Unix
+ * domain sockets. Each process runs one island, and sends this process
+ * its statistics every generation, its migrants, and finally its best
+ * individual. This process prints the statistics and forwards the
+ * migrants to the island they are for. If an island process fails, the
+ * others are stopped.
+ * @param num_processes The number of processes.
+ * @param run The function run by each process.
+ * @param best_genome Set to the best genome of all islands.
+ * @param best_fitness Set to the fitness of the best genome.
+ * @return Whether every island finished.
+ */
+bool run_island_processes(int num_processes, island_process run, struct node **best_genome, double *best_fitness) {
+    int *fds = allocate_m(sizeof(int) * num_processes);
+    pid_t *pids = allocate_m(sizeof(pid_t) * num_processes);
+    bool *finished = allocate_m(sizeof(bool) * num_processes);
+    struct pollfd *polls = allocate_m(sizeof(struct pollfd) * num_processes);
+
+    // The processes start with a copy of the output buffers.
+    fflush(stdout);
+    fflush(stderr);
+
+    for (int i = 0; i < num_processes; i++) {
+        int pair[2];
+
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair)) {
+            perror("Could not create a socket");
+            abort();
+        }
+
+        pid_t pid = fork();
+
+        if (pid < 0) {
+            perror("Could not start an island process");
+            abort();
+        }
+
+        if (pid == 0) {
+            close(pair[0]);
+
+            for (int k = 0; k < i; k++) close(fds[k]);
+
+            run(i, pair[1]);
+            close(pair[1]);
+            _exit(EXIT_SUCCESS);
+        }
+
+        close(pair[1]);
+
+        fds[i] = pair[0];
+        pids[i] = pid;
+        finished[i] = false;
+        polls[i].fd = fds[i];
+        polls[i].events = POLLIN;
+    }
+
+    int running = num_processes;
+    long migrations = 0;
+    bool failed = false;
+
+    *best_genome = NULL;
+    *best_fitness = 0.0;
+
+    while (running > 0 && !failed) {
+        if (poll(polls, (nfds_t) num_processes, -1) < 0) {
+            if (errno == EINTR) continue;
+
+            perror("Could not wait for the island processes");
+            abort();
+        }
+
+        for (int i = 0; i < num_processes && !failed; i++) {
+            if (polls[i].fd < 0 || !polls[i].revents) continue;
+
+            struct message_header header;
+            unsigned char *payload = receive_message(fds[i], &header);
+
+            if (!payload) {
+                // The process closed its socket.
+                polls[i].fd = -1;
+                running--;
+
+                if (!finished[i]) {
+                    fprintf(stderr, "Island process %d stopped before it finished.\n", i);
+                    failed = true;
+                }
+
+                continue;
+            }
+
+            if (header.type == MSG_STATS && header.length >= sizeof(struct island_stats)) {
+                if (!EXPERIMENTAL_OUTPUT) print_island_stats(&header, payload);
+            } else if (header.type == MSG_MIGRANTS && header.island >= 0 && header.island < num_processes) {
+                // A process that has stopped does not need them.
+                send_message(fds[header.island], MSG_MIGRANTS, header.island, header.generation,
+                             payload, header.length);
+                migrations++;
+            } else if (header.type == MSG_BEST && header.length > sizeof(double)) {
+                double fitness;
+                const unsigned char *genome = payload + sizeof(double);
+
+                memcpy(&fitness, payload, sizeof(double));
+
+                if (!*best_genome || fitness > *best_fitness) {
+                    if (*best_genome) free_node(*best_genome);
+
+                    *best_genome = decode_genome(&genome, payload + header.length);
+                    *best_fitness = fitness;
+                }
+
+                finished[i] = true;
+            }
+
+            free_pointer(payload);
+        }
+    }
+
+    for (int i = 0; i < num_processes; i++) {
+        if (failed && polls[i].fd >= 0) kill(pids[i], SIGTERM);
+
+        close(fds[i]);
+        waitpid(pids[i], NULL, 0);
+    }
+
+    if (!EXPERIMENTAL_OUTPUT) printf("Processes: %d, migrations: %ld\n", num_processes, migrations);
+
+    free_pointer(fds);
+    free_pointer(pids);
+    free_pointer(finished);
+    free_pointer(polls);
+
+    return !failed && *best_genome;
+}
+
+/**
+ * Write a whole buffer to a socket.
+ * @return Whether the buffer was written.
+ */
+static bool write_all(int fd, const void *buffer, size_t length) {
+    const unsigned char *p = buffer;
+
+    while (length > 0) {
+        // Fail instead of being killed if the other end has closed.
+        ssize_t written = send(fd, p, length, MSG_NOSIGNAL);
+
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+
+        p += written;
+        length -= (size_t) written;
+    }
+
+    return true;
+}
+
+/**
+ * Read a whole buffer from a socket, waiting for it if needed.
+ * @return Whether the buffer was read.
+ */
+static bool read_all(int fd, void *buffer, size_t length) {
+    unsigned char *p = buffer;
+
+    while (length > 0) {
+        ssize_t received = recv(fd, p, length, 0);
+
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return false;
+
+        p += received;
+        length -= (size_t) received;
+    }
+
+    return true;
+}
+
+/**
+ * Print the statistics of a generation of an island.
+ * @param header The header of the MSG_STATS message.
+ * @param payload The payload of the message.
+ */
+static void print_island_stats(struct message_header *header, const unsigned char *payload) {
+    struct island_stats stats;
+    const unsigned char *genome = payload + sizeof(stats);
+
+    memcpy(&stats, payload, sizeof(stats));
+
+    struct node *best = decode_genome(&genome, payload + header->length);
+
+    printf("Island: %d, Generation: %d, Duration: ~%.4f, fit ave: %.2f+/-%.3f, size ave: %.2f, "
+           "max fit: %f, best solution: Genome: {",
+           header->island, header->generation, stats.duration, stats.fitness_average, stats.fitness_std,
+           stats.size_average, stats.best_fitness);
+    print_infix(best);
+    printf("}, Fitness: %.4f\n", stats.best_fitness);
+
+    if (best) free_node(best);
+}
+#else
+bool send_message(int fd, uint32_t type, int island, int generation, const void *payload, size_t length) {
+    return false;
+}
+
+void *receive_message(int fd, struct message_header *header) {
+    return NULL;
+}
+
+bool run_island_processes(int num_processes, island_process run, struct node **best_genome, double *best_fitness) {
+    fprintf(stderr, "Island processes are not supported here.\n");
+    return false;
+}
+#endif
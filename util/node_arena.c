@@ -0,0 +1,132 @@
+// Needed for pthreads in strict C99 mode.
+#define _POSIX_C_SOURCE 200809L
+
+#include "../include/node_arena.h"
+
+#ifdef PONY_GP_THREADS
+// Arenas are created by several threads at once.
+static pthread_mutex_t id_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static unsigned long next_arena_id = 1;
+
+// The arena new_node() allocates from in the calling thread, or NULL.
+static THREAD_LOCAL struct node_arena *current_arena = NULL;
+// The rest of the chunk the calling thread took from an arena, and the id
+// of that arena, so that chunks of a freed arena are not used.
+static THREAD_LOCAL unsigned long chunk_arena_id = 0;
+static THREAD_LOCAL struct node *chunk_next = NULL;
+static THREAD_LOCAL struct node *chunk_end = NULL;
+
+/**
+ * Create an empty node arena.
+ * @return The arena.
+ */
+struct node_arena *new_node_arena() {
+    struct node_arena *arena = allocate_m(sizeof(struct node_arena));
+
+#ifdef PONY_GP_THREADS
+    pthread_mutex_lock(&id_lock);
+#endif
+    arena->id = next_arena_id++;
+#ifdef PONY_GP_THREADS
+    pthread_mutex_unlock(&id_lock);
+
+    pthread_mutex_init(&arena->lock, NULL);
+#endif
+
+    arena->chunks = NULL;
+
+    return arena;
+}
+
+/**
+ * Free an arena and every node allocated from it. No thread may use
+ * the arena afterwards.
+ * @param arena The arena.
+ */
+void free_node_arena(struct node_arena *arena) {
+    while (arena->chunks) {
+        struct arena_chunk *next = arena->chunks->next;
+
+        free_pointer(arena->chunks);
+        arena->chunks = next;
+    }
+
+#ifdef PONY_GP_THREADS
+    pthread_mutex_destroy(&arena->lock);
+#endif
+
+    free_pointer(arena);
+}
+
+/**
+ * Set the arena that new_node() allocates from in the calling thread.
+ * @param arena The arena, or NULL to allocate nodes on the heap.
+ * @return The arena used before.
+ */
+struct node_arena *use_node_arena(struct node_arena *arena) {
+    struct node_arena *previous = current_arena;
+
+    current_arena = arena;
+
+    return previous;
+}
+
+/**
+ * Get whether new_node() allocates from an arena in the calling thread.
+ */
+bool is_node_arena_used() {
+    return current_arena != NULL;
+}
+
+/**
+ * Allocate a node from the arena of the calling thread, taking a new
+ * chunk from the arena when the thread's chunk is used up.
+ * @return The node, with `in_arena` set, or NULL if the thread has no arena.
+ */
+struct node *allocate_arena_node() {
+    struct node_arena *arena = current_arena;
+
+    if (!arena) return NULL;
+
+    if (chunk_arena_id != arena->id || chunk_next == chunk_end) {
+        struct arena_chunk *chunk = allocate_m(sizeof(struct arena_chunk));
+
+#ifdef PONY_GP_THREADS
+        pthread_mutex_lock(&arena->lock);
+#endif
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+#ifdef PONY_GP_THREADS
+        pthread_mutex_unlock(&arena->lock);
+#endif
+
+        chunk_arena_id = arena->id;
+        chunk_next = chunk->nodes;
+        chunk_end = chunk->nodes + ARENA_CHUNK_NODES;
+    }
+
+    struct node *node = chunk_next++;
+
+    node->in_arena = true;
+
+    return node;
+}
+
+/**
+ * Copy a tree into an arena, in depth-first order so that a traversal
+ * reads its nodes one after another, and free the tree's heap nodes.
+ * @param root The tree.
+ * @param arena The arena.
+ * @return The copy.
+ */
+struct node *compact_tree(struct node *root, struct node_arena *arena) {
+    struct node_arena *previous = use_node_arena(arena);
+    struct node *copy = tree_deep_copy(root);
+
+    use_node_arena(previous);
+    free_node(root);
+
+    return copy;
+}
@@ -0,0 +1,180 @@
+#include "../include/prefix_genome.h"
+
+static struct prefix_genome *allocate_prefix_genome(int len);
+static int flatten_genome(struct prefix_genome *g, struct node *node, int depth, int *pos);
+static struct node *build_tree(const struct prefix_genome *g, int i);
+
+/**
+ * Allocate a prefix genome, with its arrays in the same block.
+ * @param len The number of symbols.
+ * @return The genome, with only `len` set.
+ */
+static struct prefix_genome *allocate_prefix_genome(int len) {
+    size_t ints = sizeof(int) * (size_t) len;
+    struct prefix_genome *g = allocate_m(sizeof(struct prefix_genome) + 2 * ints + (size_t) len + 1);
+
+    g->len = len;
+    g->sizes = (int *) (g + 1);
+    g->depths = g->sizes + len;
+    g->symbols = (char *) (g->depths + len);
+    g->symbols[len] = '\0';
+
+    return g;
+}
+
+/**
+ * Flatten a tree into a prefix genome.
+ * @param root The root of the tree.
+ * @return The genome.
+ */
+struct prefix_genome *new_prefix_genome(struct node *root) {
+    struct prefix_genome *g = allocate_prefix_genome(get_number_of_nodes(root));
+    int pos = 0;
+
+    if (root) flatten_genome(g, root, 0, &pos);
+
+    return g;
+}
+
+/**
+ * Write a subtree into a prefix genome.
+ * @param g The genome.
+ * @param node The root of the subtree.
+ * @param depth The depth of the root.
+ * @param pos The index to write the root at. Set to the index after the subtree.
+ * @return The size of the subtree.
+ */
+static int flatten_genome(struct prefix_genome *g, struct node *node, int depth, int *pos) {
+    int i = (*pos)++;
+
+    g->symbols[i] = node->value;
+    g->depths[i] = depth;
+    g->sizes[i] = 1;
+
+    if (node->left) g->sizes[i] += flatten_genome(g, node->left, depth + 1, pos);
+    if (node->right) g->sizes[i] += flatten_genome(g, node->right, depth + 1, pos);
+
+    return g->sizes[i];
+}
+
+/**
+ * Return a copy of a prefix genome.
+ * @param g The genome.
+ * @return The copy.
+ */
+struct prefix_genome *copy_prefix_genome(const struct prefix_genome *g) {
+    struct prefix_genome *copy = allocate_prefix_genome(g->len);
+
+    memcpy(copy->sizes, g->sizes, sizeof(int) * (size_t) g->len);
+    memcpy(copy->depths, g->depths, sizeof(int) * (size_t) g->len);
+    memcpy(copy->symbols, g->symbols, (size_t) g->len);
+
+    return copy;
+}
+
+/**
+ * Free a prefix genome.
+ * @param g The genome.
+ */
+void free_prefix_genome(struct prefix_genome *g) {
+    free_pointer(g);
+}
+
+/**
+ * Return the string of a prefix genome, the same as tree_to_string() of its tree.
+ * @param g The genome.
+ * @return The string.
+ */
+char *prefix_genome_to_string(const struct prefix_genome *g) {
+    char *str = allocate_m((size_t) g->len + 1);
+
+    memcpy(str, g->symbols, (size_t) g->len + 1);
+
+    return str;
+}
+
+/**
+ * Build the tree of a prefix genome, in depth-first order.
+ * @param g The genome.
+ * @return The tree, or NULL if the genome is empty.
+ */
+struct node *prefix_genome_to_tree(const struct prefix_genome *g) {
+    return g->len ? build_tree(g, 0) : NULL;
+}
+
+/**
+ * Build the subtree at an index of a prefix genome.
+ * @param g The genome.
+ * @param i The index.
+ * @return The subtree.
+ */
+static struct node *build_tree(const struct prefix_genome *g, int i) {
+    struct node *node = new_node(g->symbols[i]);
+
+    if (g->sizes[i] > 1) {
+        int right = i + 1 + g->sizes[i + 1];
+
+        node->left = build_tree(g, i + 1);
+        if (right < i + g->sizes[i]) node->right = build_tree(g, right);
+
+        update_node(node);
+    }
+
+    return node;
+}
+
+/**
+ * Get the depth of the subtree at an index, as get_max_tree_depth() would.
+ * @param g The genome.
+ * @param i The index.
+ * @return The depth of the subtree.
+ */
+int get_prefix_subtree_depth(const struct prefix_genome *g, int i) {
+    int max_depth = g->depths[i];
+
+    for (int k = i + 1; k < i + g->sizes[i]; k++) {
+        if (g->depths[k] > max_depth) max_depth = g->depths[k];
+    }
+
+    return max_depth - g->depths[i];
+}
+
+/**
+ * Return a genome with the subtree at an index replaced by a subtree of
+ * another genome. The symbols are copied in three runs, and only the
+ * sizes of the replaced subtree's ancestors are recomputed.
+ * @param g The genome.
+ * @param i The index of the subtree to replace.
+ * @param donor The genome to take the new subtree from.
+ * @param j The index of the new subtree in the donor.
+ * @return The new genome.
+ */
+struct prefix_genome *splice_prefix_genome(const struct prefix_genome *g, int i,
+                                           const struct prefix_genome *donor, int j) {
+    int removed = g->sizes[i];
+    int inserted = donor->sizes[j];
+    int tail = g->len - i - removed;
+    struct prefix_genome *s = allocate_prefix_genome(g->len - removed + inserted);
+
+    memcpy(s->symbols, g->symbols, (size_t) i);
+    memcpy(s->symbols + i, donor->symbols + j, (size_t) inserted);
+    memcpy(s->symbols + i + inserted, g->symbols + i + removed, (size_t) tail);
+
+    memcpy(s->sizes, g->sizes, sizeof(int) * (size_t) i);
+    memcpy(s->sizes + i, donor->sizes + j, sizeof(int) * (size_t) inserted);
+    memcpy(s->sizes + i + inserted, g->sizes + i + removed, sizeof(int) * (size_t) tail);
+
+    memcpy(s->depths, g->depths, sizeof(int) * (size_t) i);
+    memcpy(s->depths + i + inserted, g->depths + i + removed, sizeof(int) * (size_t) tail);
+
+    int shift = g->depths[i] - donor->depths[j];
+
+    for (int k = 0; k < inserted; k++) s->depths[i + k] = donor->depths[j + k] + shift;
+
+    // The subtrees before `i` that extend past it are its ancestors.
+    for (int k = 0; k < i; k++) {
+        if (k + g->sizes[k] > i) s->sizes[k] += inserted - removed;
+    }
+
+    return s;
+}
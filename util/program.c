@@ -0,0 +1,531 @@
+#include "../include/program.h"
+#include "../include/kernels.h"
+
+static void emit_node(struct program *p, struct node *node, int *depth);
+static void emit(struct program *p, unsigned char opcode, int index, double constant, int stack_change, int *depth);
+static void simplify(struct program *p, int left, int right, int *depth);
+static double apply_operator(unsigned char opcode, double left, double right);
+static bool is_constant(struct program *p, int start, int end, double value);
+
+/**
+ * Compile a tree into a postfix program. The tree is walked once, so
+ * the program can then be run on every fitness case without touching
+ * the tree again. Subtrees without variables are folded into a single
+ * constant, and operations with an identity operand (x*1, x/1, x+0, ...)
+ * are dropped. Only rewrites that give the same value for every input
+ * are made, so the program gives exactly the same outputs as the tree.
+ * @param root The root of the tree.
+ * @return The compiled program.
+ */
+struct program *compile_program(struct node *root) {
+    struct program *p = allocate_m(sizeof(struct program));
+
+    // A missing child still pushes a value, so leave room for one extra
+    // instruction per node.
+    p->code = allocate_m(sizeof(struct instruction) * (2 * get_number_of_nodes(root) + 1));
+    p->len = 0;
+    p->max_stack = 0;
+
+    int depth = 0;
+
+    emit_node(p, root, &depth);
+
+    assert(depth == 1);
+
+    // Simplification may have lowered the largest stack depth.
+    p->max_stack = depth = 0;
+
+    for (int i = 0; i < p->len; i++) {
+        depth += (p->code[i].opcode == OP_CONST || p->code[i].opcode == OP_VAR) ? 1 : -1;
+
+        if (depth > p->max_stack) p->max_stack = depth;
+    }
+
+    return p;
+}
+
+/**
+ * Emit the instructions of a node after the instructions of its children.
+ * @param p The program to append to.
+ * @param node The node to emit.
+ * @param depth The current stack depth.
+ */
+static void emit_node(struct program *p, struct node *node, int *depth) {
+    if (!node) {
+        emit(p, OP_CONST, 0, MISSING_NODE_VALUE, 1, depth);
+        return;
+    }
+
+    char symbol = node->value;
+
+    if (symbol == '+' || symbol == '-' || symbol == '*' || symbol == '/') {
+        int left = p->len;
+
+        emit_node(p, node->left, depth);
+
+        int right = p->len;
+
+        emit_node(p, node->right, depth);
+
+        unsigned char opcode;
+
+        if (symbol == '+') opcode = OP_ADD;
+        else if (symbol == '-') opcode = OP_SUB;
+        else if (symbol == '*') opcode = OP_MUL;
+        else opcode = OP_DIV;
+
+        emit(p, opcode, 0, 0.0, -1, depth);
+        simplify(p, left, right, depth);
+    } else if (isalpha(symbol)) {
+        // Fitness case variables must be in alphabetical order
+        // for this to work correctly.
+        int index = symbol - (islower(symbol) ? 'a' : 'A');
+
+        emit(p, OP_VAR, index, 0.0, 1, depth);
+    } else {
+        emit(p, OP_CONST, 0, (double) (symbol - '0'), 1, depth);
+    }
+}
+
+/**
+ * Append an instruction to a program and track the stack depth.
+ * @param p The program to append to.
+ * @param opcode The operation.
+ * @param index The column index (OP_VAR only).
+ * @param constant The constant value (OP_CONST only).
+ * @param stack_change The number of values the instruction adds to the stack.
+ * @param depth The current stack depth.
+ */
+static void emit(struct program *p, unsigned char opcode, int index, double constant,
+                 int stack_change, int *depth) {
+    struct instruction *in = &p->code[p->len++];
+
+    in->opcode = opcode;
+    in->index = index;
+    in->constant = constant;
+
+    *depth += stack_change;
+
+    if (*depth > p->max_stack) p->max_stack = *depth;
+}
+
+/**
+ * Simplify the operation just appended to a program, given where the
+ * instructions of its operands start.
+ * @param p The program.
+ * @param left The index of the first instruction of the left operand.
+ * @param right The index of the first instruction of the right operand.
+ * @param depth The current stack depth.
+ */
+static void simplify(struct program *p, int left, int right, int *depth) {
+    int op = p->len - 1;
+    unsigned char opcode = p->code[op].opcode;
+
+    bool left_constant = (right - left == 1 && p->code[left].opcode == OP_CONST);
+    bool right_constant = (op - right == 1 && p->code[right].opcode == OP_CONST);
+
+    if (left_constant && right_constant) {
+        // Compute the value once instead of once per fitness case.
+        double value = apply_operator(opcode, p->code[left].constant, p->code[right].constant);
+
+        // Both operands and the operation are replaced by one constant,
+        // which leaves the stack as deep as before.
+        p->len = left;
+        *depth -= 1;
+        emit(p, OP_CONST, 0, value, 1, depth);
+        return;
+    }
+
+    // x * 1, x / 1, x + 0 and x - 0. A protected division by a denominator
+    // smaller than the limit is a division by 1.
+    if (right_constant) {
+        double c = p->code[right].constant;
+
+        if (((opcode == OP_MUL || opcode == OP_DIV) && c == 1.0) ||
+            (opcode == OP_DIV && fabs(c) < PROTECTED_DIVISION_LIMIT) ||
+            ((opcode == OP_ADD || opcode == OP_SUB) && c == 0.0)) {
+            p->len = right;
+            return;
+        }
+    }
+
+    // 1 * x and 0 + x. Move the right operand over the left one.
+    if ((opcode == OP_MUL && is_constant(p, left, right, 1.0)) ||
+        (opcode == OP_ADD && is_constant(p, left, right, 0.0))) {
+        memmove(p->code + left, p->code + right, sizeof(struct instruction) * (op - right));
+
+        p->len = left + (op - right);
+    }
+}
+
+/**
+ * Return whether the instructions from `start` to `end` push a single
+ * constant with the given value.
+ */
+static bool is_constant(struct program *p, int start, int end, double value) {
+    return end - start == 1 && p->code[start].opcode == OP_CONST && p->code[start].constant == value;
+}
+
+/**
+ * Apply a binary operation to two values, the same way the evaluation
+ * kernels do.
+ * @param opcode The operation.
+ * @param left, right The operands.
+ * @return The result.
+ */
+static double apply_operator(unsigned char opcode, double left, double right) {
+    switch (opcode) {
+        case OP_ADD:
+            return left + right;
+        case OP_SUB:
+            return left - right;
+        case OP_MUL:
+            return left * right;
+        default:
+            if (fabs(right) < PROTECTED_DIVISION_LIMIT) right = 1.0;
+
+            return left / right;
+    }
+}
+
+/**
+ * Free the memory allocated for a program.
+ * @param p The program to free.
+ */
+void free_program(struct program *p) {
+    free_pointer(p->code);
+    free_pointer(p);
+}
+
+/**
+ * Run a program on a single fitness case.
+ * @param p The program to run.
+ * @param fitness_case Data to input into variables (defined in csv file).
+ * @param stack Scratch space for at least `p->max_stack` values.
+ * @return The value of the program on the given data.
+ */
+double run_program(struct program *p, const double *fitness_case, double *stack) {
+    const struct instruction *in = p->code;
+    const struct instruction *end = p->code + p->len;
+    double *top = stack - 1;
+
+    for (; in < end; in++) {
+        switch (in->opcode) {
+            case OP_CONST:
+                *++top = in->constant;
+                break;
+            case OP_VAR:
+                *++top = fitness_case[in->index];
+                break;
+            case OP_ADD:
+                top--;
+                *top = *top + top[1];
+                break;
+            case OP_SUB:
+                top--;
+                *top = *top - top[1];
+                break;
+            case OP_MUL:
+                top--;
+                *top = *top * top[1];
+                break;
+            case OP_DIV: {
+                double denominator = *top--;
+
+                if (fabs(denominator) < PROTECTED_DIVISION_LIMIT) {
+                    denominator = 1.0;
+                }
+
+                *top = *top / denominator;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    return stack[0];
+}
+
+/**
+ * Run a program on a block of fitness cases, one instruction at a time
+ * over the whole block. Variables are read straight from the columns.
+ * @param p The program to run.
+ * @param data The fitness cases.
+ * @param start The first fitness case of the block.
+ * @param n The number of fitness cases in the block, at most EVAL_BLOCK_SIZE.
+ * @param scratch Scratch space for `p->max_stack * EVAL_BLOCK_SIZE` values.
+ * @param stack Scratch space for `p->max_stack` pointers.
+ * @return The outputs of the program for the block.
+ */
+const double *run_program_block(struct program *p, struct dataset *data, int start, int n,
+                                double *scratch, const double **stack) {
+    const struct kernels *k = get_kernels();
+    int top = -1;
+
+    // The columns are padded, so run whole vectors past the last case.
+    int width = n;
+
+    if (start + n == data->len) {
+        width = ((n + DATASET_PADDING - 1) / DATASET_PADDING) * DATASET_PADDING;
+    }
+
+    for (int i = 0; i < p->len; i++) {
+        const struct instruction *in = &p->code[i];
+
+        if (in->opcode == OP_VAR) {
+            stack[++top] = data->columns[in->index] + start;
+            continue;
+        }
+
+        if (in->opcode == OP_CONST) {
+            double *slot = scratch + (++top) * EVAL_BLOCK_SIZE;
+
+            fill_column(slot, in->constant, width);
+            stack[top] = slot;
+            continue;
+        }
+
+        // Write the result over the left operand's slot.
+        double *out = scratch + (--top) * EVAL_BLOCK_SIZE;
+
+        switch (in->opcode) {
+            case OP_ADD:
+                k->add(out, stack[top], stack[top + 1], width);
+                break;
+            case OP_SUB:
+                k->sub(out, stack[top], stack[top + 1], width);
+                break;
+            case OP_MUL:
+                k->mul(out, stack[top], stack[top + 1], width);
+                break;
+            case OP_DIV:
+                k->pdiv(out, stack[top], stack[top + 1], width);
+                break;
+            default:
+                break;
+        }
+
+        stack[top] = out;
+    }
+
+    return stack[0];
+}
+
+/**
+ * Return the sum of the squared errors of a program over a set of
+ * fitness cases. The cases are evaluated a block at a time. Evaluation
+ * stops early once the sum exceeds `limit`, since the errors of the
+ * remaining cases can only make it larger.
+ * @param p The program to run.
+ * @param data The fitness cases.
+ * @param limit Stop once the sum exceeds this. HUGE_VAL to evaluate every case.
+ * @param evaluated Set to the number of cases evaluated, if not NULL.
+ * @return The sum of the squared errors of the evaluated cases.
+ */
+double program_squared_error(struct program *p, struct dataset *data, double limit, int *evaluated) {
+    const struct kernels *k = get_kernels();
+
+    double *scratch = allocate_m(sizeof(double) * p->max_stack * EVAL_BLOCK_SIZE);
+    const double **stack = allocate_m(sizeof(double *) * p->max_stack);
+
+    double total = 0.0;
+    int start;
+
+    for (start = 0; start < data->len && !(total > limit); start += EVAL_BLOCK_SIZE) {
+        int n = (data->len - start < EVAL_BLOCK_SIZE) ? data->len - start : EVAL_BLOCK_SIZE;
+
+        const double *outputs = run_program_block(p, data, start, n, scratch, stack);
+
+        total += k->squared_error(outputs, data->targets + start, n);
+    }
+
+    if (evaluated) *evaluated = (start < data->len) ? start : data->len;
+
+    free_pointer(scratch);
+    free_pointer(stack);
+
+    return total;
+}
+
+/**
+ * Run a program on a block of fitness cases in single precision.
+ * See run_program_block().
+ * @param p The program to run.
+ * @param data The fitness cases.
+ * @param start The first fitness case of the block.
+ * @param n The number of fitness cases in the block, at most EVAL_BLOCK_SIZE.
+ * @param scratch Scratch space for `p->max_stack * EVAL_BLOCK_SIZE` values.
+ * @param stack Scratch space for `p->max_stack` pointers.
+ * @return The outputs of the program for the block.
+ */
+const float *run_program_block_float(struct program *p, struct float_dataset *data, int start, int n,
+                                     float *scratch, const float **stack) {
+    const struct kernels *k = get_kernels();
+    int top = -1;
+
+    int width = n;
+
+    if (start + n == data->len) {
+        width = ((n + FLOAT_DATASET_PADDING - 1) / FLOAT_DATASET_PADDING) * FLOAT_DATASET_PADDING;
+    }
+
+    for (int i = 0; i < p->len; i++) {
+        const struct instruction *in = &p->code[i];
+
+        if (in->opcode == OP_VAR) {
+            stack[++top] = data->columns[in->index] + start;
+            continue;
+        }
+
+        if (in->opcode == OP_CONST) {
+            float *slot = scratch + (++top) * EVAL_BLOCK_SIZE;
+
+            // A missing child would round to -inf.
+            float constant = (in->constant == MISSING_NODE_VALUE) ? -FLT_MAX : (float) in->constant;
+
+            fill_column_float(slot, constant, width);
+            stack[top] = slot;
+            continue;
+        }
+
+        float *out = scratch + (--top) * EVAL_BLOCK_SIZE;
+
+        switch (in->opcode) {
+            case OP_ADD:
+                k->add_float(out, stack[top], stack[top + 1], width);
+                break;
+            case OP_SUB:
+                k->sub_float(out, stack[top], stack[top + 1], width);
+                break;
+            case OP_MUL:
+                k->mul_float(out, stack[top], stack[top + 1], width);
+                break;
+            case OP_DIV:
+                k->pdiv_float(out, stack[top], stack[top + 1], width);
+                break;
+            default:
+                break;
+        }
+
+        stack[top] = out;
+    }
+
+    return stack[0];
+}
+
+/**
+ * Return the sum of the squared errors of a program over a set of
+ * fitness cases, evaluated in single precision. The sum of each block
+ * is added in double precision. See program_squared_error().
+ * @param p The program to run.
+ * @param data The fitness cases.
+ * @param limit Stop once the sum exceeds this. HUGE_VAL to evaluate every case.
+ * @param evaluated Set to the number of cases evaluated, if not NULL.
+ * @return The sum of the squared errors of the evaluated cases.
+ */
+double program_squared_error_float(struct program *p, struct float_dataset *data, double limit, int *evaluated) {
+    const struct kernels *k = get_kernels();
+
+    float *scratch = allocate_m(sizeof(float) * p->max_stack * EVAL_BLOCK_SIZE);
+    const float **stack = allocate_m(sizeof(float *) * p->max_stack);
+
+    double total = 0.0;
+    int start;
+
+    for (start = 0; start < data->len && !(total > limit); start += EVAL_BLOCK_SIZE) {
+        int n = (data->len - start < EVAL_BLOCK_SIZE) ? data->len - start : EVAL_BLOCK_SIZE;
+
+        const float *outputs = run_program_block_float(p, data, start, n, scratch, stack);
+
+        total += k->squared_error_float(outputs, data->targets + start, n);
+    }
+
+    if (evaluated) *evaluated = (start < data->len) ? start : data->len;
+
+    free_pointer(scratch);
+    free_pointer(stack);
+
+    return total;
+}
+
+/**
+ * Calculate the sum of the squared errors of a program for each block of
+ * a range of fitness cases. The blocks are the same as in
+ * program_squared_error(), so sum_block_errors() gives the same result.
+ * Ranges that do not overlap can be evaluated by different threads.
+ * @param p The program to run.
+ * @param data The fitness cases.
+ * @param start The first fitness case, a multiple of EVAL_BLOCK_SIZE.
+ * @param end The end of the range (exclusive), a multiple of
+ *            EVAL_BLOCK_SIZE or the number of fitness cases.
+ * @param errors Set to the sum of the squared errors of each block in the range.
+ */
+void program_block_errors(struct program *p, struct dataset *data, int start, int end, double *errors) {
+    const struct kernels *k = get_kernels();
+
+    double *scratch = allocate_m(sizeof(double) * p->max_stack * EVAL_BLOCK_SIZE);
+    const double **stack = allocate_m(sizeof(double *) * p->max_stack);
+
+    for (int b = 0; start < end; start += EVAL_BLOCK_SIZE, b++) {
+        int n = (end - start < EVAL_BLOCK_SIZE) ? end - start : EVAL_BLOCK_SIZE;
+
+        const double *outputs = run_program_block(p, data, start, n, scratch, stack);
+
+        errors[b] = k->squared_error(outputs, data->targets + start, n);
+    }
+
+    free_pointer(scratch);
+    free_pointer(stack);
+}
+
+/**
+ * Calculate the sum of the squared errors of a program for each block of
+ * a range of fitness cases, in single precision. See program_block_errors().
+ * @param p The program to run.
+ * @param data The fitness cases.
+ * @param start The first fitness case, a multiple of EVAL_BLOCK_SIZE.
+ * @param end The end of the range (exclusive), a multiple of
+ *            EVAL_BLOCK_SIZE or the number of fitness cases.
+ * @param errors Set to the sum of the squared errors of each block in the range.
+ */
+void program_block_errors_float(struct program *p, struct float_dataset *data, int start, int end, double *errors) {
+    const struct kernels *k = get_kernels();
+
+    float *scratch = allocate_m(sizeof(float) * p->max_stack * EVAL_BLOCK_SIZE);
+    const float **stack = allocate_m(sizeof(float *) * p->max_stack);
+
+    for (int b = 0; start < end; start += EVAL_BLOCK_SIZE, b++) {
+        int n = (end - start < EVAL_BLOCK_SIZE) ? end - start : EVAL_BLOCK_SIZE;
+
+        const float *outputs = run_program_block_float(p, data, start, n, scratch, stack);
+
+        errors[b] = k->squared_error_float(outputs, data->targets + start, n);
+    }
+
+    free_pointer(scratch);
+    free_pointer(stack);
+}
+
+/**
+ * Add up the squared errors of the blocks of a set of fitness cases in
+ * order, stopping once the sum exceeds `limit`, as program_squared_error()
+ * does.
+ * @param errors The sum of the squared errors of each block.
+ * @param len The number of fitness cases.
+ * @param limit Stop once the sum exceeds this. HUGE_VAL to add every block.
+ * @param evaluated Set to the number of cases added, if not NULL.
+ * @return The sum of the squared errors of the added cases.
+ */
+double sum_block_errors(const double *errors, int len, double limit, int *evaluated) {
+    double total = 0.0;
+    int start;
+
+    for (start = 0; start < len && !(total > limit); start += EVAL_BLOCK_SIZE) {
+        total += errors[start / EVAL_BLOCK_SIZE];
+    }
+
+    if (evaluated) *evaluated = (start < len) ? start : len;
+
+    return total;
+}
@@ -1,37 +1,222 @@
 #include "../include/rand_util.h"
 
+// Philox4x32 multipliers and Weyl sequence constants (Salmon et al., 2011).
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+// The seed of the run, and the stream used by the functions that do not
+// take a stream. Each thread has its own stream, and its own island.
+static uint64_t run_seed = 0;
+static THREAD_LOCAL struct rng current_rng;
+static THREAD_LOCAL uint32_t current_island = 0;
+
 /**
- * A wrapper for srand. Ensures that it is only called once per execution.
+ * Compute one block of the Philox4x32-10 generator.
+ * @param counter The counter.
+ * @param key The key.
+ * @param out Set to four random words.
  */
-void start_srand() {
-    // In order for the other random functions to work as expected,
-    // this must be called exactly once per execution. This is because
-    // srand will return different results only if it is called once.
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]) {
+    uint32_t c[4] = {counter[0], counter[1], counter[2], counter[3]};
+    uint32_t k[2] = {key[0], key[1]};
+
+    for (int round = 0; round < PHILOX_ROUNDS; round++) {
+        uint64_t product0 = (uint64_t) PHILOX_M0 * c[0];
+        uint64_t product1 = (uint64_t) PHILOX_M1 * c[2];
+
+        uint32_t next[4] = {
+                (uint32_t) (product1 >> 32) ^ c[1] ^ k[0], (uint32_t) product1,
+                (uint32_t) (product0 >> 32) ^ c[3] ^ k[1], (uint32_t) product0
+        };
+
+        c[0] = next[0];
+        c[1] = next[1];
+        c[2] = next[2];
+        c[3] = next[3];
+
+        k[0] += PHILOX_W0;
+        k[1] += PHILOX_W1;
+    }
+
+    out[0] = c[0];
+    out[1] = c[1];
+    out[2] = c[2];
+    out[3] = c[3];
+}
+
+/**
+ * Start a stream of random numbers. The stream is the same for the same
+ * seed, purpose, generation and index, whichever thread creates it and
+ * whenever it is created.
+ * @param r The stream.
+ * @param seed The seed of the run.
+ * @param purpose What the numbers are used for, one of the RNG_* macros.
+ * @param generation The generation.
+ * @param index The individual (or other unit of work) the stream is for.
+ */
+void init_rng(struct rng *r, uint64_t seed, uint32_t purpose, uint32_t generation, uint32_t index) {
+    r->key[0] = (uint32_t) seed;
+    r->key[1] = (uint32_t) (seed >> 32);
+    r->counter[0] = 0;
+    r->counter[1] = index;
+    r->counter[2] = generation;
+    r->counter[3] = purpose;
+    r->used = 4;
+}
+
+/**
+ * Return the next random 32-bit word of a stream.
+ * @param r The stream.
+ * @return The random word.
+ */
+uint32_t rng_next(struct rng *r) {
+    if (r->used == 4) {
+        philox4x32(r->counter, r->key, r->output);
+        r->counter[0]++;
+        r->used = 0;
+    }
+
+    return r->output[r->used++];
+}
+
+/**
+ * Generate a random integer between min and max (inclusive), without the
+ * bias of taking a remainder (Lemire, 2019).
+ * @param r The stream.
+ * @param min The minimum value.
+ * @param max The maximum value.
+ * @return The randomly generated integer.
+ */
+int rng_randint(struct rng *r, int min, int max) {
+    uint32_t range = (uint32_t) max - (uint32_t) min + 1;
+
+    // The whole range of 32-bit words.
+    if (range == 0) return (int) ((uint32_t) min + rng_next(r));
+
+    uint64_t product = (uint64_t) rng_next(r) * range;
+    uint32_t low = (uint32_t) product;
+
+    if (low < range) {
+        // Reject the words that would make the low values more likely.
+        uint32_t threshold = -range % range;
+
+        while (low < threshold) {
+            product = (uint64_t) rng_next(r) * range;
+            low = (uint32_t) product;
+        }
+    }
+
+    return (int) ((uint32_t) min + (uint32_t) (product >> 32));
+}
+
+/**
+ * Generate a random probability. Values are 0.0 (inclusive) to 1.0 (exclusive),
+ * with 53 random bits.
+ * @param r The stream.
+ * @return A randomly generated double.
+ */
+double rng_probability(struct rng *r) {
+    uint64_t high = rng_next(r);
+    uint64_t low = rng_next(r);
+
+    return (double) (((high << 32) | low) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Randomly rearrange `n` elements of an array (Fisher-Yates).
+ * @param r The stream.
+ * @param a The array to shuffle.
+ * @param n The length of the array.
+ */
+void rng_shuffle(struct rng *r, int *a, int n) {
+    for (int i = n - 1; i > 0; i--) {
+        int j = rng_randint(r, 0, i);
 
+        swap(&a[i], &a[j]);
+    }
+}
+
+/**
+ * Set the seed of the run from `SEED`, or the time if it is 0. Ensures that
+ * it is only done once per execution.
+ */
+void start_srand() {
     static bool called = false;
 
     if (!called) {
-        srand((unsigned int) (SEED ? SEED : time(NULL)));
+        run_seed = (uint64_t) (SEED ? SEED : time(NULL));
+        use_rng_stream(RNG_SETUP, 0, 0);
         called = true;
     }
 }
 
 /**
- * Generate a random integer between min and max (inclusive).
+ * Make the functions that do not take a stream draw from the given stream,
+ * from its start, in the calling thread. See init_rng(). The streams of
+ * each island are distinct.
+ * @param purpose What the numbers are used for, one of the RNG_* macros.
+ * @param generation The generation.
+ * @param index The individual (or other unit of work) the stream is for.
+ */
+void use_rng_stream(uint32_t purpose, uint32_t generation, uint32_t index) {
+    init_rng(&current_rng, run_seed, purpose | current_island << 16, generation, index);
+}
+
+/**
+ * Get the current stream of the calling thread, where it is now, so
+ * that it can be continued later, possibly in another thread.
+ * @param r Set to the stream.
+ */
+void save_rng_stream(struct rng *r) {
+    *r = current_rng;
+}
+
+/**
+ * Continue a stream saved by save_rng_stream() in the calling thread.
+ * @param r The stream.
+ */
+void restore_rng_stream(const struct rng *r) {
+    current_rng = *r;
+}
+
+/**
+ * Set the island whose streams use_rng_stream() selects in the calling
+ * thread. Island 0 uses the same streams as a run without islands.
+ * @param island The island.
+ */
+void set_rng_island(uint32_t island) {
+    current_island = island;
+}
+
+/**
+ * Get the seed of the run, for creating streams with init_rng().
+ * @return The seed.
+ */
+uint64_t get_rng_seed() {
+    return run_seed;
+}
+
+/**
+ * Generate a random integer between min and max (inclusive), from the
+ * current stream.
  * @param min The minimum value.
  * @param max The maximum value.
  * @return The randomly generated integer.
  */
 int get_randint(int min, int max) {
-    return (rand() % (max + 1 - min)) + min;
+    return rng_randint(&current_rng, min, max);
 }
 
 /**
- * Generate a random probability. Values are 0.0 to 1.0 (inclusive).
+ * Generate a random probability from the current stream. Values are
+ * 0.0 (inclusive) to 1.0 (exclusive).
  * @return A randomly generated double.
  */
 double get_rand_probability() {
-    return (double)rand() / (double)RAND_MAX;
+    return rng_probability(&current_rng);
 }
 
 /**
@@ -52,15 +237,10 @@ int *rand_indexes(int n) {
 }
 
 /**
- * Randomly rearrange `n` elements of an array.
- * In order to work effectively, `n` must be smaller than RAND_MAX.
+ * Randomly rearrange `n` elements of an array, from the current stream.
  * @param a The array to shuffle.
  * @param n The length of the array.
  */
 void shuffle(int *a, int n) {
-    for (int i = n - 1; i > 0; i--) {
-        int j = get_randint(0, i + 1);
-
-        swap(&a[i], &a[j]);
-    }
+    rng_shuffle(&current_rng, a, n);
 }
@@ -0,0 +1,338 @@
+#include "../include/semantic_cache.h"
+
+static void unlink_entry(struct semantic_cache *c, struct semantic_entry *e);
+static void push_newest(struct semantic_cache *c, struct semantic_entry *e);
+static void evict_oldest(struct semantic_cache *c);
+static size_t entry_size(struct semantic_cache *c, int key_len);
+static const double *evaluate_subtree(struct semantic_cache *c, const char *prefix,
+                                      const int *sizes, int i, bool *owned);
+
+/**
+ * Allocate a semantic cache for a dataset.
+ * @param data The fitness cases the cached outputs are computed on.
+ * @param budget The memory the cached entries may use (bytes).
+ * @return The empty cache.
+ */
+struct semantic_cache *init_semantic_cache(struct dataset *data, size_t budget) {
+    struct semantic_cache *c = allocate_m(sizeof(struct semantic_cache));
+
+    c->data = data;
+    c->budget = budget;
+    c->used = 0;
+    c->stamp = 0;
+    c->hits = c->misses = c->evictions = 0;
+    c->newest = c->oldest = NULL;
+
+    // Size the table for the number of vectors that fit in the budget.
+    size_t max_entries = budget / entry_size(c, 0) + 1;
+
+    c->num_buckets = 16;
+
+    while ((size_t) c->num_buckets < max_entries && c->num_buckets < (1 << 24)) {
+        c->num_buckets *= 2;
+    }
+
+    c->buckets = allocate_m(sizeof(struct semantic_entry *) * c->num_buckets);
+
+    for (int i = 0; i < c->num_buckets; i++) {
+        c->buckets[i] = NULL;
+    }
+
+    return c;
+}
+
+/**
+ * Free the memory allocated for a semantic cache and all its entries.
+ * @param c The cache to free.
+ */
+void free_semantic_cache(struct semantic_cache *c) {
+    while (c->oldest) evict_oldest(c);
+
+    free_pointer(c->buckets);
+    free_pointer(c);
+}
+
+/**
+ * Return the 64-bit FNV-1a hash of a string of symbols.
+ * @param symbols The symbols.
+ * @param len The number of symbols.
+ * @return The hash.
+ */
+uint64_t hash_symbols(const char *symbols, int len) {
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (int i = 0; i < len; i++) {
+        hash ^= (unsigned char) symbols[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * Get the cached outputs of a subtree. Returns NULL if the subtree is not
+ * cached. The outputs stay valid until the next evaluation starts.
+ * @param c The cache.
+ * @param hash The hash of the key.
+ * @param key The prefix string of the subtree.
+ * @param key_len The length of the key.
+ * @return The outputs of the subtree, or NULL.
+ */
+const double *get_semantic_cache(struct semantic_cache *c, uint64_t hash, const char *key, int key_len) {
+    struct semantic_entry *e = c->buckets[hash & (uint64_t) (c->num_buckets - 1)];
+
+    for (; e; e = e->chain) {
+        if (e->hash == hash && e->key_len == key_len && !memcmp(e->key, key, (size_t) key_len)) {
+            c->hits++;
+
+            e->stamp = c->stamp;
+            unlink_entry(c, e);
+            push_newest(c, e);
+
+            return e->outputs;
+        }
+    }
+
+    c->misses++;
+
+    return NULL;
+}
+
+/**
+ * Cache the outputs of a subtree. The cache takes ownership of the outputs
+ * if they are stored. Old entries are evicted to stay within the budget,
+ * apart from those used by the current evaluation.
+ * @param c The cache.
+ * @param hash The hash of the key.
+ * @param key The prefix string of the subtree.
+ * @param key_len The length of the key.
+ * @param outputs The outputs of the subtree, `c->data->stride` values.
+ * @return Whether the outputs were stored.
+ */
+bool put_semantic_cache(struct semantic_cache *c, uint64_t hash, const char *key, int key_len, double *outputs) {
+    size_t size = entry_size(c, key_len);
+
+    if (size > c->budget) return false;
+
+    while (c->used + size > c->budget && c->oldest && c->oldest->stamp != c->stamp) {
+        evict_oldest(c);
+    }
+
+    struct semantic_entry *e = allocate_m(sizeof(struct semantic_entry));
+
+    e->hash = hash;
+    e->key = allocate_m((size_t) key_len);
+    memcpy(e->key, key, (size_t) key_len);
+    e->key_len = key_len;
+    e->outputs = outputs;
+    e->stamp = c->stamp;
+
+    int bucket = (int) (hash & (uint64_t) (c->num_buckets - 1));
+
+    e->chain = c->buckets[bucket];
+    c->buckets[bucket] = e;
+
+    push_newest(c, e);
+    c->used += size;
+
+    return true;
+}
+
+/**
+ * Remove an entry from the least-recently-used list.
+ */
+static void unlink_entry(struct semantic_cache *c, struct semantic_entry *e) {
+    if (e->newer) e->newer->older = e->older;
+    else c->newest = e->older;
+
+    if (e->older) e->older->newer = e->newer;
+    else c->oldest = e->newer;
+
+    e->newer = e->older = NULL;
+}
+
+/**
+ * Add an entry to the front of the least-recently-used list.
+ */
+static void push_newest(struct semantic_cache *c, struct semantic_entry *e) {
+    e->newer = NULL;
+    e->older = c->newest;
+
+    if (c->newest) c->newest->newer = e;
+    else c->oldest = e;
+
+    c->newest = e;
+}
+
+/**
+ * Remove and free the least recently used entry.
+ */
+static void evict_oldest(struct semantic_cache *c) {
+    struct semantic_entry *e = c->oldest;
+    struct semantic_entry **link = &c->buckets[e->hash & (uint64_t) (c->num_buckets - 1)];
+
+    while (*link != e) link = &(*link)->chain;
+
+    *link = e->chain;
+
+    unlink_entry(c, e);
+
+    c->used -= entry_size(c, e->key_len);
+    c->evictions++;
+
+    free_pointer(e->outputs);
+    free_pointer(e->key);
+    free_pointer(e);
+}
+
+/**
+ * The memory an entry uses, as counted against the budget.
+ */
+static size_t entry_size(struct semantic_cache *c, int key_len) {
+    return sizeof(struct semantic_entry) + (size_t) key_len + sizeof(double) * (size_t) c->data->stride;
+}
+
+/**
+ * Write the prefix string of a tree and the size of every subtree.
+ * Missing children of functions are written as MISSING_NODE_SYMBOL.
+ * @param node The root of the (sub)tree.
+ * @param prefix The string to write to.
+ * @param sizes The subtree sizes, indexed like the string.
+ * @param pos The next free position.
+ * @return The size of the subtree.
+ */
+int flatten_tree(struct node *node, char *prefix, int *sizes, int *pos) {
+    int i = (*pos)++;
+
+    if (!node) {
+        prefix[i] = MISSING_NODE_SYMBOL;
+        sizes[i] = 1;
+
+        return 1;
+    }
+
+    prefix[i] = node->value;
+    sizes[i] = 1;
+
+    if (strchr("+-*/", node->value)) {
+        sizes[i] += flatten_tree(node->left, prefix, sizes, pos);
+        sizes[i] += flatten_tree(node->right, prefix, sizes, pos);
+    }
+
+    return sizes[i];
+}
+
+/**
+ * Return the outputs of the subtree at index `i` of a prefix string.
+ * Functions are looked up in the cache, and computed from their children
+ * and cached if they are missing.
+ * @param c The cache.
+ * @param prefix The prefix string of the tree.
+ * @param sizes The subtree sizes.
+ * @param i The index of the subtree.
+ * @param owned Set to whether the caller must free the outputs.
+ * @return The outputs, `c->data->stride` values.
+ */
+static const double *evaluate_subtree(struct semantic_cache *c, const char *prefix,
+                                      const int *sizes, int i, bool *owned) {
+    struct dataset *data = c->data;
+    char symbol = prefix[i];
+
+    *owned = false;
+
+    if (isalpha(symbol)) {
+        return data->columns[symbol - (islower(symbol) ? 'a' : 'A')];
+    }
+
+    if (!strchr("+-*/", symbol)) {
+        double *outputs = allocate_m(sizeof(double) * data->stride);
+
+        fill_column(outputs, symbol == MISSING_NODE_SYMBOL ? MISSING_NODE_VALUE : (double) (symbol - '0'),
+                    data->stride);
+        *owned = true;
+
+        return outputs;
+    }
+
+    uint64_t hash = hash_symbols(prefix + i, sizes[i]);
+    const double *cached = get_semantic_cache(c, hash, prefix + i, sizes[i]);
+
+    if (cached) return cached;
+
+    bool left_owned, right_owned;
+    const double *left = evaluate_subtree(c, prefix, sizes, i + 1, &left_owned);
+    const double *right = evaluate_subtree(c, prefix, sizes, i + 1 + sizes[i + 1], &right_owned);
+
+    const struct kernels *k = get_kernels();
+    double *outputs = allocate_m(sizeof(double) * data->stride);
+
+    if (symbol == '+') k->add(outputs, left, right, data->stride);
+    else if (symbol == '-') k->sub(outputs, left, right, data->stride);
+    else if (symbol == '*') k->mul(outputs, left, right, data->stride);
+    else k->pdiv(outputs, left, right, data->stride);
+
+    if (left_owned) free_pointer((void *) left);
+    if (right_owned) free_pointer((void *) right);
+
+    *owned = !put_semantic_cache(c, hash, prefix + i, sizes[i], outputs);
+
+    return outputs;
+}
+
+/**
+ * Return the sum of the squared errors of a tree over the cache's
+ * dataset. Subtrees whose outputs are cached are not evaluated again.
+ * Gives the same result as program_squared_error().
+ * @param c The cache.
+ * @param root The root of the tree.
+ * @return The sum of the squared errors.
+ */
+double semantic_squared_error(struct semantic_cache *c, struct node *root) {
+    struct dataset *data = c->data;
+    const struct kernels *k = get_kernels();
+
+    // A missing child takes a place in the string as well.
+    int max_len = 2 * get_number_of_nodes(root) + 1;
+    char *prefix = allocate_m((size_t) max_len);
+    int *sizes = allocate_m(sizeof(int) * max_len);
+    int pos = 0;
+
+    flatten_tree(root, prefix, sizes, &pos);
+
+    // Entries used from here on are not evicted until the next evaluation.
+    c->stamp++;
+
+    bool owned;
+    const double *outputs = evaluate_subtree(c, prefix, sizes, 0, &owned);
+
+    // Reduce in the same blocks as the interpreter, so that the result
+    // is identical.
+    double total = 0.0;
+
+    for (int start = 0; start < data->len; start += EVAL_BLOCK_SIZE) {
+        int n = (data->len - start < EVAL_BLOCK_SIZE) ? data->len - start : EVAL_BLOCK_SIZE;
+
+        total += k->squared_error(outputs + start, data->targets + start, n);
+    }
+
+    if (owned) free_pointer((void *) outputs);
+
+    free_pointer(prefix);
+    free_pointer(sizes);
+
+    return total;
+}
+
+/**
+ * Print the hit rate and size of a semantic cache, and reset its counters.
+ * @param c The cache.
+ */
+void print_semantic_cache(struct semantic_cache *c) {
+    long lookups = c->hits + c->misses;
+
+    printf("Semantic cache: hits: %ld, misses: %ld, hit rate: %.2f%%, evictions: %ld, size: %.2f/%.2f MB\n",
+           c->hits, c->misses, lookups ? 100.0 * (double) c->hits / (double) lookups : 0.0,
+           c->evictions, (double) c->used / 1e6, (double) c->budget / 1e6);
+
+    c->hits = c->misses = c->evictions = 0;
+}
@@ -0,0 +1,264 @@
+#include "../include/semantics.h"
+
+static const double *node_outputs(struct semantics *s, int i, struct dataset *data,
+                                  struct semantics **origins, int num_origins, bool *owned);
+static bool reuse_subtree(struct semantics *s, int i, struct semantics **origins, int num_origins);
+static int find_subtree(struct semantics *o, uint64_t hash, const char *key, int size);
+static void build_index(struct semantics *s);
+
+// Counters since the last call to print_semantics_stats().
+static long nodes_computed = 0;
+static long nodes_reused = 0;
+
+/**
+ * Evaluate every function node of a tree over a dataset. Subtrees that
+ * also occur in one of the origins (typically the parents) share the
+ * origin's outputs instead of being evaluated.
+ * @param root The root of the tree.
+ * @param data The fitness cases.
+ * @param origins The semantics to reuse outputs from. Entries may be NULL.
+ * @param num_origins The number of origins.
+ * @return The semantics of the tree, with one reference.
+ */
+struct semantics *evaluate_semantics(struct node *root, struct dataset *data,
+                                     struct semantics **origins, int num_origins) {
+    struct semantics *s = allocate_m(sizeof(struct semantics));
+
+    // A missing child takes a place in the string as well.
+    int max_len = 2 * get_number_of_nodes(root) + 1;
+    int pos = 0;
+
+    s->refs = 1;
+    s->prefix = allocate_m((size_t) max_len);
+    s->sizes = allocate_m(sizeof(int) * max_len);
+
+    flatten_tree(root, s->prefix, s->sizes, &pos);
+
+    s->len = pos;
+    s->hashes = allocate_m(sizeof(uint64_t) * s->len);
+    s->outputs = allocate_m(sizeof(struct shared_outputs *) * s->len);
+
+    for (int i = 0; i < s->len; i++) {
+        s->hashes[i] = hash_symbols(s->prefix + i, s->sizes[i]);
+        s->outputs[i] = NULL;
+    }
+
+    bool owned;
+    const double *outputs = node_outputs(s, 0, data, origins, num_origins, &owned);
+
+    if (owned) free_pointer((void *) outputs);
+
+    build_index(s);
+
+    return s;
+}
+
+/**
+ * Return the outputs of the node at index `i`, evaluating it (and its
+ * children) unless it can be taken from an origin.
+ * @param owned Set to whether the caller must free the outputs.
+ */
+static const double *node_outputs(struct semantics *s, int i, struct dataset *data,
+                                  struct semantics **origins, int num_origins, bool *owned) {
+    char symbol = s->prefix[i];
+
+    *owned = false;
+
+    if (isalpha(symbol)) {
+        return data->columns[symbol - (islower(symbol) ? 'a' : 'A')];
+    }
+
+    if (!strchr("+-*/", symbol)) {
+        double *outputs = allocate_m(sizeof(double) * data->stride);
+
+        fill_column(outputs, symbol == MISSING_NODE_SYMBOL ? MISSING_NODE_VALUE : (double) (symbol - '0'),
+                    data->stride);
+        *owned = true;
+
+        return outputs;
+    }
+
+    if (reuse_subtree(s, i, origins, num_origins)) return s->outputs[i]->values;
+
+    bool left_owned, right_owned;
+    const double *left = node_outputs(s, i + 1, data, origins, num_origins, &left_owned);
+    const double *right = node_outputs(s, i + 1 + s->sizes[i + 1], data, origins, num_origins, &right_owned);
+
+    const struct kernels *k = get_kernels();
+    struct shared_outputs *out = allocate_m(sizeof(struct shared_outputs) + sizeof(double) * data->stride);
+
+    out->refs = 1;
+
+    if (symbol == '+') k->add(out->values, left, right, data->stride);
+    else if (symbol == '-') k->sub(out->values, left, right, data->stride);
+    else if (symbol == '*') k->mul(out->values, left, right, data->stride);
+    else k->pdiv(out->values, left, right, data->stride);
+
+    if (left_owned) free_pointer((void *) left);
+    if (right_owned) free_pointer((void *) right);
+
+    s->outputs[i] = out;
+    nodes_computed++;
+
+    return out->values;
+}
+
+/**
+ * Share the outputs of the subtree at index `i` (and of all nodes below
+ * it) with the first origin that contains the same subtree.
+ * @return Whether the subtree was found.
+ */
+static bool reuse_subtree(struct semantics *s, int i, struct semantics **origins, int num_origins) {
+    for (int o = 0; o < num_origins; o++) {
+        if (!origins[o]) continue;
+
+        int j = find_subtree(origins[o], s->hashes[i], s->prefix + i, s->sizes[i]);
+
+        if (j < 0) continue;
+
+        for (int k = 0; k < s->sizes[i]; k++) {
+            struct shared_outputs *out = origins[o]->outputs[j + k];
+
+            if (out) {
+                out->refs++;
+                nodes_reused++;
+            }
+
+            s->outputs[i + k] = out;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Find a subtree with known outputs in a set of semantics.
+ * @param o The semantics to search.
+ * @param hash The hash of the subtree's prefix string.
+ * @param key The prefix string of the subtree.
+ * @param size The size of the subtree.
+ * @return The index of the subtree, or -1 if it was not found.
+ */
+static int find_subtree(struct semantics *o, uint64_t hash, const char *key, int size) {
+    int mask = o->index_size - 1;
+
+    for (int slot = (int) (hash & (uint64_t) mask); o->index[slot] != -1; slot = (slot + 1) & mask) {
+        int j = o->index[slot];
+
+        if (o->hashes[j] == hash && o->sizes[j] == size && !memcmp(o->prefix + j, key, (size_t) size)) {
+            return j;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Build the hash table of the function nodes of a set of semantics.
+ */
+static void build_index(struct semantics *s) {
+    s->index_size = 2;
+
+    while (s->index_size < 2 * s->len) s->index_size *= 2;
+
+    s->index = allocate_m(sizeof(int) * s->index_size);
+
+    for (int slot = 0; slot < s->index_size; slot++) {
+        s->index[slot] = -1;
+    }
+
+    int mask = s->index_size - 1;
+
+    for (int i = 0; i < s->len; i++) {
+        if (!s->outputs[i]) continue;
+
+        int slot = (int) (s->hashes[i] & (uint64_t) mask);
+
+        while (s->index[slot] != -1) slot = (slot + 1) & mask;
+
+        s->index[slot] = i;
+    }
+}
+
+/**
+ * Return the sum of the squared errors of a tree from its semantics.
+ * Gives the same result as program_squared_error().
+ * @param s The semantics of the tree.
+ * @param data The fitness cases the semantics were evaluated on.
+ * @return The sum of the squared errors.
+ */
+double semantics_squared_error(struct semantics *s, struct dataset *data) {
+    const struct kernels *k = get_kernels();
+
+    bool owned = false;
+    const double *outputs;
+
+    if (s->outputs[0]) {
+        outputs = s->outputs[0]->values;
+    } else {
+        // A single terminal.
+        outputs = node_outputs(s, 0, data, NULL, 0, &owned);
+    }
+
+    // Reduce in the same blocks as the interpreter, so that the result
+    // is identical.
+    double total = 0.0;
+
+    for (int start = 0; start < data->len; start += EVAL_BLOCK_SIZE) {
+        int n = (data->len - start < EVAL_BLOCK_SIZE) ? data->len - start : EVAL_BLOCK_SIZE;
+
+        total += k->squared_error(outputs + start, data->targets + start, n);
+    }
+
+    if (owned) free_pointer((void *) outputs);
+
+    return total;
+}
+
+/**
+ * Add a reference to a set of semantics.
+ * @param s The semantics.
+ * @return The semantics.
+ */
+struct semantics *retain_semantics(struct semantics *s) {
+    s->refs++;
+
+    return s;
+}
+
+/**
+ * Remove a reference to a set of semantics. Frees the semantics, and
+ * any outputs no one else shares, when the last reference is removed.
+ * @param s The semantics.
+ */
+void release_semantics(struct semantics *s) {
+    if (--s->refs > 0) return;
+
+    for (int i = 0; i < s->len; i++) {
+        if (s->outputs[i] && --s->outputs[i]->refs == 0) {
+            free_pointer(s->outputs[i]);
+        }
+    }
+
+    free_pointer(s->prefix);
+    free_pointer(s->sizes);
+    free_pointer(s->hashes);
+    free_pointer(s->outputs);
+    free_pointer(s->index);
+    free_pointer(s);
+}
+
+/**
+ * Print how many nodes were evaluated and how many were reused from
+ * the parents, and reset the counters.
+ */
+void print_semantics_stats() {
+    long total = nodes_computed + nodes_reused;
+
+    printf("Incremental evaluation: nodes computed: %ld, nodes reused: %ld, reuse rate: %.2f%%\n",
+           nodes_computed, nodes_reused, total ? 100.0 * (double) nodes_reused / (double) total : 0.0);
+
+    nodes_computed = nodes_reused = 0;
+}
@@ -46,76 +46,21 @@ void test_setup(struct symbols *s) {
 
     start_srand();
 
-    training_len = 3;
-    test_len = 2;
-    int num_columns = 2;
+    double cases[5][2] = {{5, 2}, {4, 2}, {7, 4}, {3, 4}, {6, -3}};
+    double targets[5] = {29, 20, 65, 25, 45};
 
-    targets_len = training_len + test_len;
+    fitness_data = new_dataset(5, 2);
 
-    fitness_cases = allocate_m(sizeof(double *) * targets_len);
-    targets = allocate_m(sizeof(double) * targets_len);
-
-    for (int i=0; i < training_len + test_len; i++) {
-        fitness_cases[i] = allocate_m(sizeof(double) * num_columns);
+    for (int i=0; i < fitness_data->len; i++) {
+        fitness_data->columns[0][i] = cases[i][0];
+        fitness_data->columns[1][i] = cases[i][1];
+        fitness_data->targets[i] = targets[i];
     }
 
-    fitness_cases[0][0] = 5;
-    fitness_cases[0][1] = 2;
-
-    targets[0] = 29;
-
-    fitness_cases[1][0] = 4;
-    fitness_cases[1][1] = 2;
-
-    targets[1] = 20;
-
-    fitness_cases[2][0] = 7;
-    fitness_cases[2][1] = 4;
-
-    targets[2] = 65;
-
-    fitness_cases[3][0] = 3;
-    fitness_cases[3][1] = 4;
-
-    targets[3] = 25;
-
-    fitness_cases[4][0] = 6;
-    fitness_cases[4][0] = -3;
-
-    targets[4] = 45;
-
-    training_cases = allocate_m(sizeof(double *) * training_len);
-    training_targets = allocate_m(sizeof(double) * training_len);
-    test_cases = allocate_m(sizeof(double *) * test_len);
-    test_targets = allocate_m(sizeof(double) * test_len);
-
-    for (int i=0; i < training_len; i++) {
-        training_cases[i] = allocate_m(sizeof(double) * num_columns);
-    }
-
-    for (int i=0; i < test_len; i++) {
-        test_cases[i] = allocate_m(sizeof(double) * num_columns);
-    }
-
-    training_cases[0][0] = fitness_cases[0][0];
-    training_cases[0][1] = fitness_cases[0][1];
-    training_targets[0] = targets[0];
-
-    training_cases[1][0] = fitness_cases[1][0];
-    training_cases[1][1] = fitness_cases[1][1];
-    training_targets[1] = targets[1];
-
-    training_cases[2][0] = fitness_cases[2][0];
-    training_cases[2][1] = fitness_cases[2][1];
-    training_targets[2] = targets[2];
-
-    test_cases[0][0] = fitness_cases[3][0];
-    test_cases[0][1] = fitness_cases[3][1];
-    test_targets[0] = targets[3];
+    int split[] = {0, 1, 2, 3, 4};
 
-    test_cases[1][0] = fitness_cases[4][0];
-    test_cases[1][0] = fitness_cases[4][1];
-    test_targets[1] = targets[4];
+    training_data = dataset_subset(fitness_data, split, 3);
+    test_data = dataset_subset(fitness_data, split + 3, 2);
 }
 
 void run_tests(struct symbols *s) {
@@ -126,25 +71,53 @@ void run_tests(struct symbols *s) {
     get_node_at_index_test();
     get_max_tree_depth_test();
     evaluate_individual_test();
+    run_program_test();
+    kernels_test();
+    dataset_test();
+    jit_test();
+    semantic_cache_test();
+    semantics_test();
+    racing_test();
+    float_evaluation_test();
+    simplify_test();
+    dag_test();
+    thread_pool_test();
+    block_errors_test();
+    rng_test();
+    island_test();
+    migration_test();
+    steady_state_test();
+    variation_test();
+    node_arena_test();
+    prefix_genome_test();
+    fitness_cache_test();
+    fitness_store_test();
+    semantic_deduplication_test();
 }
 
 void get_node_at_index_test() {
     char values[] = {'*', '+', '5', '4', '3'};
+    int depths[] = {0, 1, 2, 2, 1};
 
     struct node *node = new_node('*');
     node->left = new_node('+');
     node->right = new_node('3');
     node->left->right = new_node('4');
     node->left->left = new_node('5');
+    annotate_tree(node);
 
     for (int i=0; i < 5; i++) {
         struct node *n = get_node_at_index_wrapper(node, i);
 
-        if (n->value != values[i]) {
+        if (n->value != values[i] || get_depth_at_index_wrapper(node, i) != depths[i]) {
             fprintf(stderr, "get_node_at_index has been modified and is broken.\n");
         }
     }
 
+    if (get_number_of_nodes(node) != 5 || node->left->size != 3 || node->left->height != 1) {
+        fprintf(stderr, "annotate_tree has been modified and is broken.\n");
+    }
+
     free_node(node);
 
 }
@@ -155,6 +128,7 @@ void get_max_tree_depth_test() {
     node->right = new_node('3');
     node->left->right = new_node('4');
     node->left->left = new_node('5');
+    annotate_tree(node);
 
     if (get_max_tree_depth(node) != 2 || get_max_tree_depth(NULL) != 0) {
         fprintf(stderr, "get_max_tree_depth has been modified and is broken.\n");
@@ -165,17 +139,24 @@ void get_max_tree_depth_test() {
 }
 
 void subtree_mutation_test() {
-    char values[] = {'*', '+', '5', '4', '*', '/', '1', 'b', 'b'};
+    char values[] = {'*', '+', '5', '4', '+', 'a', '1'};
 
     struct node *node = new_node('*');
     node->left = new_node('+');
     node->right = new_node('3');
     node->left->right = new_node('4');
     node->left->left = new_node('5');
+    annotate_tree(node);
 
-    subtree_mutation(node);
+    node = subtree_mutation(node);
 
-    for (int i=0; i < 9; i++) {
+    if (get_number_of_nodes(node) != 7) {
+        fprintf(stderr, "subtree_mutation has been modified and is broken.\n");
+        free_node(node);
+        return;
+    }
+
+    for (int i=0; i < 7; i++) {
         struct node *n = get_node_at_index_wrapper(node, i);
 
         if (!n || n->value != values[i]) {
@@ -187,25 +168,31 @@ void subtree_mutation_test() {
 }
 
 void subtree_crossover_test() {
-    char node_values[] = {'/', '+', '4', '2', '9'};
-    char node1_values[] = {'*', '+', '5', '1', '3'};
+    char node_values[] = {'/', '+', '1', '*', '+', '5', '4', '3', '9'};
+    char node1_values[] = {'2'};
 
     struct node *node = new_node('*');
     node->left = new_node('+');
     node->right = new_node('3');
     node->left->right = new_node('4');
     node->left->left = new_node('5');
+    annotate_tree(node);
 
     struct node *node1 = new_node('/');
     node1->left = new_node('+');
     node1->right = new_node('9');
     node1->left->right = new_node('2');
     node1->left->left = new_node('1');
+    annotate_tree(node1);
 
     struct node **nodes = subtree_crossover(node, node1);
 
+    if (get_number_of_nodes(nodes[1]) != 9 || get_number_of_nodes(nodes[0]) != 1) {
+        fprintf(stderr, "subtree_crossover has been modified and is broken.\n");
+        return;
+    }
 
-    for (int i=0; i < 5; i++) {
+    for (int i=0; i < 9; i++) {
         struct node *n = get_node_at_index_wrapper(nodes[1], i);
 
         if (!n || n->value != node_values[i]) {
@@ -213,7 +200,7 @@ void subtree_crossover_test() {
         }
     }
 
-    for (int i=0; i < 5; i++) {
+    for (int i=0; i < 1; i++) {
         struct node *n = get_node_at_index_wrapper(nodes[0], i);
 
         if (!n || n->value != node1_values[i]) {
@@ -231,6 +218,7 @@ void evaluate_individual_test() {
     node->right = new_node('3');
     node->left->right = new_node('4');
     node->left->left = new_node('5');
+    annotate_tree(node);
 
     struct individual *i = new_individual(node, DEFAULT_FITNESS);
 
@@ -239,4 +227,852 @@ void evaluate_individual_test() {
     if (i->fitness != -299.39999999999998) {
         fprintf(stderr, "evaluate_individual has been modified and is broken.\n");
     }
-}
\ No newline at end of file
+}
+
+void run_program_test() {
+    double fitness_case[] = {3, -2};
+
+    struct node *node = new_node('/');
+    node->left = new_node('-');
+    node->right = new_node('*');
+    node->left->left = new_node('a');
+    node->left->right = new_node('1');
+    node->right->left = new_node('b');
+    node->right->right = new_node('0');
+    annotate_tree(node);
+
+    struct program *p = compile_program(node);
+    double *stack = allocate_m(sizeof(double) * p->max_stack);
+
+    if (p->len != 7 || p->max_stack != 3 ||
+        run_program(p, fitness_case, stack) != evaluate(node, fitness_case)) {
+        fprintf(stderr, "run_program has been modified and is broken.\n");
+    }
+
+    free_pointer(stack);
+    free_program(p);
+    free_node(node);
+}
+
+void kernels_test() {
+    const struct kernels *k = get_kernels();
+
+    double left[] = {1, 2, 3, 4, 5, 6, 7};
+    double right[] = {2, 0.000001, -4, -0.000001, 0.5, 0, -1};
+    double divided[] = {0.5, 2, -0.75, 4, 10, 6, -7};
+    double out[7];
+
+    k->pdiv(out, left, right, 7);
+
+    double expected = 0.0;
+
+    for (int i = 0; i < 7; i++) {
+        if (out[i] != divided[i]) {
+            fprintf(stderr, "The %s division kernel has been modified and is broken.\n", k->name);
+        }
+
+        expected += (left[i] - right[i]) * (left[i] - right[i]);
+    }
+
+    if (fabs(k->squared_error(left, right, 7) - expected) > 1e-9) {
+        fprintf(stderr, "The %s squared error kernel has been modified and is broken.\n", k->name);
+    }
+}
+
+void dataset_test() {
+    int indexes[] = {4, 0, 2};
+
+    struct dataset *subset = dataset_subset(fitness_data, indexes, 3);
+
+    if (subset->stride % DATASET_PADDING != 0 ||
+        (uintptr_t) subset->columns[1] % DATASET_ALIGNMENT != 0 ||
+        subset->columns[1][0] != -3 || subset->targets[2] != 65 ||
+        subset->columns[0][subset->len] != 0) {
+        fprintf(stderr, "dataset_subset has been modified and is broken.\n");
+    }
+
+    free_dataset(subset);
+}
+
+void jit_test() {
+    if (!jit_available()) return;
+
+    // (a - b) / (b * 0 + a / 1)
+    struct node *node = new_node('/');
+    node->left = new_node('-');
+    node->left->left = new_node('a');
+    node->left->right = new_node('b');
+    node->right = new_node('+');
+    node->right->left = new_node('*');
+    node->right->left->left = new_node('b');
+    node->right->left->right = new_node('0');
+    node->right->right = new_node('/');
+    node->right->right->left = new_node('a');
+    node->right->right->right = new_node('1');
+    annotate_tree(node);
+
+    struct program *p = compile_program(node);
+    struct jit_program *j = jit_compile(p);
+
+    if (!j || jit_squared_error(j, fitness_data, HUGE_VAL, NULL) !=
+              program_squared_error(p, fitness_data, HUGE_VAL, NULL)) {
+        fprintf(stderr, "jit_compile has been modified and is broken.\n");
+    }
+
+    if (j) jit_free(j);
+    free_program(p);
+    free_node(node);
+}
+
+void semantic_cache_test() {
+    // (a * b) + (a * b) / 0
+    struct node *node = new_node('+');
+    node->left = new_node('*');
+    node->left->left = new_node('a');
+    node->left->right = new_node('b');
+    node->right = new_node('/');
+    node->right->left = tree_deep_copy(node->left);
+    node->right->right = new_node('0');
+    annotate_tree(node);
+
+    struct semantic_cache *c = init_semantic_cache(fitness_data, 1000000);
+    struct program *p = compile_program(node);
+
+    double expected = program_squared_error(p, fitness_data, HUGE_VAL, NULL);
+
+    if (semantic_squared_error(c, node) != expected || c->hits != 1 || c->misses != 3) {
+        fprintf(stderr, "semantic_squared_error has been modified and is broken.\n");
+    }
+
+    if (semantic_squared_error(c, node) != expected || c->hits != 2) {
+        fprintf(stderr, "The semantic cache has been modified and is broken.\n");
+    }
+
+    free_program(p);
+    free_semantic_cache(c);
+    free_node(node);
+}
+
+void semantics_test() {
+    // (a * b) - (b / 1)
+    struct node *parent = new_node('-');
+    parent->left = new_node('*');
+    parent->left->left = new_node('a');
+    parent->left->right = new_node('b');
+    parent->right = new_node('/');
+    parent->right->left = new_node('b');
+    parent->right->right = new_node('1');
+    annotate_tree(parent);
+
+    // (a * b) + (b / 1)
+    struct node *child = tree_deep_copy(parent);
+    child->value = '+';
+
+    struct semantics *origin = evaluate_semantics(parent, fitness_data, NULL, 0);
+    struct semantics *s = evaluate_semantics(child, fitness_data, &origin, 1);
+    struct program *p = compile_program(child);
+
+    // Only the root is evaluated, both subtrees are shared.
+    if (s->outputs[1] != origin->outputs[1] || s->outputs[4] != origin->outputs[4] ||
+        s->outputs[0] == origin->outputs[0] ||
+        semantics_squared_error(s, fitness_data) != program_squared_error(p, fitness_data, HUGE_VAL, NULL)) {
+        fprintf(stderr, "evaluate_semantics has been modified and is broken.\n");
+    }
+
+    release_semantics(origin);
+    release_semantics(s);
+    free_program(p);
+    free_node(parent);
+    free_node(child);
+}
+
+void racing_test() {
+    struct dataset *d = new_dataset(3 * EVAL_BLOCK_SIZE, 1);
+
+    for (int i = 0; i < d->len; i++) {
+        d->columns[0][i] = i;
+        d->targets[i] = i + 1;
+    }
+
+    // Every case has a squared error of 1.
+    struct node *node = new_node('a');
+    struct program *p = compile_program(node);
+    int evaluated;
+
+    double total = program_squared_error(p, d, EVAL_BLOCK_SIZE + 1, &evaluated);
+
+    if (evaluated != 2 * EVAL_BLOCK_SIZE || total != 2 * EVAL_BLOCK_SIZE ||
+        program_squared_error(p, d, HUGE_VAL, &evaluated) != d->len || evaluated != d->len) {
+        fprintf(stderr, "Racing in program_squared_error has been modified and is broken.\n");
+    }
+
+    free_program(p);
+    free_node(node);
+    free_dataset(d);
+}
+
+void float_evaluation_test() {
+    // a * b - a / 0
+    struct node *node = new_node('-');
+    node->left = new_node('*');
+    node->left->left = new_node('a');
+    node->left->right = new_node('b');
+    node->right = new_node('/');
+    node->right->left = new_node('a');
+    node->right->right = new_node('0');
+    annotate_tree(node);
+
+    struct program *p = compile_program(node);
+    struct float_dataset *f = new_float_dataset(fitness_data);
+
+    double exact = program_squared_error(p, fitness_data, HUGE_VAL, NULL);
+    double approximate = program_squared_error_float(p, f, HUGE_VAL, NULL);
+
+    if (f->stride % FLOAT_DATASET_PADDING != 0 || (uintptr_t) f->columns[1] % DATASET_ALIGNMENT != 0 ||
+        fabs(approximate - exact) > 1e-5 * exact) {
+        fprintf(stderr, "program_squared_error_float has been modified and is broken.\n");
+    }
+
+    free_float_dataset(f);
+    free_program(p);
+    free_node(node);
+}
+
+void simplify_test() {
+    double fitness_case[] = {3, -2};
+
+    // (a * 1 + b / 0) - (1 + 1)
+    struct node *node = new_node('-');
+    node->left = new_node('+');
+    node->left->left = new_node('*');
+    node->left->left->left = new_node('a');
+    node->left->left->right = new_node('1');
+    node->left->right = new_node('/');
+    node->left->right->left = new_node('b');
+    node->left->right->right = new_node('0');
+    node->right = new_node('+');
+    node->right->left = new_node('1');
+    node->right->right = new_node('1');
+    annotate_tree(node);
+
+    struct program *p = compile_program(node);
+    double *stack = allocate_m(sizeof(double) * p->max_stack);
+
+    // a b + 2 -
+    if (p->len != 5 || p->max_stack != 2 || p->code[3].opcode != OP_CONST || p->code[3].constant != 2 ||
+        run_program(p, fitness_case, stack) != evaluate(node, fitness_case)) {
+        fprintf(stderr, "The simplification in compile_program has been modified and is broken.\n");
+    }
+
+    free_pointer(stack);
+    free_program(p);
+    free_node(node);
+}
+
+void dag_test() {
+    // (a * b) - (a * b) / 0, and a * b.
+    struct node *node = new_node('-');
+    node->left = new_node('*');
+    node->left->left = new_node('a');
+    node->left->right = new_node('b');
+    node->right = new_node('/');
+    node->right->left = tree_deep_copy(node->left);
+    node->right->right = new_node('0');
+    annotate_tree(node);
+
+    struct dag *d = new_dag(2 * (get_number_of_nodes(node) + get_number_of_nodes(node->left)) + 2);
+    int roots[2];
+    double errors[2];
+
+    roots[0] = intern_tree(d, node);
+    roots[1] = intern_tree(d, node->left);
+
+    dag_squared_errors(d, roots, 2, fitness_data, errors);
+
+    struct program *p = compile_program(node);
+    struct program *q = compile_program(node->left);
+
+    // a, b, a * b, 0, / and -.
+    if (d->len != 6 || d->interned != 12 || d->nodes[roots[1]].refs != 3 ||
+        errors[0] != program_squared_error(p, fitness_data, HUGE_VAL, NULL) ||
+        errors[1] != program_squared_error(q, fitness_data, HUGE_VAL, NULL)) {
+        fprintf(stderr, "dag_squared_errors has been modified and is broken.\n");
+    }
+
+    free_program(p);
+    free_program(q);
+    free_dag(d);
+    free_node(node);
+}
+
+static void square_task(void *context, int task) {
+    int *values = context;
+
+    values[task] = task * task;
+}
+
+void thread_pool_test() {
+    struct thread_pool *pool = new_thread_pool(3);
+    int values[100];
+    double costs[100];
+
+    for (int i = 0; i < 100; i++) {
+        values[i] = -1;
+        costs[i] = (double) (i % 7);
+    }
+
+    run_thread_pool(pool, square_task, values, costs, 100);
+
+    for (int i = 0; i < 100; i++) {
+        if (values[i] != i * i) {
+            fprintf(stderr, "run_thread_pool has been modified and is broken.\n");
+            break;
+        }
+    }
+
+    free_thread_pool(pool);
+}
+
+void block_errors_test() {
+    struct dataset *d = new_dataset(2 * EVAL_BLOCK_SIZE + 3, 1);
+
+    for (int i = 0; i < d->len; i++) {
+        d->columns[0][i] = i % 13;
+        d->targets[i] = i;
+    }
+
+    // a * a / 3
+    struct node *node = new_node('/');
+    node->left = new_node('*');
+    node->left->left = new_node('a');
+    node->left->right = new_node('a');
+    node->right = new_node('3');
+    annotate_tree(node);
+
+    struct program *p = compile_program(node);
+    double errors[3];
+
+    // Two shards, split between the first and second block.
+    program_block_errors(p, d, 0, EVAL_BLOCK_SIZE, errors);
+    program_block_errors(p, d, EVAL_BLOCK_SIZE, d->len, errors + 1);
+
+    int evaluated;
+
+    if (sum_block_errors(errors, d->len, HUGE_VAL, NULL) != program_squared_error(p, d, HUGE_VAL, NULL) ||
+        sum_block_errors(errors, d->len, errors[0] / 2, &evaluated) != errors[0] ||
+        evaluated != EVAL_BLOCK_SIZE) {
+        fprintf(stderr, "program_block_errors has been modified and is broken.\n");
+    }
+
+    free_program(p);
+    free_node(node);
+    free_dataset(d);
+}
+
+void rng_test() {
+    // Known answers of Philox4x32-10 (Random123).
+    uint32_t zeros[4] = {0, 0, 0, 0};
+    uint32_t ones[4] = {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff};
+    uint32_t out[4], ones_out[4];
+
+    philox4x32(zeros, zeros, out);
+    philox4x32(ones, ones, ones_out);
+
+    bool broken = out[0] != 0x6627e8d5 || out[1] != 0xe169c58d || out[2] != 0xbc57ac4c || out[3] != 0x9b00dbd8 ||
+                  ones_out[0] != 0x408f276d || ones_out[1] != 0x41c83b0e ||
+                  ones_out[2] != 0xa20bc7c6 || ones_out[3] != 0x6d5451fd;
+
+    // The same stream gives the same numbers, another stream different ones.
+    struct rng a, b, c;
+
+    init_rng(&a, 2, RNG_MUTATION, 3, 7);
+    init_rng(&b, 2, RNG_MUTATION, 3, 7);
+    init_rng(&c, 2, RNG_MUTATION, 3, 8);
+
+    int same = 0;
+
+    for (int i = 0; i < 100; i++) {
+        int x = rng_randint(&a, -5, 5);
+        double p = rng_probability(&a);
+
+        if (x < -5 || x > 5 || p < 0.0 || p >= 1.0) broken = true;
+        if (x != rng_randint(&b, -5, 5) || p != rng_probability(&b)) broken = true;
+        if (rng_next(&c) == rng_next(&a)) same++;
+
+        rng_next(&b);
+    }
+
+    int a_shuffled[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    int sum = 0;
+
+    rng_shuffle(&a, a_shuffled, 10);
+
+    for (int i = 0; i < 10; i++) sum += a_shuffled[i];
+
+    if (broken || same > 1 || sum != 45) {
+        fprintf(stderr, "rand_util has been modified and is broken.\n");
+    }
+}
+
+void island_test() {
+    struct mailbox m = {{NULL}, 0, 0};
+    int messages[MAILBOX_CAPACITY];
+    bool broken = false;
+
+    for (int i = 0; i < MAILBOX_CAPACITY; i++) mailbox_send(&m, &messages[i]);
+
+    for (int i = 0; i < MAILBOX_CAPACITY; i++) {
+        if (mailbox_receive(&m) != &messages[i]) broken = true;
+    }
+
+    // Every island receives from the island that sends to it.
+    for (int topology = RING_TOPOLOGY; topology <= RANDOM_TOPOLOGY; topology++) {
+        struct archipelago *a = new_archipelago(5, 10, 2, topology);
+
+        for (int island = 0; island < 5; island++) {
+            int target = get_migration_target(a, island, 4, false);
+
+            if (target == island || get_migration_target(a, target, 4, true) != island) broken = true;
+        }
+
+        free_archipelago(a);
+    }
+
+    if (broken) {
+        fprintf(stderr, "island has been modified and is broken.\n");
+    }
+}
+
+void migration_test() {
+    struct node *node = new_node('*');
+    node->left = new_node('+');
+    node->right = new_node('x');
+    node->left->left = new_node('5');
+    node->left->right = new_node('-');
+    node->left->right->left = new_node('1');
+    annotate_tree(node);
+
+    unsigned char buffer[16];
+    size_t length = encode_genome(node, buffer);
+    const unsigned char *p = buffer;
+    struct node *decoded = decode_genome(&p, buffer + length);
+    char symbols[] = {'*', '+', '5', '-', '1', 'x'};
+    bool broken = length != get_encoded_size(node) || length != 7 || p != buffer + length ||
+                  get_number_of_nodes(decoded) != 6 || decoded->left->right->right != NULL;
+
+    for (int i = 0; i < 6 && !broken; i++) {
+        if (get_node_at_index_wrapper(decoded, i)->value != symbols[i]) broken = true;
+    }
+
+    // A cut short encoding is not read past its end.
+    p = buffer;
+    struct node *partial = decode_genome(&p, buffer + 3);
+
+    if (p != buffer + 3) broken = true;
+
+    if (broken) {
+        fprintf(stderr, "migration has been modified and is broken.\n");
+    }
+
+    free_node(node);
+    free_node(decoded);
+    free_node(partial);
+}
+
+void steady_state_test() {
+    struct individual **pop = allocate_m(sizeof(struct individual *) * POPULATION_SIZE);
+    int tournament_size = TOURNAMENT_SIZE;
+    bool broken = false;
+
+    for (int i = 0; i < POPULATION_SIZE; i++) pop[i] = new_individual(new_node('a'), -i);
+
+    // A tournament of the whole population is won by the best, and lost by the worst.
+    TOURNAMENT_SIZE = POPULATION_SIZE;
+
+    if (pop[steady_state_tournament(pop, false)]->fitness != 0 ||
+        pop[steady_state_tournament(pop, true)]->fitness != 1 - POPULATION_SIZE) {
+        broken = true;
+    }
+
+    TOURNAMENT_SIZE = tournament_size;
+
+    // The other competitors are at least as good as the loser.
+    for (int k = 0; k < 10; k++) {
+        struct individual *loser = pop[steady_state_tournament(pop, true)];
+
+        for (int i = POPULATION_SIZE - TOURNAMENT_SIZE; i < POPULATION_SIZE; i++) {
+            if (pop[i]->fitness < loser->fitness) broken = true;
+        }
+    }
+
+    if (broken) {
+        fprintf(stderr, "steady_state_tournament has been modified and is broken.\n");
+    }
+
+    for (int i = 0; i < POPULATION_SIZE; i++) free_individual(pop[i]);
+
+    free_pointer(pop);
+}
+
+void variation_test() {
+    struct individual **parents = allocate_m(sizeof(struct individual *) * POPULATION_SIZE);
+    struct individual **forward = allocate_m(sizeof(struct individual *) * POPULATION_SIZE);
+    struct individual **backward = allocate_m(sizeof(struct individual *) * POPULATION_SIZE);
+    int num_pairs = (POPULATION_SIZE + 1) / 2;
+    bool broken = false;
+
+    for (int i = 0; i < POPULATION_SIZE; i++) {
+        struct node *node = new_node('+');
+        node->left = new_node(i % 2 ? 'a' : '1');
+        node->right = new_node(i % 3 ? 'b' : '0');
+        annotate_tree(node);
+
+        parents[i] = new_individual(node, DEFAULT_FITNESS);
+    }
+
+    struct variation_batch batch;
+
+    batch.pairs = allocate_m(sizeof(struct individual *) * 2 * num_pairs);
+    batch.streams = allocate_m(sizeof(struct rng) * num_pairs);
+    batch.arena = NULL;
+    batch.generation = 1;
+    batch.evaluate = false;
+
+    pair_parents(parents, &batch);
+
+    // The offspring do not depend on the order the pairs are varied in.
+    batch.new_pop = forward;
+    for (int k = 0; k < num_pairs; k++) variation_task(&batch, k);
+
+    batch.new_pop = backward;
+    for (int k = num_pairs - 1; k >= 0; k--) variation_task(&batch, k);
+
+    for (int i = 0; i < POPULATION_SIZE; i++) {
+        char *s1 = tree_to_string(forward[i]->genome);
+        char *s2 = tree_to_string(backward[i]->genome);
+
+        if (strcmp(s1, s2) != 0) broken = true;
+
+        free_pointer(s1);
+        free_pointer(s2);
+        free_individual(forward[i]);
+        free_individual(backward[i]);
+        free_individual(parents[i]);
+    }
+
+    if (broken) {
+        fprintf(stderr, "variation_task has been modified and is broken.\n");
+    }
+
+    free_pointer(batch.pairs);
+    free_pointer(batch.streams);
+    free_pointer(parents);
+    free_pointer(forward);
+    free_pointer(backward);
+}
+
+void node_arena_test() {
+    struct node_arena *arena = new_node_arena();
+    struct node_arena *previous = use_node_arena(arena);
+
+    // a + b * 1
+    struct node *node = new_node('+');
+    node->left = new_node('a');
+    node->right = new_node('*');
+    node->right->left = new_node('b');
+    node->right->right = new_node('1');
+    annotate_tree(node);
+
+    use_node_arena(previous);
+
+    struct node *heap = tree_deep_copy(node);
+    struct node_arena *survivors = new_node_arena();
+    struct node *copy = compact_tree(node, survivors);
+    char *s1 = tree_to_string(heap);
+    char *s2 = tree_to_string(copy);
+
+    free_node_arena(arena);
+
+    // The copy is in depth-first order.
+    bool broken = heap->in_arena || !copy->in_arena || strcmp(s1, s2) != 0 ||
+                  copy->left != copy + 1 || copy->right != copy + 2 || copy->right->right != copy + 4;
+
+    if (broken) {
+        fprintf(stderr, "node_arena has been modified and is broken.\n");
+    }
+
+    free_pointer(s1);
+    free_pointer(s2);
+    free_node(heap);
+    free_node_arena(survivors);
+}
+
+void prefix_genome_test() {
+    // (a + b) * 1 and 0 - (b / a)
+    struct node *t1 = new_node('*');
+    t1->left = new_node('+');
+    t1->left->left = new_node('a');
+    t1->left->right = new_node('b');
+    t1->right = new_node('1');
+    annotate_tree(t1);
+
+    struct node *t2 = new_node('-');
+    t2->left = new_node('0');
+    t2->right = new_node('/');
+    t2->right->left = new_node('b');
+    t2->right->right = new_node('a');
+    annotate_tree(t2);
+
+    struct prefix_genome *g1 = new_prefix_genome(t1);
+    struct prefix_genome *g2 = new_prefix_genome(t2);
+    bool broken = strcmp(g1->symbols, "*+ab1") != 0 || g1->sizes[1] != 3 || g1->depths[2] != 2 ||
+                  get_prefix_subtree_depth(g1, 0) != 2 || get_prefix_subtree_depth(g1, 1) != 1;
+
+    // Splicing gives the same tree as replacing the subtree.
+    struct prefix_genome *spliced = splice_prefix_genome(g1, 1, g2, 2);
+    struct node *replaced = replace_subtree(t1, 1, retain_node(t2->right));
+    struct node *rebuilt = prefix_genome_to_tree(spliced);
+    char *s1 = tree_to_string(replaced);
+    char *s2 = tree_to_string(rebuilt);
+
+    if (strcmp(s1, spliced->symbols) != 0 || strcmp(s1, s2) != 0 || spliced->sizes[0] != 5 ||
+        spliced->depths[2] != 2 || get_max_tree_depth(rebuilt) != get_prefix_subtree_depth(spliced, 0)) {
+        broken = true;
+    }
+
+    free_pointer(s1);
+    free_pointer(s2);
+
+    // Crossover on prefix genomes gives the same children as on trees.
+    for (int k = 0; k < 20 && !broken; k++) {
+        struct rng stream;
+
+        use_rng_stream(RNG_VARIATION, 0, (uint32_t) k);
+        save_rng_stream(&stream);
+
+        struct node **trees = subtree_crossover(t1, t2);
+
+        restore_rng_stream(&stream);
+
+        struct prefix_genome **genomes = prefix_crossover(g1, g2);
+
+        for (int i = 0; i < 2; i++) {
+            char *s = tree_to_string(trees[i]);
+
+            if (strcmp(s, genomes[i]->symbols) != 0) broken = true;
+
+            free_pointer(s);
+            free_node(trees[i]);
+            free_prefix_genome(genomes[i]);
+        }
+
+        free_pointer(trees);
+        free_pointer(genomes);
+    }
+
+    if (broken) {
+        fprintf(stderr, "prefix_genome has been modified and is broken.\n");
+    }
+
+    free_node(t1);
+    free_node(t2);
+    free_node(replaced);
+    free_node(rebuilt);
+    free_prefix_genome(g1);
+    free_prefix_genome(g2);
+    free_prefix_genome(spliced);
+}
+
+void fitness_cache_test() {
+    // a * b, a + b and a
+    struct node *t1 = new_node('*');
+    t1->left = new_node('a');
+    t1->right = new_node('b');
+    annotate_tree(t1);
+    struct node *t2 = new_node('+');
+    t2->left = new_node('a');
+    t2->right = new_node('b');
+    annotate_tree(t2);
+    struct node *t3 = new_node('a');
+
+    char *key = tree_to_string(t1);
+
+    if (hash_tree(t1) != hash_symbols(key, 3)) {
+        fprintf(stderr, "hash_tree has been modified and is broken.\n");
+    }
+
+    struct fitness_cache *c = init_fitness_cache(2);
+    double fitness = 0;
+
+    put_fitness_cache(c, hash_tree(t1), t1, -1.0);
+    put_fitness_cache(c, hash_tree(t2), t2, -2.0);
+
+    // A genome with the hash of another is not mistaken for it.
+    if (!get_fitness_cache(c, hash_tree(t1), t1, &fitness) || fitness != -1.0 ||
+        get_fitness_cache(c, hash_tree(t1), t2, &fitness) || c->hits != 1 || c->misses != 1) {
+        fprintf(stderr, "get_fitness_cache has been modified and is broken.\n");
+    }
+
+    // The cache is full, so one of the entries is evicted.
+    put_fitness_cache(c, hash_tree(t3), t3, -3.0);
+
+    if (!get_fitness_cache(c, hash_tree(t3), t3, &fitness) || fitness != -3.0 ||
+        c->len != 2 || c->evictions != 1) {
+        fprintf(stderr, "put_fitness_cache has been modified and is broken.\n");
+    }
+
+    free_fitness_cache(c);
+    free_pointer(key);
+    free_node(t1);
+    free_node(t2);
+    free_node(t3);
+}
+
+void fitness_store_test() {
+    // a * b and a + b
+    struct node *t1 = new_node('*');
+    t1->left = new_node('a');
+    t1->right = new_node('b');
+    annotate_tree(t1);
+    struct node *t2 = new_node('+');
+    t2->left = new_node('a');
+    t2->right = new_node('b');
+    annotate_tree(t2);
+
+    const char *path = "fitness_store_test.bin";
+    double fitness = 0;
+
+    remove(path);
+
+    struct fitness_store *s = open_fitness_store(path, 1);
+
+    // Not supported on this platform.
+    if (!s) return;
+
+    // A genome is appended once.
+    put_fitness_store(s, hash_tree(t1), t1, -1.0);
+    put_fitness_store(s, hash_tree(t1), t1, -1.0);
+
+    if (s->added != 1) {
+        fprintf(stderr, "put_fitness_store has been modified and appends duplicates.\n");
+    }
+
+    close_fitness_store(s);
+
+    // The records are found after the file is opened again.
+    s = open_fitness_store(path, 1);
+
+    if (!get_fitness_store(s, hash_tree(t1), t1, &fitness) || fitness != -1.0 ||
+        get_fitness_store(s, hash_tree(t1), t2, &fitness) || s->len != 1) {
+        fprintf(stderr, "The fitness cache file has been modified and is broken.\n");
+    }
+
+    // A genome with a record in the file is not appended again.
+    put_fitness_store(s, hash_tree(t1), t1, -1.0);
+    put_fitness_store(s, hash_tree(t2), t2, -2.0);
+
+    if (s->added != 1) {
+        fprintf(stderr, "put_fitness_store has been modified and appends duplicates.\n");
+    }
+
+    close_fitness_store(s);
+
+    // Records of other fitness cases are not used.
+    s = open_fitness_store(path, 2);
+
+    if (get_fitness_store(s, hash_tree(t1), t1, &fitness) || s->len != 0) {
+        fprintf(stderr, "open_fitness_store has been modified and is broken.\n");
+    }
+
+    close_fitness_store(s);
+    remove(path);
+    free_node(t1);
+    free_node(t2);
+}
+
+void semantic_deduplication_test() {
+    struct dataset *d = new_dataset(5, 2);
+
+    for (int i = 0; i < d->len; i++) {
+        d->columns[0][i] = i - 2;
+        d->columns[1][i] = 3 - i;
+        d->targets[i] = 0;
+    }
+
+    // a * b, b * a, a + b, a * 0 and a - a
+    struct node *t1 = new_node('*');
+    t1->left = new_node('a');
+    t1->right = new_node('b');
+    annotate_tree(t1);
+    struct node *t2 = new_node('*');
+    t2->left = new_node('b');
+    t2->right = new_node('a');
+    annotate_tree(t2);
+    struct node *t3 = new_node('+');
+    t3->left = new_node('a');
+    t3->right = new_node('b');
+    annotate_tree(t3);
+    struct node *t4 = new_node('*');
+    t4->left = new_node('a');
+    t4->right = new_node('0');
+    annotate_tree(t4);
+    struct node *t5 = new_node('-');
+    t5->left = new_node('a');
+    t5->right = new_node('a');
+    annotate_tree(t5);
+
+    double o1[5], o2[5], o3[5], o4[5], o5[5];
+    int key_len = (int) sizeof(o1);
+
+    get_probe_outputs(d, t1, o1);
+    get_probe_outputs(d, t2, o2);
+    get_probe_outputs(d, t3, o3);
+    get_probe_outputs(d, t4, o4);
+    get_probe_outputs(d, t5, o5);
+
+    if (memcmp(o1, o2, sizeof(o1)) || o1[0] != -6) {
+        fprintf(stderr, "get_probe_outputs has been modified and is broken.\n");
+    }
+
+    // a * 0 is -0.0 where a is negative, and a - a is 0.0 everywhere, but
+    // their outputs are the same key.
+    struct program *p = compile_program(t4);
+    double stack[4];
+    double fitness_case[2] = {-2, 5};
+
+    if (!signbit(run_program(p, fitness_case, stack)) || signbit(o4[0]) ||
+        memcmp(o4, o5, sizeof(o4))) {
+        fprintf(stderr, "get_probe_outputs has been modified and does not normalize zeros.\n");
+    }
+
+    free_program(p);
+
+    struct fitness_cache *c = init_fitness_cache(4);
+    double fitness = 0;
+
+    put_fitness_cache_key(c, hash_symbols((char *) o1, key_len), (char *) o1, key_len, -1.0);
+
+    // b * a gets the fitness of a * b, but a + b does not.
+    if (!get_fitness_cache_key(c, hash_symbols((char *) o2, key_len), (char *) o2, key_len, &fitness) ||
+        fitness != -1.0 ||
+        get_fitness_cache_key(c, hash_symbols((char *) o3, key_len), (char *) o3, key_len, &fitness) ||
+        put_fitness_cache_key(c, hash_symbols((char *) o2, key_len), (char *) o2, key_len, -2.0)) {
+        fprintf(stderr, "get_fitness_cache_key has been modified and is broken.\n");
+    }
+
+    // a - a gets the fitness of a * 0.
+    put_fitness_cache_key(c, hash_symbols((char *) o4, key_len), (char *) o4, key_len, -3.0);
+
+    if (!get_fitness_cache_key(c, hash_symbols((char *) o5, key_len), (char *) o5, key_len, &fitness) ||
+        fitness != -3.0) {
+        fprintf(stderr, "get_fitness_cache_key has been modified and does not match zeros.\n");
+    }
+
+    free_fitness_cache(c);
+    free_node(t1);
+    free_node(t2);
+    free_node(t3);
+    free_node(t4);
+    free_node(t5);
+    free_dataset(d);
+}
@@ -0,0 +1,339 @@
+// Needed for pthreads in strict C99 mode.
+#define _POSIX_C_SOURCE 200809L
+
+#include "../include/thread_pool.h"
+
+/**
+ * A task and its estimated cost, for ordering the tasks of a batch.
+ */
+struct costed_task {
+    double cost;
+    int task;
+};
+
+static int cost_comp(const void *elem1, const void *elem2);
+static void fill_queues(struct thread_pool *pool, const double *costs, int num_tasks);
+static bool take_task(struct thread_pool *pool, int id, int *task);
+static void work(struct thread_pool *pool, int id);
+
+#ifdef PONY_GP_THREADS
+static void *worker_main(void *arg);
+#endif
+
+/**
+ * Start a pool of worker threads.
+ * @param num_threads The number of workers, including the calling thread.
+ *                    Without thread support the pool always has one.
+ * @return The pool.
+ */
+struct thread_pool *new_thread_pool(int num_threads) {
+    struct thread_pool *pool = allocate_m(sizeof(struct thread_pool));
+
+    if (num_threads < 1) num_threads = 1;
+
+#ifndef PONY_GP_THREADS
+    if (num_threads > 1) {
+        fprintf(stderr, "Threads are not supported here. Using one thread.\n");
+        num_threads = 1;
+    }
+#endif
+
+    pool->num_threads = num_threads;
+    pool->queues = allocate_m(sizeof(struct pool_queue) * num_threads);
+    pool->run = NULL;
+    pool->context = NULL;
+    pool->batch = 0;
+    pool->busy = 0;
+    pool->shutdown = false;
+
+    for (int i = 0; i < num_threads; i++) {
+        struct pool_queue *q = &pool->queues[i];
+
+        q->tasks = NULL;
+        q->head = q->tail = 0;
+        q->stolen = 0;
+        q->pool = pool;
+    }
+
+#ifdef PONY_GP_THREADS
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (int i = 0; i < num_threads; i++) {
+        pthread_mutex_init(&pool->queues[i].lock, NULL);
+    }
+
+    pool->threads = allocate_m(sizeof(pthread_t) * num_threads);
+
+    // Worker 0 is the calling thread.
+    for (int i = 1; i < num_threads; i++) {
+        pthread_create(&pool->threads[i], NULL, worker_main, &pool->queues[i]);
+    }
+#endif
+
+    return pool;
+}
+
+/**
+ * Stop the workers of a pool and free the memory allocated for it.
+ * @param pool The pool to free.
+ */
+void free_thread_pool(struct thread_pool *pool) {
+#ifdef PONY_GP_THREADS
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; i < pool->num_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    for (int i = 0; i < pool->num_threads; i++) {
+        pthread_mutex_destroy(&pool->queues[i].lock);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->done);
+
+    free_pointer(pool->threads);
+#endif
+
+    free_pointer(pool->queues);
+    free_pointer(pool);
+}
+
+/**
+ * Run a batch of tasks on the pool and wait for all of them to finish.
+ * The most expensive tasks are dealt out first, each to the worker with
+ * the least work so far. A worker that runs out of tasks steals the
+ * cheapest remaining task of another worker, so that a few expensive
+ * tasks do not leave the other workers idle. Tasks must not depend on
+ * the order they are run in.
+ * @param pool The pool.
+ * @param run The task function.
+ * @param context The first argument of the task function.
+ * @param costs The estimated cost of each task.
+ * @param num_tasks The number of tasks.
+ */
+void run_thread_pool(struct thread_pool *pool, pool_task run, void *context, const double *costs, int num_tasks) {
+    if (pool->num_threads == 1 || num_tasks < 2) {
+        for (int task = 0; task < num_tasks; task++) {
+            run(context, task);
+        }
+
+        return;
+    }
+
+    fill_queues(pool, costs, num_tasks);
+
+    pool->run = run;
+    pool->context = context;
+
+#ifdef PONY_GP_THREADS
+    pthread_mutex_lock(&pool->lock);
+    pool->busy = pool->num_threads - 1;
+    pool->batch++;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+#endif
+
+    work(pool, 0);
+
+#ifdef PONY_GP_THREADS
+    pthread_mutex_lock(&pool->lock);
+
+    while (pool->busy > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+#endif
+
+    for (int i = 0; i < pool->num_threads; i++) {
+        free_pointer(pool->queues[i].tasks);
+        pool->queues[i].tasks = NULL;
+    }
+}
+
+/**
+ * Print the number of workers of a pool and the number of tasks stolen
+ * since the last call. May be called from a task.
+ * @param pool The pool.
+ */
+void print_thread_pool(struct thread_pool *pool) {
+    long stolen = 0;
+
+    for (int i = 0; i < pool->num_threads; i++) {
+#ifdef PONY_GP_THREADS
+        pthread_mutex_lock(&pool->queues[i].lock);
+#endif
+
+        stolen += pool->queues[i].stolen;
+        pool->queues[i].stolen = 0;
+
+#ifdef PONY_GP_THREADS
+        pthread_mutex_unlock(&pool->queues[i].lock);
+#endif
+    }
+
+    printf("Threads: %d, tasks stolen: %ld\n", pool->num_threads, stolen);
+}
+
+/**
+ * Helper function to order tasks by decreasing cost. Use with `qsort`.
+ */
+static int cost_comp(const void *elem1, const void *elem2) {
+    const struct costed_task *t1 = elem1;
+    const struct costed_task *t2 = elem2;
+
+    if (t1->cost < t2->cost) return 1;
+    if (t1->cost > t2->cost) return -1;
+
+    return t1->task - t2->task;
+}
+
+/**
+ * Deal the tasks of a batch out to the queues of the workers, the most
+ * expensive first, each to the worker with the least work so far.
+ * @param pool The pool.
+ * @param costs The estimated cost of each task.
+ * @param num_tasks The number of tasks.
+ */
+static void fill_queues(struct thread_pool *pool, const double *costs, int num_tasks) {
+    struct costed_task *order = allocate_m(sizeof(struct costed_task) * num_tasks);
+    int *owners = allocate_m(sizeof(int) * num_tasks);
+    double *loads = allocate_m(sizeof(double) * pool->num_threads);
+
+    for (int t = 0; t < num_tasks; t++) {
+        order[t].cost = costs[t];
+        order[t].task = t;
+    }
+
+    qsort(order, (size_t) num_tasks, sizeof(*order), cost_comp);
+
+    for (int i = 0; i < pool->num_threads; i++) {
+        loads[i] = 0.0;
+        pool->queues[i].head = pool->queues[i].tail = 0;
+    }
+
+    for (int t = 0; t < num_tasks; t++) {
+        int least = 0;
+
+        for (int i = 1; i < pool->num_threads; i++) {
+            if (loads[i] < loads[least]) least = i;
+        }
+
+        loads[least] += order[t].cost;
+        owners[t] = least;
+        pool->queues[least].tail++;
+    }
+
+    for (int i = 0; i < pool->num_threads; i++) {
+        struct pool_queue *q = &pool->queues[i];
+
+        q->tasks = allocate_m(sizeof(int) * (q->tail ? q->tail : 1));
+        q->tail = 0;
+    }
+
+    // Every queue is in order of decreasing cost.
+    for (int t = 0; t < num_tasks; t++) {
+        struct pool_queue *q = &pool->queues[owners[t]];
+
+        q->tasks[q->tail++] = order[t].task;
+    }
+
+    free_pointer(order);
+    free_pointer(owners);
+    free_pointer(loads);
+}
+
+/**
+ * Take the next task of a worker, or steal one from another worker.
+ * @param pool The pool.
+ * @param id The worker.
+ * @param task Set to the task.
+ * @return Whether a task was found.
+ */
+static bool take_task(struct thread_pool *pool, int id, int *task) {
+    for (int k = 0; k < pool->num_threads; k++) {
+        int victim = (id + k) % pool->num_threads;
+        struct pool_queue *q = &pool->queues[victim];
+        bool found = false;
+
+#ifdef PONY_GP_THREADS
+        pthread_mutex_lock(&q->lock);
+#endif
+
+        if (q->head < q->tail) {
+            found = true;
+
+            if (victim == id) {
+                *task = q->tasks[q->head++];
+            } else {
+                *task = q->tasks[--q->tail];
+                q->stolen++;
+            }
+        }
+
+#ifdef PONY_GP_THREADS
+        pthread_mutex_unlock(&q->lock);
+#endif
+
+        if (found) return true;
+    }
+
+    return false;
+}
+
+/**
+ * Run tasks until no worker has any left.
+ * @param pool The pool.
+ * @param id The worker.
+ */
+static void work(struct thread_pool *pool, int id) {
+    int task;
+
+    while (take_task(pool, id, &task)) {
+        pool->run(pool->context, task);
+    }
+}
+
+#ifdef PONY_GP_THREADS
+/**
+ * The main loop of a worker thread. Waits for a batch, works on it,
+ * and reports back when there is nothing left to do.
+ * @param arg The queue of the worker.
+ */
+static void *worker_main(void *arg) {
+    struct pool_queue *queue = arg;
+    struct thread_pool *pool = queue->pool;
+    int id = (int) (queue - pool->queues);
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+
+    for (;;) {
+        while (!pool->shutdown && pool->batch == seen) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+
+        if (pool->shutdown) break;
+
+        seen = pool->batch;
+        pthread_mutex_unlock(&pool->lock);
+
+        work(pool, id);
+
+        pthread_mutex_lock(&pool->lock);
+
+        if (--pool->busy == 0) pthread_cond_signal(&pool->done);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+#endif